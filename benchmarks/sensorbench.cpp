@@ -0,0 +1,405 @@
+// End-to-end throughput benchmark on synthetic scenarios (see Scenario.h).
+//
+//   sensorbench [--sizes 256,512,1024] [--threads 1,4] [--sensors frame,linescan]
+//               [--seed 1] [--repeat 3] [--dem-cells 256] [--tile 64]
+//
+// For every sensor, square image size and thread count it times, on an execution::ThreadPool:
+//
+//   imageToGround      the batch SensorModel::imageToGround of every pixel center
+//   backplane          backplane::compute of phase, emission, incidence and resolution, in
+//                      line blocks
+//   backplane_hilbert  the same along a ground-aware execution::TraversalSchedule
+//   shadow             a TerrainVisibility shadow mask of every pixel's ground point on the
+//                      DEM, in raster order
+//   shadow_hilbert     the same along the schedule
+//
+// and prints one CSV row per stage. A row's pixels_per_second is the best of --repeat runs.
+// Shadow rows also count the misses of a simulated 32 KiB, 8-way data cache and 64-entry TLB
+// on the horizon map reads, in single-threaded processing order, to show how much the
+// schedule reduces them independently of the machine.
+// The scenario fingerprint identifies the generated geometry and the checksum the results,
+// so rows from different releases are comparable when both match; the format column changes
+// whenever the meaning of a column does.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Backplane.h"
+#include "Encoding.h"
+#include "Scenario.h"
+#include "sensorcore.h"
+#include "Sensor.h"
+#include "SensorModel.h"
+#include "TerrainVisibility.h"
+#include "ThreadPool.h"
+#include "Traversal.h"
+
+namespace {
+
+  const int FORMAT = 2;
+
+
+  struct Options {
+    std::vector<int64_t> sizes;
+    std::vector<int64_t> threads;
+    std::vector<std::string> sensors;
+    uint64_t seed;
+    int repeat;
+    int64_t elevationCells;
+    int tileSize;
+  };
+
+
+  int usage() {
+    std::cerr << "usage: sensorbench [--sizes N,...] [--threads N,...] "
+                 "[--sensors frame,linescan] [--seed N] [--repeat N] [--dem-cells N] "
+                 "[--tile N]\n";
+    return 2;
+  }
+
+
+  std::vector<std::string> split(const std::string &list) {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+      items.push_back(item);
+    }
+    return items;
+  }
+
+
+  std::vector<int64_t> numbers(const std::string &list) {
+    std::vector<int64_t> values;
+    std::vector<std::string> items = split(list);
+    for (size_t i = 0; i < items.size(); i++) {
+      values.push_back(std::atoll(items[i].c_str()));
+      if (values.back() <= 0) {
+        throw std::invalid_argument("Expected positive numbers in " + list);
+      }
+    }
+    return values;
+  }
+
+
+  // Best wall-clock time of repeat runs, in seconds.
+  double best(int repeat, const std::function<void()> &run) {
+    double fastest = 0.0;
+    for (int i = 0; i < repeat; i++) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      run();
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                     - start).count();
+      fastest = i == 0 ? seconds : std::min(fastest, seconds);
+    }
+    return fastest;
+  }
+
+
+  // A set-associative LRU cache of fixed-size blocks (cache lines, or pages for a TLB) that
+  // counts the misses of an address trace.
+  class CacheModel {
+
+    public:
+      CacheModel(uint64_t blockBytes, size_t sets, size_t ways)
+          : m_blockBytes(blockBytes), m_ways(ways), m_sets(sets), m_misses(0) {
+      }
+
+      void access(uint64_t address) {
+        uint64_t block = address / m_blockBytes;
+        std::vector<uint64_t> &set = m_sets[block % m_sets.size()];
+        std::vector<uint64_t>::iterator found = std::find(set.begin(), set.end(), block);
+        if (found != set.end()) {
+          set.erase(found);
+        }
+        else {
+          m_misses++;
+          if (set.size() == m_ways) {
+            set.pop_back();
+          }
+        }
+        set.insert(set.begin(), block);
+      }
+
+      uint64_t misses() const {
+        return m_misses;
+      }
+
+    private:
+      uint64_t m_blockBytes;
+      size_t m_ways;
+      std::vector<std::vector<uint64_t> > m_sets;  // Most recently used first.
+      uint64_t m_misses;
+  };
+
+
+  struct Misses {
+    uint64_t cache;
+    uint64_t tlb;
+  };
+
+
+  // Simulated misses of the horizon map reads of a shadow mask over the points, taken in the
+  // passed order: one 4-byte read per point, at its nearest DEM cell and the sun's azimuth.
+  Misses simulate(const shapemodel::TerrainVisibility &terrain, const std::vector<double> &local,
+                  const std::vector<int64_t> &order, const double sunDirection[3]) {
+    const shapemodel::ElevationModel &dem = terrain.elevation();
+    double azimuth = std::atan2(sunDirection[1], sunDirection[0]);
+    if (azimuth < 0.0) {
+      azimuth += 2.0 * M_PI;
+    }
+    uint64_t azimuthIndex = uint64_t(azimuth / (2.0 * M_PI) * terrain.azimuths())
+                            % uint64_t(terrain.azimuths());
+    CacheModel cache(64, 64, 8), tlb(4096, 16, 4);
+    for (size_t i = 0; i < order.size(); i++) {
+      const double *point = &local[3 * order[i]];
+      double line = std::floor((point[1] - dem.originY()) / dem.spacing() + 0.5);
+      double sample = std::floor((point[0] - dem.originX()) / dem.spacing() + 0.5);
+      if (!(line >= 0.0 && sample >= 0.0 && line < dem.lines() && sample < dem.samples())) {
+        continue;
+      }
+      uint64_t cell = uint64_t(line) * uint64_t(dem.samples()) + uint64_t(sample);
+      uint64_t address = (cell * terrain.azimuths() + azimuthIndex) * sizeof(float);
+      cache.access(address);
+      tlb.access(address);
+    }
+    Misses misses = {cache.misses(), tlb.misses()};
+    return misses;
+  }
+
+
+  void report(const std::string &sensor, int64_t size, int64_t threads, const char *stage,
+              int64_t pixels, double seconds, double checksum, uint64_t fingerprint,
+              const Misses *misses = NULL) {
+    std::printf("%d,%s,%lld,%lld,%lld,%s,%lld,%.6f,%.4e,%.9g,%016llx,", FORMAT,
+                sensor.c_str(), (long long)size, (long long)size, (long long)threads, stage,
+                (long long)pixels, seconds, double(pixels) / seconds, checksum,
+                (unsigned long long)fingerprint);
+    if (misses) {
+      std::printf("%llu,%llu\n", (unsigned long long)misses->cache,
+                  (unsigned long long)misses->tlb);
+    }
+    else {
+      std::printf(",\n");
+    }
+    std::fflush(stdout);
+  }
+
+
+  void run(const Options &options, const std::string &sensorName, int64_t size) {
+    scenario::ScenarioOptions scenarioOptions;
+    scenarioOptions.seed = options.seed;
+    scenarioOptions.sensor = sensorName == "linescan" ? scenario::LineScanner
+                                                      : scenario::FrameCamera;
+    scenarioOptions.lines = size;
+    scenarioOptions.samples = size;
+    scenarioOptions.elevationCells = options.elevationCells;
+    scenario::Scenario scenario = scenario::createScenario(scenarioOptions);
+    const SensorModel &model = *scenario.model;
+    Sensor sensor(scenario.model.get(), scenario.illuminatorPosition);
+    sensor.setDetector(scenarioOptions.focalLength, scenarioOptions.pixelPitch, 1.0);
+    shapemodel::TerrainVisibility terrain(scenario.elevation);
+    CartesianVector sun = scenario.toLocalDirection(CartesianVector(
+        scenario.illuminatorPosition.x - scenario.center.x,
+        scenario.illuminatorPosition.y - scenario.center.y,
+        scenario.illuminatorPosition.z - scenario.center.z));
+    const double sunDirection[3] = {sun.x, sun.y, sun.z};
+
+    int64_t pixels = size * size;
+    std::vector<CartesianPoint> ground(pixels);
+    std::vector<double> local(3 * pixels);
+    std::vector<uint8_t> shadowed(pixels);
+
+    // Image tiles grouped by the 16 x 16 cell DEM tile their center sees.
+    execution::TraversalSchedule schedule(model, size, size, options.tileSize,
+                                          scenario.elevationTiles(16));
+    std::vector<int64_t> rasterOrder(pixels), scheduleOrder;
+    scheduleOrder.reserve(pixels);
+    for (int64_t i = 0; i < pixels; i++) {
+      rasterOrder[i] = i;
+    }
+    for (size_t i = 0; i < schedule.size(); i++) {
+      const execution::ImageTile &tile = schedule[i];
+      for (int64_t line = tile.firstLine; line < tile.firstLine + tile.lines; line++) {
+        for (int64_t sample = tile.firstSample; sample < tile.firstSample + tile.samples;
+             sample++) {
+          scheduleOrder.push_back(line * size + sample);
+        }
+      }
+    }
+
+    for (size_t t = 0; t < options.threads.size(); t++) {
+      int64_t threads = options.threads[t];
+      execution::ThreadPool pool(static_cast<int>(threads));
+      int64_t blocks = std::min<int64_t>(size, 4 * threads);
+      // Backplane output placed on the nodes of the line blocks that write it, as an
+      // application using this pool would allocate it.
+      execution::FirstTouchBuffer<double> values(pool, size, size_t(size), blocks);
+      double *output = values.data();
+
+      double seconds = best(options.repeat, [&]() {
+        pool.parallelFor(blocks, [&](int64_t block) {
+          std::vector<ImagePoint> images(size);
+          int64_t end = execution::blockBegin(block + 1, blocks, size);
+          for (int64_t line = execution::blockBegin(block, blocks, size); line < end; line++) {
+            for (int64_t sample = 0; sample < size; sample++) {
+              images[sample] = ImagePoint(sample + 0.5, line + 0.5, 1.0);
+            }
+            model.imageToGround(images.data(), size, &ground[line * size]);
+          }
+        });
+      });
+      double checksum = 0.0;
+      for (int64_t i = 0; i < pixels; i++) {
+        checksum += std::isnan(ground[i].x) ? 0.0 : ground[i].x + ground[i].y + ground[i].z;
+      }
+      report(sensorName, size, threads, "imageToGround", pixels, seconds, checksum,
+             scenario.fingerprint);
+
+      const backplane::Quantity quantities[4] = {backplane::Phase, backplane::Emission,
+                                                 backplane::Incidence, backplane::Resolution};
+      checksum = 0.0;
+      seconds = 0.0;
+      for (int q = 0; q < 4; q++) {
+        seconds += best(options.repeat, [&]() {
+          backplane::compute(sensor, quantities[q], size, size, EncodedBuffer(output), pool,
+                             blocks);
+        });
+        for (int64_t i = 0; i < pixels; i++) {
+          checksum += std::isnan(output[i]) ? 0.0 : output[i];
+        }
+      }
+      report(sensorName, size, threads, "backplane", pixels, seconds, checksum,
+             scenario.fingerprint);
+
+      checksum = 0.0;
+      seconds = 0.0;
+      for (int q = 0; q < 4; q++) {
+        seconds += best(options.repeat, [&]() {
+          backplane::compute(sensor, quantities[q], schedule, EncodedBuffer(output), pool);
+        });
+        for (int64_t i = 0; i < pixels; i++) {
+          checksum += std::isnan(output[i]) ? 0.0 : output[i];
+        }
+      }
+      report(sensorName, size, threads, "backplane_hilbert", pixels, seconds, checksum,
+             scenario.fingerprint);
+
+      for (int64_t i = 0; i < pixels; i++) {
+        CartesianPoint point = scenario.toLocal(ground[i]);
+        local[3 * i] = point.x;
+        local[3 * i + 1] = point.y;
+        local[3 * i + 2] = point.z;
+      }
+      seconds = best(options.repeat, [&]() {
+        pool.parallelFor(blocks, [&](int64_t block) {
+          int64_t first = execution::blockBegin(block, blocks, pixels);
+          int64_t end = execution::blockBegin(block + 1, blocks, pixels);
+          terrain.shadowMask(&local[3 * first], size_t(end - first), sunDirection, 0,
+                             &shadowed[first]);
+        });
+      });
+      checksum = double(std::count(shadowed.begin(), shadowed.end(), 1));
+      Misses misses = simulate(terrain, local, rasterOrder, sunDirection);
+      report(sensorName, size, threads, "shadow", pixels, seconds, checksum,
+             scenario.fingerprint, &misses);
+
+      int64_t tiles = int64_t(schedule.size());
+      int64_t tileBlocks = std::min<int64_t>(tiles, 4 * threads);
+      seconds = best(options.repeat, [&]() {
+        pool.parallelFor(tileBlocks, [&](int64_t block) {
+          int64_t end = execution::blockBegin(block + 1, tileBlocks, tiles);
+          for (int64_t i = execution::blockBegin(block, tileBlocks, tiles); i < end; i++) {
+            const execution::ImageTile &tile = schedule[size_t(i)];
+            for (int64_t line = tile.firstLine; line < tile.firstLine + tile.lines; line++) {
+              int64_t first = line * size + tile.firstSample;
+              terrain.shadowMask(&local[3 * first], size_t(tile.samples), sunDirection, 0,
+                                 &shadowed[first]);
+            }
+          }
+        });
+      });
+      checksum = double(std::count(shadowed.begin(), shadowed.end(), 1));
+      misses = simulate(terrain, local, scheduleOrder, sunDirection);
+      report(sensorName, size, threads, "shadow_hilbert", pixels, seconds, checksum,
+             scenario.fingerprint, &misses);
+    }
+  }
+}
+
+
+int main(int argc, char **argv) {
+  Options options;
+  options.sizes = std::vector<int64_t>{256, 512, 1024};
+  options.threads = std::vector<int64_t>{1, std::max<int64_t>(
+                                                  1, std::thread::hardware_concurrency())};
+  options.sensors = std::vector<std::string>{"frame", "linescan"};
+  options.seed = 1;
+  options.repeat = 3;
+  options.elevationCells = 256;
+  options.tileSize = 64;
+  try {
+    for (int i = 1; i < argc; i++) {
+      std::string flag = argv[i];
+      if (i + 1 == argc) {
+        return usage();
+      }
+      std::string value = argv[++i];
+      if (flag == "--sizes") {
+        options.sizes = numbers(value);
+      }
+      else if (flag == "--threads") {
+        options.threads = numbers(value);
+      }
+      else if (flag == "--sensors") {
+        options.sensors = split(value);
+      }
+      else if (flag == "--seed") {
+        options.seed = std::strtoull(value.c_str(), NULL, 10);
+      }
+      else if (flag == "--repeat") {
+        options.repeat = std::max(1, std::atoi(value.c_str()));
+      }
+      else if (flag == "--dem-cells") {
+        options.elevationCells = std::max<int64_t>(2, std::atoll(value.c_str()));
+      }
+      else if (flag == "--tile") {
+        options.tileSize = std::max(1, std::atoi(value.c_str()));
+      }
+      else {
+        return usage();
+      }
+    }
+    for (size_t i = 0; i < options.sensors.size(); i++) {
+      if (options.sensors[i] != "frame" && options.sensors[i] != "linescan") {
+        return usage();
+      }
+    }
+
+    std::printf("format,sensor,lines,samples,threads,stage,pixels,seconds,pixels_per_second,"
+                "checksum,scenario,cache_misses,tlb_misses\n");
+    for (size_t s = 0; s < options.sensors.size(); s++) {
+      for (size_t i = 0; i < options.sizes.size(); i++) {
+        run(options, options.sensors[s], options.sizes[i]);
+      }
+    }
+  }
+  catch (const std::exception &error) {
+    std::cerr << "sensorbench: " << error.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef Backplane_h
+#define Backplane_h
+
+#include <cstdint>
+#include <vector>
+
+#include "Encoding.h"
+
+class Sensor;
+
+namespace execution {
+  class ThreadPool;
+  class TraversalSchedule;
+}
+
+namespace statistics {
+  class StreamingStatistics;
+}
+
+namespace backplane {
+
+  /**
+   * The photometric quantities a backplane can hold.
+   */
+  enum Quantity {
+    Phase,      /**< Phase angle in radians. */
+    Emission,   /**< Emission angle in radians. */
+    Incidence,  /**< Incidence angle in radians. */
+    Resolution  /**< Resolution in meters/pixel (see Sensor::setDetector). */
+  };
+
+
+  /**
+   * How the coarser levels of a pyramid are produced.
+   */
+  enum PyramidMode {
+    Reduce,   /**< Average the (up to) four finer pixels covering each coarse pixel. */
+    Direct    /**< Evaluate the Sensor at the center of each coarse pixel. */
+  };
+
+
+  /**
+   * Receives backplane rasters as they are generated, one full-width strip per level at a time.
+   * Strips of each level arrive in increasing line order.
+   */
+  class BackplaneWriter {
+
+    public:
+      virtual ~BackplaneWriter() {}
+
+      /**
+       * Writes a strip of a pyramid level.
+       *
+       * @param level Pyramid level, 0 being full resolution.
+       * @param firstLine First line of the strip, in pixels of the level.
+       * @param lines Number of lines in the strip.
+       * @param samples Number of samples in each line (the full width of the level).
+       * @param values lines * samples values, row-major, in the encoding requested from
+       *               generate().
+       */
+      virtual void write(int level, int64_t firstLine, int64_t lines, int64_t samples,
+                         const EncodedBuffer &values) = 0;
+  };
+
+
+  /**
+   * A BackplaneWriter that keeps every level of the pyramid in memory. Float64 strips are kept
+   * in levels, 16-bit strips in codes.
+   */
+  class PyramidBuffer : public BackplaneWriter {
+
+    public:
+      void write(int level, int64_t firstLine, int64_t lines, int64_t samples,
+                 const EncodedBuffer &values);
+
+      std::vector<std::vector<double> > levels;   /**< Row-major raster of each level. */
+      std::vector<std::vector<uint16_t> > codes;  /**< Row-major 16-bit raster of each level. */
+      std::vector<int64_t> samples;               /**< Width of each level. */
+  };
+
+
+  void evaluate(Sensor &sensor, Quantity quantity, int level, int64_t firstLine,
+                int64_t firstSample, int lines, int samples, const EncodedBuffer &values,
+                statistics::StreamingStatistics *statistics = NULL);
+  void generate(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples, int levels,
+                PyramidMode mode, BackplaneWriter &writer, int stripLines = 256,
+                const EncodingFormat &format = EncodingFormat(),
+                statistics::StreamingStatistics *statistics = NULL);
+  void compute(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples,
+               const EncodedBuffer &values, execution::ThreadPool &pool, int64_t blocks = 0);
+  void compute(Sensor &sensor, Quantity quantity, const execution::TraversalSchedule &schedule,
+               const EncodedBuffer &values, execution::ThreadPool &pool, int64_t blocks = 0);
+  void summarize(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples,
+                 statistics::StreamingStatistics &result, int threads = 1, int blockLines = 16);
+  void summarize(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples,
+                 statistics::StreamingStatistics &result, execution::ThreadPool &pool,
+                 int blockLines = 16);
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef ShardedJob_h
+#define ShardedJob_h
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include "Backplane.h"
+#include "Encoding.h"
+#include "sensorcore.h"
+
+class Sensor;
+
+namespace backplane {
+
+  /**
+   * A full-resolution backplane job that can be split over many processes sharing a
+   * filesystem.
+   *
+   * The image is cut into square tiles (row-major tile order) and the tiles into shards of
+   * consecutive tiles, so every process derives the same shard ranges from the job alone.
+   * Each shard is written to its own file and can be rerun independently; mergeShards then
+   * assembles the shard files into the product, a headerless row-major raster in the job's
+   * encoding (native byte order) that is bit-identical to a single-process run.
+   *
+   * Jobs are stored as "key = value" text lines ('#' starts a comment). The keys are
+   * quantity (phase, emission, incidence or resolution), lines, samples, tile_size, shards,
+   * encoding (float64, angle16, half or log16), encoding_minimum, encoding_maximum, output,
+   * and the frame camera: camera_position (x y z), camera_angles (omega phi kappa),
+   * focal_length, pixel_pitch, summing, body_radii (x y z) and illuminator_position (x y z).
+   * See FramingSensorModel for their units.
+   */
+  struct JobDescription {
+    JobDescription();
+
+    Quantity quantity;                 /**< The quantity to compute. */
+    int64_t lines;                     /**< Number of image lines. */
+    int64_t samples;                   /**< Number of image samples. */
+    int tileSize;                      /**< Size of the square tiles, in pixels. */
+    int shards;                        /**< Number of shards the tiles are split into. */
+    EncodingFormat format;             /**< Encoding of the product. */
+    std::string output;                /**< Product path; shards are written next to it. */
+
+    CartesianPoint cameraPosition;     /**< Body-fixed camera position (km). */
+    double omega;                      /**< Camera rotation about x (radians). */
+    double phi;                        /**< Camera rotation about y (radians). */
+    double kappa;                      /**< Camera rotation about z (radians). */
+    double focalLength;                /**< Focal length (mm). */
+    double pixelPitch;                 /**< Pixel size (mm). */
+    double summing;                    /**< Summing mode, for resolution. */
+    CartesianPoint bodyRadii;          /**< Semi-axes of the body ellipsoid (km). */
+    CartesianPoint illuminatorPosition; /**< Body-fixed illuminator position (km). */
+  };
+
+
+  /**
+   * The consecutive tiles, in row-major tile order, computed by one shard.
+   */
+  struct ShardRange {
+    int64_t firstTile;    /**< Index of the first tile. */
+    int64_t tileCount;    /**< Number of tiles; may be 0 when there are more shards than tiles. */
+  };
+
+
+  JobDescription readJob(std::istream &input);
+  JobDescription readJob(const std::string &path);
+  void writeJob(const JobDescription &job, std::ostream &output);
+  void writeJob(const JobDescription &job, const std::string &path);
+
+  int64_t tileCount(const JobDescription &job);
+  ShardRange shardRange(const JobDescription &job, int shard);
+  std::string shardPath(const JobDescription &job, int shard);
+  bool shardComplete(const JobDescription &job, int shard);
+
+  bool runShard(const JobDescription &job, int shard);
+  bool runShard(const JobDescription &job, int shard, Sensor &sensor);
+  void mergeShards(const JobDescription &job);
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef TiledBackplane_h
+#define TiledBackplane_h
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Backplane.h"
+#include "Encoding.h"
+
+class Sensor;
+
+namespace execution {
+  class ThreadPool;
+}
+
+namespace backplane {
+
+  /**
+   * Identifies one tile of a backplane.
+   *
+   * Level 0 is the full-resolution image; each further level halves both dimensions. Tile
+   * (line, sample) at a level covers level pixels [line * tileSize, (line + 1) * tileSize) and
+   * [sample * tileSize, (sample + 1) * tileSize), clipped to the level dimensions.
+   */
+  struct TileKey {
+    int level;            /**< Pyramid level, 0 being full resolution. */
+    int64_t line;         /**< Tile row at this level. */
+    int64_t sample;       /**< Tile column at this level. */
+    Quantity quantity;    /**< The quantity held by the tile. */
+    /**
+     * Creates a TileKey with the passed values.
+     *
+     * @param level Pyramid level.
+     * @param line Tile row at the level.
+     * @param sample Tile column at the level.
+     * @param quantity The quantity held by the tile.
+     */
+    TileKey(int level, int64_t line, int64_t sample, Quantity quantity):
+      level(level), line(line), sample(sample), quantity(quantity) {};
+    bool operator==(const TileKey &other) const {
+      return level == other.level && line == other.line && sample == other.sample
+             && quantity == other.quantity;
+    };
+  };
+
+
+  /**
+   * Hashes a TileKey for use in unordered containers.
+   */
+  struct TileKeyHash {
+    size_t operator()(const TileKey &key) const {
+      uint64_t hash = uint64_t(key.line) * 0x9e3779b97f4a7c15ULL;
+      hash ^= uint64_t(key.sample) + 0x632be59bd9b4e019ULL + (hash << 6) + (hash >> 2);
+      hash ^= uint64_t(key.level * 4 + int(key.quantity)) + (hash << 6) + (hash >> 2);
+      return size_t(hash);
+    };
+  };
+
+
+  /**
+   * A computed block of backplane values, stored row-major. Depending on the encoding of its
+   * quantity, a tile holds either values (Float64) or codes (16-bit encodings).
+   */
+  struct Tile {
+    TileKey key;                  /**< The tile this block holds. */
+    int64_t firstLine;            /**< First level line covered by the tile. */
+    int64_t firstSample;          /**< First level sample covered by the tile. */
+    int lines;                    /**< Number of lines in the tile. */
+    int samples;                  /**< Number of samples in the tile. */
+    EncodingFormat format;        /**< How the tile values are stored. */
+    std::vector<double> values;   /**< lines * samples values, row-major (Float64 only). */
+    std::vector<uint16_t> codes;  /**< lines * samples codes, row-major (16-bit encodings). */
+    /**
+     * Creates an empty tile for a key.
+     *
+     * @param key The tile this block holds.
+     */
+    Tile(const TileKey &key): key(key), firstLine(0), firstSample(0), lines(0), samples(0) {};
+
+    /**
+     * @return double Returns the decoded value at a position within the tile.
+     */
+    double value(int line, int sample) const {
+      size_t index = size_t(line) * samples + sample;
+      if (format.encoding == Encoding::Float64) {
+        return values[index];
+      }
+      return EncodedBuffer(format, const_cast<uint16_t *>(codes.data())).load(index);
+    };
+
+    /**
+     * @return size_t Returns the memory used by the tile values.
+     */
+    size_t bytes() const {
+      return values.size() * sizeof(double) + codes.size() * sizeof(uint16_t);
+    };
+  };
+
+
+  /**
+   * Lazily evaluated, tiled view of the photometric backplanes of an image.
+   *
+   * Tiles are computed through the Sensor only when requested and kept in a bounded
+   * least-recently-used cache. Every request also queues the eight neighboring tiles for
+   * background computation on an execution::ThreadPool, so panning across the image usually
+   * finds tiles already computed. Requests and prefetches call the Sensor concurrently, so its
+   * model must be safe to share between threads, as for backplane::compute.
+   */
+  class TiledBackplane {
+
+    public:
+      /**
+       * Counters describing how the cache has been used.
+       */
+      struct CacheStatistics {
+        size_t hits;          /**< Requests answered from the cache. */
+        size_t misses;        /**< Requests that had to compute (or wait for) a tile. */
+        size_t evictions;     /**< Tiles dropped to stay within the memory budget. */
+        size_t prefetched;    /**< Tiles computed in the background. */
+        CacheStatistics(): hits(0), misses(0), evictions(0), prefetched(0) {};
+      };
+
+      TiledBackplane(Sensor &sensor, int64_t lines, int64_t samples, int tileSize = 256,
+                     size_t cacheBytes = 64 * 1024 * 1024, bool prefetch = true);
+      TiledBackplane(Sensor &sensor, execution::ThreadPool &pool, int64_t lines,
+                     int64_t samples, int tileSize = 256, size_t cacheBytes = 64 * 1024 * 1024);
+      ~TiledBackplane();
+
+      void setEncoding(Quantity quantity, const EncodingFormat &format);
+
+      std::shared_ptr<const Tile> tile(const TileKey &key);
+      std::shared_ptr<const Tile> cachedTile(const TileKey &key);
+      void prefetch(const TileKey &key);
+      void waitForPrefetch();
+
+      int levels() const;
+      int tileSize() const;
+      int64_t lines(int level) const;
+      int64_t samples(int level) const;
+      int64_t tileLines(int level) const;
+      int64_t tileSamples(int level) const;
+
+      size_t cacheBytes();
+      CacheStatistics statistics();
+
+    private:
+      TiledBackplane(const TiledBackplane &);
+      TiledBackplane &operator=(const TiledBackplane &);
+
+      typedef std::list<std::shared_ptr<const Tile> > TileList;
+
+      // Shared with queued prefetch tasks, which may start after the backplane is destroyed.
+      struct PrefetchState {
+        std::mutex mutex;
+        std::condition_variable idle;
+        TiledBackplane *backplane;  // NULL once the backplane is being destroyed.
+        int running;                // Tasks inside prefetchTiles.
+      };
+
+      void initialize();
+
+      bool contains(const TileKey &key) const;
+      std::shared_ptr<const Tile> compute(const TileKey &key);
+      void insert(const std::shared_ptr<const Tile> &tile);
+      void queueNeighbors(const TileKey &key);
+      void startPrefetch();
+      void prefetchTiles();
+
+      Sensor &m_sensor;
+      int64_t m_lines;
+      int64_t m_samples;
+      int m_tileSize;
+      int m_levels;
+      size_t m_cacheLimit;
+      EncodingFormat m_formats[4];
+
+      std::mutex m_mutex;
+      std::condition_variable m_computed;
+
+      TileList m_recent;
+      std::unordered_map<TileKey, TileList::iterator, TileKeyHash> m_cache;
+      std::unordered_set<TileKey, TileKeyHash> m_inFlight;
+      std::deque<TileKey> m_queue;
+      size_t m_cacheBytes;
+      CacheStatistics m_statistics;
+
+      bool m_stopping;
+      execution::ThreadPool *m_pool;                  // NULL if prefetching is disabled.
+      int m_prefetchTasks;                            // Submitted and not yet finished.
+      std::shared_ptr<PrefetchState> m_prefetchState;
+  };
+}
+
+#endif
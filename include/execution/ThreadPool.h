@@ -0,0 +1,175 @@
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace execution {
+
+  /**
+   * The NUMA nodes of the machine and the CPUs of each.
+   */
+  struct Topology {
+    std::vector<std::vector<int> > nodes;  /**< CPU numbers of each node. */
+
+    static Topology read(const std::string &nodeDirectory);
+    static Topology detect();
+
+    int cpuCount() const;
+  };
+
+
+  std::vector<int> parseCpuList(const std::string &cpuList);
+
+
+  /**
+   * How pool threads are bound to CPUs.
+   */
+  enum Pinning {
+    NoPinning,  /**< Threads may run anywhere. */
+    PinToNode,  /**< Each thread may run on any CPU of its node (on a single node machine,
+                     each thread is bound to one CPU instead). */
+    PinToCpu    /**< Each thread is bound to one CPU of its node. */
+  };
+
+
+  /**
+   * The first index of a block when count items are split into blocks near-equal,
+   * consecutive blocks: block b covers [blockBegin(b), blockBegin(b + 1)).
+   */
+  inline int64_t blockBegin(int64_t block, int64_t blocks, int64_t count) {
+    return count * block / blocks;
+  }
+
+
+  /**
+   * A fixed set of worker threads spread over the NUMA nodes, with one work queue per node.
+   *
+   * Threads are assigned to nodes round-robin and optionally pinned to them. A worker takes
+   * tasks from the front of its own node's queue and, when that is empty, steals from the back
+   * of the other nodes' queues, so work stays on the node it was queued for unless a node runs
+   * dry.
+   *
+   * parallelFor splits its range into contiguous stretches, one per node in proportion to the
+   * node's threads (see nodeOf), so data written by item i is written on node nodeOf(i). A
+   * FirstTouchBuffer uses the same assignment to place each block's pages on that node before
+   * the computation writes them.
+   */
+  class ThreadPool {
+
+    public:
+      ThreadPool(int threads = 0, Pinning pinning = PinToNode,
+                 const Topology &topology = Topology::detect());
+      ~ThreadPool();
+
+      ThreadPool(const ThreadPool &) = delete;
+      ThreadPool &operator=(const ThreadPool &) = delete;
+
+      int threads() const;
+      int nodes() const;
+      int nodeOf(int64_t index, int64_t count) const;
+
+      void submit(const std::function<void()> &task, int node = -1);
+      void parallelFor(int64_t count, const std::function<void(int64_t index)> &body);
+
+      static ThreadPool &shared();
+      static int currentNode();
+
+    private:
+      struct NodeQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+      };
+
+      void push(int node, const std::function<void()> &task);
+      bool runOne(int node);
+      void work(int node, const std::vector<int> &cpus);
+
+      std::vector<std::unique_ptr<NodeQueue> > m_queues;
+      std::vector<int> m_threadsBefore;  // Pool threads on the nodes before each node.
+      std::atomic<int64_t> m_pending;
+      std::atomic<unsigned> m_nextNode;
+
+      std::mutex m_sleepMutex;
+      std::condition_variable m_wake;
+      bool m_stopping;
+
+      std::vector<std::thread> m_workers;
+  };
+
+
+  /**
+   * An uninitialized-on-allocation array whose pages are first written by the pool threads
+   * that will later write them, so each block lands in memory local to its node.
+   *
+   * The array is split into rows and the rows into blocks with blockBegin; block b is zeroed
+   * by task b of a parallelFor over the blocks. A computation that fills block b in task b of
+   * parallelFor(blocks) on the same pool then writes node-local memory. T must be a trivial
+   * type.
+   */
+  template <typename T>
+  class FirstTouchBuffer {
+
+    public:
+      /**
+       * Allocates and places the buffer.
+       *
+       * @param pool The pool that will fill the buffer.
+       * @param rows Number of rows.
+       * @param rowLength Number of elements per row.
+       * @param blocks Number of row blocks the computation will use.
+       */
+      FirstTouchBuffer(ThreadPool &pool, int64_t rows, size_t rowLength, int64_t blocks)
+          : m_data(NULL), m_size(size_t(rows) * rowLength) {
+        // Page-aligned, and large allocations come straight from untouched mapped pages.
+        void *memory = NULL;
+        if (m_size && posix_memalign(&memory, 4096, m_size * sizeof(T)) != 0) {
+          throw std::bad_alloc();
+        }
+        m_data = static_cast<T *>(memory);
+        T *data = m_data;
+        pool.parallelFor(blocks, [=](int64_t block) {
+          for (size_t i = size_t(blockBegin(block, blocks, rows)) * rowLength;
+               i < size_t(blockBegin(block + 1, blocks, rows)) * rowLength; i++) {
+            data[i] = T();
+          }
+        });
+      };
+
+      ~FirstTouchBuffer() {
+        std::free(m_data);
+      };
+
+      FirstTouchBuffer(const FirstTouchBuffer &) = delete;
+      FirstTouchBuffer &operator=(const FirstTouchBuffer &) = delete;
+
+      T *data() {
+        return m_data;
+      };
+
+      const T *data() const {
+        return m_data;
+      };
+
+      size_t size() const {
+        return m_size;
+      };
+
+    private:
+      T *m_data;
+      size_t m_size;
+  };
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef Traversal_h
+#define Traversal_h
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "sensorcore.h"
+
+class SensorModel;
+
+namespace execution {
+
+  /**
+   * An order of the cells of a 2D grid.
+   */
+  enum Curve {
+    RowMajor,  /**< Row by row. */
+    Morton,    /**< Z-order: interleaved coordinate bits. */
+    Hilbert    /**< Hilbert curve: consecutive cells are always neighbors. */
+  };
+
+
+  uint64_t mortonIndex(uint32_t x, uint32_t y);
+  uint64_t hilbertIndex(int bits, uint32_t x, uint32_t y);
+  uint64_t curveIndex(Curve curve, int bits, uint32_t x, uint32_t y);
+  int curveBits(int64_t cells);
+
+
+  /**
+   * Maps a body-fixed ground point to the key of the ground tile (e.g. of a DEM) holding it, or
+   * to -1 if it is not on any tile. Keys give the order in which ground tiles are visited, so
+   * they are usually curve indices of the tile grid.
+   */
+  typedef std::function<int64_t(const CartesianPoint &groundPoint)> GroundTileKey;
+
+  GroundTileKey planetocentricTiles(double tileDegrees, Curve curve = Hilbert);
+
+
+  /**
+   * A rectangle of image pixels: lines [firstLine, firstLine + lines) and samples
+   * [firstSample, firstSample + samples).
+   */
+  struct ImageTile {
+    int64_t firstLine;    /**< First line of the tile. */
+    int64_t firstSample;  /**< First sample of the tile. */
+    int lines;            /**< Number of lines. */
+    int samples;          /**< Number of samples. */
+    int64_t groundTile;   /**< Predicted ground tile key, or -1 if unknown. */
+  };
+
+
+  /**
+   * The order in which to process the tiles of an image so that consecutive work touches
+   * nearby memory.
+   *
+   * The image is cut into square tiles, which are visited along a space-filling curve over the
+   * tile grid rather than row by row. Given a sensor model and a GroundTileKey, tiles are also
+   * grouped by the ground tile their center is predicted to see (from one imageToGround per
+   * tile: a coarse grid over the image, with the tile corners as fallback where the center
+   * misses the body), in ground tile key order, so that work reading a DEM or another ground
+   * raster finishes with one ground tile before moving to the next. Tiles whose prediction
+   * fails come last.
+   *
+   * Splitting the schedule into consecutive runs of tiles (e.g. with blockBegin) gives each
+   * worker a compact region of the image and of the ground.
+   */
+  class TraversalSchedule {
+
+    public:
+      TraversalSchedule(int64_t lines, int64_t samples, int tileSize, Curve curve = Hilbert);
+      TraversalSchedule(const SensorModel &model, int64_t lines, int64_t samples, int tileSize,
+                        const GroundTileKey &groundTile, Curve curve = Hilbert);
+
+      int64_t lines() const;
+      int64_t samples() const;
+      int tileSize() const;
+      size_t size() const;
+      const ImageTile &operator[](size_t index) const;
+      size_t groundTileCount() const;
+
+    private:
+      void build(const SensorModel *model, const GroundTileKey &groundTile, Curve curve);
+
+      int64_t m_lines;
+      int64_t m_samples;
+      int m_tileSize;
+      std::vector<ImageTile> m_tiles;
+  };
+
+
+  std::vector<size_t> curveOrder(const ImagePoint *imagePoints, size_t count, double cellSize,
+                                 Curve curve = Hilbert);
+}
+
+#endif
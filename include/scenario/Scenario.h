@@ -0,0 +1,85 @@
+#ifndef Scenario_h
+#define Scenario_h
+
+#include <cstdint>
+#include <memory>
+
+#include "sensorcore.h"
+#include "Traversal.h"
+
+class SensorModel;
+
+namespace shapemodel {
+  class ElevationModel;
+}
+
+namespace scenario {
+
+  /**
+   * The kind of sensor a scenario observes with.
+   */
+  enum SensorType {
+    FrameCamera,  /**< A FramingSensorModel exposing the whole image at once. */
+    LineScanner   /**< A LineScanSensorModel exposing one line at a time along the orbit. */
+  };
+
+
+  /**
+   * Everything that defines a synthetic scenario. The defaults are a Mars orbiter at 400 km
+   * with a 5 m/pixel camera. Every random choice (orbit, pointing, jitter, sun, terrain) is
+   * drawn from seed, so the same options give the same scenario on every platform and release.
+   */
+  struct ScenarioOptions {
+    ScenarioOptions();
+
+    uint64_t seed;                  /**< Seed of every random choice. */
+    SensorType sensor;              /**< The sensor model to create. */
+    int64_t lines;                  /**< Number of image lines. */
+    int64_t samples;                /**< Number of image samples. */
+    CartesianPoint radii;           /**< Semi-axes of the body ellipsoid (km). */
+    double gravitationalParameter;  /**< GM of the body (km^3/s^2), for the orbit rate. */
+    double altitude;                /**< Height of the circular orbit above the mean radius (km). */
+    double focalLength;             /**< Focal length (mm). */
+    double pixelPitch;              /**< Pixel size (mm). */
+    double maximumOffNadir;         /**< Largest roll, pitch and yaw off nadir (radians). */
+    double jitter;                  /**< Amplitude of line-scan attitude jitter (radians). */
+    double sunDistance;             /**< Distance of the illuminator from the body (km). */
+    int64_t elevationCells;         /**< Cells per side of the synthetic DEM; 0 for none. */
+    double relief;                  /**< Height scale of the synthetic DEM (km). */
+  };
+
+
+  /**
+   * A generated scenario: a sensor model, the illuminator and, optionally, a synthetic DEM
+   * covering the image footprint.
+   *
+   * The DEM is in a local east-north-up frame (km) centered on the ground point seen by the
+   * image center; toLocal and toLocalDirection convert body-fixed points and vectors into
+   * it, e.g. to query shapemodel::TerrainVisibility for the ground points of an image, and
+   * elevationTiles groups them by DEM tile for an execution::TraversalSchedule.
+   */
+  struct Scenario {
+    Scenario();
+
+    ScenarioOptions options;                    /**< The options it was generated from. */
+    std::shared_ptr<const SensorModel> model;   /**< The sensor model. */
+    CartesianPoint illuminatorPosition;         /**< Body-fixed sun position (km). */
+    double groundSampleDistance;                /**< Nadir pixel size on the ground (km). */
+    CartesianPoint center;                      /**< Body-fixed ground point of the center. */
+    CartesianVector east;                       /**< Local east axis (body-fixed unit vector). */
+    CartesianVector north;                      /**< Local north axis. */
+    CartesianVector up;                         /**< Local up axis: the ellipsoid normal. */
+    std::shared_ptr<const shapemodel::ElevationModel> elevation; /**< The DEM, or empty. */
+    uint64_t fingerprint;                       /**< Hash of the generated geometry. */
+
+    CartesianPoint toLocal(const CartesianPoint &point) const;
+    CartesianVector toLocalDirection(const CartesianVector &vector) const;
+    execution::GroundTileKey elevationTiles(int tileCells,
+                                            execution::Curve curve = execution::Hilbert) const;
+  };
+
+
+  Scenario createScenario(const ScenarioOptions &options = ScenarioOptions());
+}
+
+#endif
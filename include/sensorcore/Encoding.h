@@ -0,0 +1,342 @@
+#ifndef Encoding_h
+#define Encoding_h
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * Storage encodings for computed rasters.
+ *
+ * The 16-bit encodings reserve the code NO_DATA_CODE for invalid (NaN) values.
+ *
+ * AngleFixed16 maps [0, pi] linearly onto codes 0 to 65534. The step is pi / 65534, so the
+ * quantization error is at most ANGLE_QUANTIZATION_ERROR (about 2.4e-5 radians or 0.0014
+ * degrees). Angles outside [0, pi] are clamped.
+ *
+ * Half is an IEEE 754 binary16 float (11 significant bits): the relative error is at most
+ * 2^-11 for values between about 6.1e-5 and 65504. Larger values become infinity.
+ *
+ * LogScaled16 maps [minimum, maximum] logarithmically onto codes 0 to 65534, so the relative
+ * error is at most exp(ln(maximum / minimum) / 131068) - 1; about 1.05e-4 for a range of 1e6.
+ * Values outside the range are clamped, and values <= 0 are stored as NO_DATA_CODE.
+ */
+enum class Encoding {
+  Float64,        /**< Unquantized doubles (8 bytes). */
+  AngleFixed16,   /**< 16-bit fixed point over [0, pi]. */
+  Half,           /**< 16-bit IEEE half-precision float. */
+  LogScaled16     /**< 16-bit logarithmic code over a caller-defined range. */
+};
+
+/** The 16-bit code used for invalid values by AngleFixed16 and LogScaled16. */
+const uint16_t NO_DATA_CODE = 65535;
+
+/** The largest error introduced by AngleFixed16, in radians. */
+const double ANGLE_QUANTIZATION_ERROR = M_PI / (2.0 * 65534.0);
+
+
+/**
+ * @param encoding An encoding.
+ *
+ * @return size_t Returns the number of bytes used per value.
+ */
+inline size_t bytesPerValue(Encoding encoding) {
+  return encoding == Encoding::Float64 ? sizeof(double) : sizeof(uint16_t);
+}
+
+
+/**
+ * Encodes an angle in radians as a 16-bit fixed-point code.
+ *
+ * @param angle Angle in radians.
+ *
+ * @return uint16_t Returns the code, or NO_DATA_CODE for NaN.
+ */
+inline uint16_t encodeAngle(double angle) {
+  if (std::isnan(angle)) {
+    return NO_DATA_CODE;
+  }
+  double scaled = angle * (65534.0 / M_PI) + 0.5;
+  if (scaled <= 0.0) {
+    return 0;
+  }
+  if (scaled >= 65534.0) {
+    return 65534;
+  }
+  return uint16_t(scaled);
+}
+
+
+/**
+ * @param code A code produced by encodeAngle.
+ *
+ * @return double Returns the angle in radians, or NaN for NO_DATA_CODE.
+ */
+inline double decodeAngle(uint16_t code) {
+  if (code == NO_DATA_CODE) {
+    return NAN;
+  }
+  return code * (M_PI / 65534.0);
+}
+
+
+/**
+ * Encodes a value as an IEEE half-precision float, rounding to nearest even.
+ *
+ * @param value The value to encode.
+ *
+ * @return uint16_t Returns the binary16 bit pattern.
+ */
+inline uint16_t encodeHalf(double value) {
+  float single = float(value);
+  uint32_t bits;
+  std::memcpy(&bits, &single, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000u;
+  uint32_t magnitude = bits & 0x7fffffffu;
+
+  if (magnitude >= 0x7f800000u) {
+    // Infinity stays infinity; NaN stays a (quiet) NaN.
+    return uint16_t(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x0200u : 0u));
+  }
+  if (magnitude >= 0x477ff000u) {
+    // Rounds to a value beyond the largest half (65504).
+    return uint16_t(sign | 0x7c00u);
+  }
+  if (magnitude < 0x38800000u) {
+    // Subnormal half (or zero): shift the implicit bit into place and round.
+    if (magnitude < 0x33000000u) {
+      return uint16_t(sign);
+    }
+    uint32_t exponent = magnitude >> 23;
+    uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+    uint32_t shift = 126 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t midpoint = 1u << (shift - 1);
+    if (remainder > midpoint || (remainder == midpoint && (half & 1u))) {
+      half++;
+    }
+    return uint16_t(sign | half);
+  }
+  // Normal half: rebias the exponent and round the mantissa to 10 bits.
+  uint32_t half = ((magnitude - 0x38000000u) >> 13);
+  uint32_t remainder = magnitude & 0x1fffu;
+  if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+    half++;
+  }
+  return uint16_t(sign | half);
+}
+
+
+/**
+ * @param code A binary16 bit pattern.
+ *
+ * @return double Returns the value of the half-precision float.
+ */
+inline double decodeHalf(uint16_t code) {
+  uint32_t sign = uint32_t(code & 0x8000u) << 16;
+  uint32_t exponent = (code >> 10) & 0x1fu;
+  uint32_t mantissa = code & 0x3ffu;
+  uint32_t bits;
+  if (exponent == 0x1fu) {
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  }
+  else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  else if (mantissa == 0) {
+    bits = sign;
+  }
+  else {
+    // Subnormal half: normalize into a single-precision float.
+    exponent = 113;
+    while (!(mantissa & 0x400u)) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+  }
+  float single;
+  std::memcpy(&single, &bits, sizeof(single));
+  return single;
+}
+
+
+/**
+ * Encodes a positive value as a logarithmic 16-bit code over [minimum, maximum].
+ *
+ * @param value The value to encode.
+ * @param minimum Smallest representable value (must be > 0).
+ * @param maximum Largest representable value (must be > minimum).
+ *
+ * @return uint16_t Returns the code, or NO_DATA_CODE for NaN and values <= 0, and for every
+ *                  value if the range is invalid.
+ */
+inline uint16_t encodeLog(double value, double minimum, double maximum) {
+  if (!(value > 0.0)) {
+    return NO_DATA_CODE;
+  }
+  double scaled = std::log(value / minimum) / std::log(maximum / minimum) * 65534.0 + 0.5;
+  if (std::isnan(scaled)) {
+    // Only reachable with an invalid range; see checkEncodingRange.
+    return NO_DATA_CODE;
+  }
+  if (scaled <= 0.0) {
+    return 0;
+  }
+  if (scaled >= 65534.0) {
+    return 65534;
+  }
+  return uint16_t(scaled);
+}
+
+
+/**
+ * @param code A code produced by encodeLog.
+ * @param minimum The minimum passed to encodeLog.
+ * @param maximum The maximum passed to encodeLog.
+ *
+ * @return double Returns the decoded value, or NaN for NO_DATA_CODE.
+ */
+inline double decodeLog(uint16_t code, double minimum, double maximum) {
+  if (code == NO_DATA_CODE) {
+    return NAN;
+  }
+  return minimum * std::exp(code * (std::log(maximum / minimum) / 65534.0));
+}
+
+
+/**
+ * Checks the parameters of an encoding. Only LogScaled16 has any: its range must satisfy
+ * 0 < minimum < maximum, with both ends finite.
+ *
+ * @param encoding The encoding.
+ * @param minimum Lower end of the range.
+ * @param maximum Upper end of the range.
+ *
+ * @throws std::invalid_argument If the encoding is LogScaled16 and the range is invalid.
+ */
+inline void checkEncodingRange(Encoding encoding, double minimum, double maximum) {
+  if (encoding == Encoding::LogScaled16
+      && !(minimum > 0.0 && maximum > minimum && std::isfinite(maximum))) {
+    throw std::invalid_argument("LogScaled16 needs a range with 0 < minimum < maximum");
+  }
+}
+
+
+/**
+ * An encoding together with the parameters it needs.
+ */
+struct EncodingFormat {
+  Encoding encoding;    /**< How values are stored. */
+  double minimum;       /**< Lower end of the LogScaled16 range. */
+  double maximum;       /**< Upper end of the LogScaled16 range. */
+  /**
+   * Creates a format with the passed values.
+   *
+   * @param encoding How values are stored.
+   * @param minimum Lower end of the range, used by LogScaled16 only.
+   * @param maximum Upper end of the range, used by LogScaled16 only.
+   *
+   * @throws std::invalid_argument If the encoding is LogScaled16 and the range is invalid.
+   */
+  EncodingFormat(Encoding encoding = Encoding::Float64, double minimum = 0.0, double maximum = 0.0):
+    encoding(encoding), minimum(minimum), maximum(maximum) {
+    checkEncodingRange(encoding, minimum, maximum);
+  };
+};
+
+
+/**
+ * A caller-owned output array together with the encoding its values are stored in. Batch
+ * functions store each result straight into the array, so no double-precision copy of the
+ * output is ever made.
+ */
+struct EncodedBuffer {
+  Encoding encoding;    /**< How values are stored. */
+  void *data;           /**< The output array (double or uint16_t elements). */
+  double minimum;       /**< Lower end of the LogScaled16 range. */
+  double maximum;       /**< Upper end of the LogScaled16 range. */
+  /**
+   * Creates a buffer storing unquantized doubles.
+   *
+   * @param values The output array.
+   */
+  EncodedBuffer(double *values):
+    encoding(Encoding::Float64), data(values), minimum(0.0), maximum(0.0) {};
+  /**
+   * Creates a buffer storing values with the passed encoding.
+   *
+   * @param encoding How values are stored.
+   * @param data The output array; uint16_t elements unless encoding is Float64.
+   * @param minimum Lower end of the range, used by LogScaled16 only.
+   * @param maximum Upper end of the range, used by LogScaled16 only.
+   *
+   * @throws std::invalid_argument If the encoding is LogScaled16 and the range is invalid.
+   */
+  EncodedBuffer(Encoding encoding, void *data, double minimum = 0.0, double maximum = 0.0):
+    encoding(encoding), data(data), minimum(minimum), maximum(maximum) {
+    checkEncodingRange(encoding, minimum, maximum);
+  };
+  /**
+   * Creates a buffer storing values in the passed format.
+   *
+   * @param format How values are stored.
+   * @param data The output array; uint16_t elements unless the encoding is Float64.
+   *
+   * @throws std::invalid_argument If the encoding is LogScaled16 and the range is invalid.
+   */
+  EncodedBuffer(const EncodingFormat &format, void *data):
+    encoding(format.encoding), data(data), minimum(format.minimum), maximum(format.maximum) {
+    checkEncodingRange(encoding, minimum, maximum);
+  };
+
+  /**
+   * @return EncodedBuffer Returns a view of this buffer starting offset values later.
+   */
+  EncodedBuffer offset(size_t offset) const {
+    EncodedBuffer result(*this);
+    result.data = static_cast<char *>(data) + offset * bytesPerValue(encoding);
+    return result;
+  };
+
+  /**
+   * Encodes and stores one value.
+   */
+  void store(size_t index, double value) const {
+    switch (encoding) {
+      case Encoding::Float64:
+        static_cast<double *>(data)[index] = value;
+        break;
+      case Encoding::AngleFixed16:
+        static_cast<uint16_t *>(data)[index] = encodeAngle(value);
+        break;
+      case Encoding::Half:
+        static_cast<uint16_t *>(data)[index] = encodeHalf(value);
+        break;
+      case Encoding::LogScaled16:
+        static_cast<uint16_t *>(data)[index] = encodeLog(value, minimum, maximum);
+        break;
+    }
+  };
+
+  /**
+   * Loads and decodes one value.
+   */
+  double load(size_t index) const {
+    switch (encoding) {
+      case Encoding::AngleFixed16:
+        return decodeAngle(static_cast<const uint16_t *>(data)[index]);
+      case Encoding::Half:
+        return decodeHalf(static_cast<const uint16_t *>(data)[index]);
+      case Encoding::LogScaled16:
+        return decodeLog(static_cast<const uint16_t *>(data)[index], minimum, maximum);
+      default:
+        return static_cast<const double *>(data)[index];
+    }
+  };
+};
+
+#endif
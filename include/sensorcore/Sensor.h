@@ -1,24 +1,58 @@
 #ifndef Sensor_h
 #define Sensor_h
 
+#include <cstddef>
 #include <string>
 
+#include "Encoding.h"
 #include "sensorcore.h"
 
+class SensorModel;
+
+namespace statistics {
+  class StreamingStatistics;
+}
+
 class Sensor {
 
   public:
     Sensor(const std::string &metaData, const std::string &sensorName);
+    Sensor(const SensorModel *sensorModel, const CartesianPoint &illuminatorPosition);
 
     double declination(const CartesianVector &);
     double emissionAngle(const CartesianPoint &groundPoint);
     double emissionAngle(const ImagePoint &imagePoint);
+    double incidenceAngle(const CartesianPoint &groundPoint);
+    double incidenceAngle(const ImagePoint &imagePoint);
     double phaseAngle(const CartesianPoint &groundPoint);
     double phaseAngle(const ImagePoint &imagePoint);
+    double resolution(const CartesianPoint &groundPoint);
+    double resolution(const ImagePoint &imagePoint);
     double rightAscension(const CartesianVector &);
 
+    void setDetector(double focalLength, double pixelPitch, double summing);
+
+    void emissionAngles(const ImagePoint *imagePoints, size_t count, const EncodedBuffer &angles,
+                        statistics::StreamingStatistics *statistics = NULL);
+    void incidenceAngles(const ImagePoint *imagePoints, size_t count, const EncodedBuffer &angles,
+                         statistics::StreamingStatistics *statistics = NULL);
+    void phaseAngles(const ImagePoint *imagePoints, size_t count, const EncodedBuffer &angles,
+                     statistics::StreamingStatistics *statistics = NULL);
+    void resolutions(const ImagePoint *imagePoints, size_t count, const EncodedBuffer &resolutions,
+                     statistics::StreamingStatistics *statistics = NULL);
+
   private:
-    // SensorModel *m_sensorModel;
+    /** Number of points intersected per sensor model batch call. */
+    static const size_t BATCH_SIZE = 256;
+
+    bool intersect(const ImagePoint *imagePoints, size_t count, CartesianPoint *ground,
+                   CartesianVector *look) const;
+
+    const SensorModel *m_sensorModel;
+    CartesianPoint m_illuminatorPosition;
+    double m_focalLength;
+    double m_pixelPitch;
+    double m_summing;
     // ShapeModel *m_shapeModel;
 };
 
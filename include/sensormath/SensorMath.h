@@ -2,6 +2,7 @@
 #define SensorMath_h
 
 #include <armadillo>
+#include <cstddef>
 #include <vector>
 
 #include "sensorcore.h"
@@ -25,6 +26,7 @@ namespace sensormath {
 
   // TODO: convert rect2lat and lat2rect to use CartesianPoints and CartesianVectors
   vector<double> rect2lat(const vector<double> rectangularCoords);
+  void rect2lat(const double *rectangularCoords, size_t count, double *radiusLatLong);
   vector<double> lat2rect(vector<double> sphericalCoords);
 }
 #endif
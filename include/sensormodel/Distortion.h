@@ -0,0 +1,150 @@
+#ifndef Distortion_h
+#define Distortion_h
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Maps ideal (undistorted) focal plane coordinates to the distorted coordinates actually
+ * measured on the detector. Focal plane points are (x, y) pairs, in millimeters for the
+ * models here; batch methods take them interleaved.
+ *
+ * distort is evaluated directly. undistort inverts it by Newton's method, one iterative solve
+ * per point; InverseDistortionGrid serves the inverse much faster from a precomputed grid.
+ */
+class DistortionModel {
+
+  public:
+    virtual ~DistortionModel() {}
+
+    /**
+     * Distorts one point and optionally computes the Jacobian of the distortion there.
+     *
+     * @param x Undistorted x.
+     * @param y Undistorted y.
+     * @param distortedX Receives the distorted x.
+     * @param distortedY Receives the distorted y.
+     * @param jacobian If not NULL, receives the row-major 2x2 matrix of partial derivatives of
+     *                 (distortedX, distortedY) with respect to (x, y).
+     */
+    virtual void distort(double x, double y, double &distortedX, double &distortedY,
+                         double *jacobian = NULL) const = 0;
+
+    bool undistort(double distortedX, double distortedY, double &x, double &y,
+                   int maxIterations = 50, double tolerance = 1e-14) const;
+
+    void distort(const double *points, size_t count, double *distorted) const;
+    void undistort(const double *distorted, size_t count, double *points) const;
+};
+
+
+/**
+ * Radial (Brown-Conrady without tangential terms) distortion about the principal point:
+ * distorted = undistorted * (1 + k1 r^2 + k2 r^4 + k3 r^6), where r is the undistorted
+ * distance from the principal point.
+ */
+class RadialDistortion final : public DistortionModel {
+
+  public:
+    RadialDistortion(double k1, double k2 = 0.0, double k3 = 0.0);
+
+    void distort(double x, double y, double &distortedX, double &distortedY,
+                 double *jacobian = NULL) const;
+    using DistortionModel::distort;
+
+  private:
+    double m_k1;
+    double m_k2;
+    double m_k3;
+};
+
+
+/**
+ * Bivariate polynomial distortion: distortedX = sum xCoefficients[t] x^i y^j and likewise for
+ * distortedY, with the terms t ordered by total degree and then by falling power of x
+ * (1, x, y, x^2, xy, y^2, x^3, ...), as in the usual transverse distortion models.
+ */
+class PolynomialDistortion final : public DistortionModel {
+
+  public:
+    PolynomialDistortion(int degree, const std::vector<double> &xCoefficients,
+                         const std::vector<double> &yCoefficients);
+
+    static size_t termCount(int degree);
+
+    void distort(double x, double y, double &distortedX, double &distortedY,
+                 double *jacobian = NULL) const;
+    using DistortionModel::distort;
+
+    int degree() const;
+
+  private:
+    int m_degree;
+    std::vector<double> m_xCoefficients;
+    std::vector<double> m_yCoefficients;
+};
+
+
+/**
+ * Accuracy of InverseDistortionGrid against the exact iterative inverse.
+ */
+struct DistortionAccuracy {
+  size_t points;        /**< Number of points compared. */
+  double maxError;      /**< Largest distance between grid and exact undistorted points. */
+  double rmsError;      /**< Root mean square of the distances. */
+  double maxResidual;   /**< Largest distance between distort(grid result) and the input. */
+  /**
+   * Creates an empty report.
+   */
+  DistortionAccuracy(): points(0), maxError(0.0), rmsError(0.0), maxResidual(0.0) {};
+};
+
+
+/**
+ * Precomputed inverse of a DistortionModel over a rectangle of the detector.
+ *
+ * The exact undistorted point is stored at every node of a regular grid in distorted
+ * coordinates. undistort interpolates the grid bilinearly and refines the result with one
+ * Newton step, which roughly squares the interpolation error, so a modest grid (e.g. 65 x 65
+ * nodes over the detector) reaches the accuracy of the iterative solve at a fraction of its
+ * cost. Points outside the grid fall back to the iterative solve.
+ *
+ * A grid is immutable once built and safe to use from several threads. Build it once per
+ * instrument with shared(), which hands every caller the same grid.
+ */
+class InverseDistortionGrid {
+
+  public:
+    InverseDistortionGrid(const std::shared_ptr<const DistortionModel> &model, double minimumX,
+                          double minimumY, double maximumX, double maximumY, int columns,
+                          int rows);
+
+    static std::shared_ptr<const InverseDistortionGrid> shared(
+        const std::string &instrument, const std::shared_ptr<const DistortionModel> &model,
+        double minimumX, double minimumY, double maximumX, double maximumY, int columns,
+        int rows);
+
+    void undistort(double distortedX, double distortedY, double &x, double &y) const;
+    void undistort(const double *distorted, size_t count, double *points) const;
+    void distort(const double *points, size_t count, double *distorted) const;
+
+    DistortionAccuracy measureAccuracy(int samplesPerCell = 4) const;
+
+    const DistortionModel &model() const;
+    int columns() const;
+    int rows() const;
+
+  private:
+    std::shared_ptr<const DistortionModel> m_model;
+    double m_minimumX;
+    double m_minimumY;
+    double m_stepX;
+    double m_stepY;
+    int m_columns;
+    int m_rows;
+    std::vector<double> m_nodes;  // Undistorted (x, y) at each node, row-major.
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef FramingSensorModel_h
+#define FramingSensorModel_h
+
+#include <cstddef>
+#include <memory>
+
+#include "sensorcore.h"
+#include "SensorModel.h"
+
+class InverseDistortionGrid;
+
+/**
+ * A frame camera (pinhole projection with optional focal plane distortion) looking at a
+ * triaxial ellipsoid.
+ *
+ * The camera frame is rotated from the body-fixed frame by omega, phi and kappa (radians, about
+ * x, then y, then z) and looks along its +z axis. An undistorted focal plane point is
+ * (f vx / vz, f vy / vz) for a camera-frame vector v; it is distorted by the distortion model
+ * and divided by the pixel pitch to get the offset of (sample, line) from the image center.
+ *
+ * The six sensor parameters, in order, are the position (x, y, z) and the angles (omega, phi,
+ * kappa). The batched groundToImage computes the partial derivatives with respect to them and
+ * to the ground point analytically, in the same pass as the projection.
+ *
+ * Points that miss the body, or lie behind the camera, give NaN coordinates.
+ */
+class FramingSensorModel final : public SensorModelBase<FramingSensorModel> {
+
+  public:
+    FramingSensorModel(const CartesianPoint &position, double omega, double phi, double kappa,
+                       double focalLength, double pixelPitch, double lines, double samples,
+                       const CartesianPoint &radii);
+
+    void setDistortion(const std::shared_ptr<const InverseDistortionGrid> &distortion);
+    void setParameters(const double parameters[6]);
+    void parameters(double parameters[6]) const;
+
+    CartesianPoint imageToGround(const ImagePoint &imagePoint) const;
+    ImagePoint groundToImage(const CartesianPoint &groundPoint) const;
+    CartesianVector groundToLook(const CartesianPoint &groundPoint) const;
+    double imageTime(const ImagePoint &imagePoint) const;
+
+    using SensorModelBase<FramingSensorModel>::imageToGround;
+    using SensorModelBase<FramingSensorModel>::groundToImage;
+    using SensorModelBase<FramingSensorModel>::groundToLook;
+    using SensorModelBase<FramingSensorModel>::imageTime;
+
+    int parameterCount() const;
+    void groundToImage(const CartesianPoint *groundPoints, size_t count,
+                       ImagePoint *imagePoints, const PartialsBuffer &partials) const;
+
+  private:
+    ImagePoint project(const CartesianPoint &groundPoint, double *groundPartials,
+                       double *sensorPartials) const;
+
+    CartesianPoint m_position;
+    double m_angles[3];
+    double m_focalLength;
+    double m_pixelPitch;
+    double m_centerLine;
+    double m_centerSample;
+    CartesianPoint m_radii;
+    std::shared_ptr<const InverseDistortionGrid> m_distortion;
+    double m_rotation[9];             // Body-fixed to camera, row-major.
+    double m_rotationPartials[3][9];  // Derivatives of m_rotation by omega, phi and kappa.
+};
+
+#endif
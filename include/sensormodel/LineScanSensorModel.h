@@ -0,0 +1,57 @@
+#ifndef LineScanSensorModel_h
+#define LineScanSensorModel_h
+
+#include <cstddef>
+#include <vector>
+
+#include "sensorcore.h"
+#include "SensorModel.h"
+
+/**
+ * A pushbroom (line-scan) camera looking at a triaxial ellipsoid: a single detector row
+ * exposed once per image line while the spacecraft moves.
+ *
+ * Each image line has its own pose, given as a body-fixed position and the angles (omega, phi,
+ * kappa) of FramingSensorModel. Pose i is the pose at the center of line i (image line i + 0.5),
+ * and poses between (or beyond) them are linearly interpolated (or extrapolated), with omega
+ * and kappa taken the short way round across +-pi. The detector row lies along the camera x
+ * axis, so a camera-frame vector v is seen at sample center + f vx / vz / pitch of the line
+ * whose pose puts it at vy = 0.
+ *
+ * Points that miss the body, or lie behind the camera, and NaN or infinite image points give
+ * NaN coordinates.
+ */
+class LineScanSensorModel final : public SensorModelBase<LineScanSensorModel> {
+
+  public:
+    LineScanSensorModel(const std::vector<CartesianPoint> &positions,
+                        const std::vector<double> &angles, double lineTime, double focalLength,
+                        double pixelPitch, double samples, const CartesianPoint &radii);
+
+    double lines() const;
+
+    CartesianPoint imageToGround(const ImagePoint &imagePoint) const;
+    ImagePoint groundToImage(const CartesianPoint &groundPoint) const;
+    CartesianVector groundToLook(const CartesianPoint &groundPoint) const;
+    double imageTime(const ImagePoint &imagePoint) const;
+
+    using SensorModelBase<LineScanSensorModel>::imageToGround;
+    using SensorModelBase<LineScanSensorModel>::groundToImage;
+    using SensorModelBase<LineScanSensorModel>::groundToLook;
+    using SensorModelBase<LineScanSensorModel>::imageTime;
+
+  private:
+    void pose(double line, CartesianPoint &position, double rotation[9]) const;
+    double locateLine(const CartesianPoint &groundPoint) const;
+
+    std::vector<CartesianPoint> m_positions;
+    std::vector<double> m_angles;
+    std::vector<double> m_rotations;  // Body-fixed to camera of each pose, row-major.
+    double m_lineTime;
+    double m_focalLength;
+    double m_pixelPitch;
+    double m_centerSample;
+    CartesianPoint m_radii;
+};
+
+#endif
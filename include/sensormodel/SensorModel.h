@@ -1,8 +1,103 @@
 #ifndef SensorModel_h
 #define SensorModel_h
 
+#include <cstddef>
+#include <cstdint>
+
 #include "sensorcore.h"
 
+/**
+ * Caller-owned output for the partial derivatives of (sample, line) computed by a batched
+ * groundToImage, in one of two layouts.
+ *
+ * BlockSparse: observation i gets a row-major 2 x 3 block of ground partials at ground + 6 i
+ * and a row-major 2 x P block of sensor partials at sensor + 2 P i, where P is the model's
+ * parameterCount(). Either pointer may be NULL.
+ *
+ * Dense: observation i fills rows firstRow + 2 i (sample) and firstRow + 2 i + 1 (line) of a
+ * row-major matrix, with its ground partials in columns groundColumns[i] to
+ * groundColumns[i] + 2 and the sensor partials in columns sensorColumn to
+ * sensorColumn + P - 1. groundColumns may be NULL and sensorColumn negative to leave those
+ * partials out. Other matrix entries are not touched.
+ */
+struct PartialsBuffer {
+  /** How the partials are laid out. */
+  enum Layout {
+    BlockSparse,    /**< Separate ground and sensor blocks per observation. */
+    Dense           /**< Entries of one row-major matrix. */
+  };
+  Layout layout;                /**< How the partials are laid out. */
+  double *ground;               /**< BlockSparse ground blocks. */
+  double *sensor;               /**< BlockSparse sensor blocks. */
+  double *matrix;               /**< Dense matrix. */
+  size_t rowStride;             /**< Dense distance between rows, in values. */
+  size_t firstRow;              /**< Dense row of the first observation's sample partials. */
+  const size_t *groundColumns;  /**< Dense first ground column of each observation. */
+  int64_t sensorColumn;         /**< Dense first sensor column, or negative for none. */
+  /**
+   * Creates a block-sparse output.
+   *
+   * @param ground 6 values per observation for the ground partials, or NULL.
+   * @param sensor 2 * parameterCount() values per observation for the sensor partials, or
+   *               NULL.
+   */
+  PartialsBuffer(double *ground, double *sensor):
+    layout(BlockSparse), ground(ground), sensor(sensor), matrix(NULL), rowStride(0),
+    firstRow(0), groundColumns(NULL), sensorColumn(-1) {};
+  /**
+   * Creates a dense output.
+   *
+   * @param matrix The row-major matrix.
+   * @param rowStride Distance between rows, in values.
+   * @param firstRow Row of the first observation's sample partials.
+   * @param groundColumns First ground column of each observation, or NULL.
+   * @param sensorColumn First sensor column, or negative for none.
+   */
+  PartialsBuffer(double *matrix, size_t rowStride, size_t firstRow,
+                 const size_t *groundColumns, int64_t sensorColumn):
+    layout(Dense), ground(NULL), sensor(NULL), matrix(matrix), rowStride(rowStride),
+    firstRow(firstRow), groundColumns(groundColumns), sensorColumn(sensorColumn) {};
+
+  /**
+   * Stores the partials of one observation.
+   *
+   * @param observation Index of the observation.
+   * @param groundPartials Row-major 2 x 3 ground partials.
+   * @param parameterCount Number of sensor parameters.
+   * @param sensorPartials Row-major 2 x parameterCount sensor partials.
+   */
+  void store(size_t observation, const double *groundPartials, int parameterCount,
+             const double *sensorPartials) const {
+    if (layout == BlockSparse) {
+      if (ground) {
+        for (int k = 0; k < 6; k++) {
+          ground[6 * observation + k] = groundPartials[k];
+        }
+      }
+      if (sensor) {
+        for (int k = 0; k < 2 * parameterCount; k++) {
+          sensor[2 * parameterCount * observation + k] = sensorPartials[k];
+        }
+      }
+      return;
+    }
+    for (int row = 0; row < 2; row++) {
+      double *values = matrix + (firstRow + 2 * observation + row) * rowStride;
+      if (groundColumns) {
+        for (int k = 0; k < 3; k++) {
+          values[groundColumns[observation] + k] = groundPartials[3 * row + k];
+        }
+      }
+      if (sensorColumn >= 0) {
+        for (int k = 0; k < parameterCount; k++) {
+          values[sensorColumn + k] = sensorPartials[parameterCount * row + k];
+        }
+      }
+    }
+  };
+};
+
+
 class SensorModel {
 
 
@@ -21,13 +116,75 @@ class SensorModel {
 
 public:
 
-  virtual CartesianPoint imageToGround(ImagePoint &) =0;
-  virtual ImagePoint groundToImage(CartesianPoint &) = 0;
-  virtual CartesianVector groundToLook(CartesianPoint & ) = 0;
-  virtual double imageTime(ImagePoint & )= 0;
+  virtual ~SensorModel() {}
+
+  virtual CartesianPoint imageToGround(const ImagePoint &) const = 0;
+  virtual ImagePoint groundToImage(const CartesianPoint &) const = 0;
+  virtual CartesianVector groundToLook(const CartesianPoint &) const = 0;
+  virtual double imageTime(const ImagePoint &) const = 0;
+
+  virtual void imageToGround(const ImagePoint *imagePoints, size_t count,
+                             CartesianPoint *groundPoints) const;
+  virtual void groundToImage(const CartesianPoint *groundPoints, size_t count,
+                             ImagePoint *imagePoints) const;
+  virtual void groundToLook(const CartesianPoint *groundPoints, size_t count,
+                            CartesianVector *lookVectors) const;
+  virtual void imageTime(const ImagePoint *imagePoints, size_t count, double *times) const;
+
+  virtual int parameterCount() const;
+  virtual void groundToImage(const CartesianPoint *groundPoints, size_t count,
+                             ImagePoint *imagePoints, const PartialsBuffer &partials) const;
+
+};
+
+
+/**
+ * Base class for sensor models whose batch methods should be compiled into inlined loops.
+ *
+ * Model derives from SensorModelBase<Model> and implements the four per-point methods. The
+ * batch methods defined here call Model's per-point methods with qualified (non-virtual)
+ * calls, so each batch costs one indirect call and the per-point math can be inlined and
+ * vectorized. Model should be final: a class deriving from it would not have its per-point
+ * overrides used by the batch methods. Code that knows the concrete model type can also call
+ * the per-point methods directly, e.g. model.Model::imageToGround(point), to build its own
+ * inlined pipelines.
+ */
+template <class Model>
+class SensorModelBase : public SensorModel {
+
+  public:
+    using SensorModel::groundToImage;
+
+    void imageToGround(const ImagePoint *imagePoints, size_t count,
+                       CartesianPoint *groundPoints) const {
+      const Model &model = static_cast<const Model &>(*this);
+      for (size_t i = 0; i < count; i++) {
+        groundPoints[i] = model.Model::imageToGround(imagePoints[i]);
+      }
+    }
 
+    void groundToImage(const CartesianPoint *groundPoints, size_t count,
+                       ImagePoint *imagePoints) const {
+      const Model &model = static_cast<const Model &>(*this);
+      for (size_t i = 0; i < count; i++) {
+        imagePoints[i] = model.Model::groundToImage(groundPoints[i]);
+      }
+    }
 
+    void groundToLook(const CartesianPoint *groundPoints, size_t count,
+                      CartesianVector *lookVectors) const {
+      const Model &model = static_cast<const Model &>(*this);
+      for (size_t i = 0; i < count; i++) {
+        lookVectors[i] = model.Model::groundToLook(groundPoints[i]);
+      }
+    }
 
+    void imageTime(const ImagePoint *imagePoints, size_t count, double *times) const {
+      const Model &model = static_cast<const Model &>(*this);
+      for (size_t i = 0; i < count; i++) {
+        times[i] = model.Model::imageTime(imagePoints[i]);
+      }
+    }
 };
 
 #endif
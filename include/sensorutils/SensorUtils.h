@@ -1,5 +1,6 @@
 #ifndef SensorUtils_h
 #define SensorUtils_h
+#include <cstddef>
 #include <vector>
 #include <armadillo>
 
@@ -23,5 +24,13 @@ double offNadirAngle(const vector<double> &observerBodyFixedPosition,
 vec illuminatorPosition(const vec &groundPointIntersection,
                         const vec &illuminatorDirection);
 
+void PhaseAngles(const double *observerPositions, size_t observerStride,
+                 const double *illuminatorPositions, size_t illuminatorStride,
+                 const double *surfaceIntersections, size_t count, double *phaseAngles);
+void EmissionAngles(const double *observerPositions, size_t observerStride,
+                    const double *groundPtIntersections, const double *surfaceNormals,
+                    size_t count, double *emissionAngles);
+void computeRADec(const double *rectangularCoords, size_t count, double *raDec);
+
 
 #endif
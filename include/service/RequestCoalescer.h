@@ -0,0 +1,137 @@
+#ifndef RequestCoalescer_h
+#define RequestCoalescer_h
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Backplane.h"
+#include "sensorcore.h"
+#include "StreamingStatistics.h"
+
+class Sensor;
+
+namespace execution {
+  class ThreadPool;
+}
+
+namespace service {
+
+  /**
+   * Queueing and batching metrics of a RequestCoalescer. Times are in seconds.
+   */
+  struct CoalescerMetrics {
+    CoalescerMetrics(double latencyBudget, size_t maximumBatchPoints);
+
+    statistics::StreamingStatistics queueTime;      /**< Submission to batch start, per request. */
+    statistics::StreamingStatistics latency;        /**< Submission to completion, per request. */
+    statistics::StreamingStatistics batchPoints;    /**< Number of points in each batch. */
+    statistics::StreamingStatistics batchRequests;  /**< Number of requests in each batch. */
+  };
+
+
+  /**
+   * Asynchronous front end that coalesces many small requests into batch kernel calls.
+   *
+   * Requests (a few points each) are queued per Sensor and quantity. A queue is run as one
+   * batch through the Sensor batch methods (or the computeRADec kernel) as soon as it holds
+   * maximumBatchPoints points, or when its oldest request has waited latencyBudget seconds,
+   * whichever comes first. A request is never split across batches, so a request larger than
+   * maximumBatchPoints runs on its own. The image points of a batch of several requests are
+   * evaluated along a Hilbert curve over the image (see execution::curveOrder), so the model
+   * sees them in a coherent order, and their values are handed back in request order.
+   *
+   * A dispatcher thread hands batches to an execution::ThreadPool, never more at once than the
+   * pool has threads: while every thread is busy, queues keep filling instead of splitting
+   * into more, smaller batches.
+   *
+   * Results are delivered through a std::future or a callback. Callbacks run on a pool
+   * thread and must not throw. An exception thrown by the batch is delivered to every request
+   * of the batch (through the future, or as the error argument of the callback).
+   *
+   * Each Sensor must outlive the requests submitted for it, and its batch methods may be
+   * called from several worker threads at once (as backplane::summarize does). The destructor
+   * runs every request still queued before it returns.
+   */
+  class RequestCoalescer {
+
+    public:
+      /**
+       * Receives the values of a request, or an empty vector and the exception that failed its
+       * batch.
+       */
+      typedef std::function<void(std::vector<double> &values, std::exception_ptr error)> Callback;
+
+      RequestCoalescer(double latencyBudget = 0.001, size_t maximumBatchPoints = 4096,
+                       int threads = 1);
+      RequestCoalescer(execution::ThreadPool &pool, double latencyBudget = 0.001,
+                       size_t maximumBatchPoints = 4096);
+      ~RequestCoalescer();
+
+      RequestCoalescer(const RequestCoalescer &) = delete;
+      RequestCoalescer &operator=(const RequestCoalescer &) = delete;
+
+      std::future<std::vector<double> > submit(Sensor &sensor, backplane::Quantity quantity,
+                                               const std::vector<ImagePoint> &imagePoints);
+      void submit(Sensor &sensor, backplane::Quantity quantity,
+                  const std::vector<ImagePoint> &imagePoints, const Callback &callback);
+
+      std::future<std::vector<double> > submitRADec(const std::vector<CartesianVector> &vectors);
+      void submitRADec(const std::vector<CartesianVector> &vectors, const Callback &callback);
+
+      CoalescerMetrics metrics() const;
+
+    private:
+      typedef std::chrono::steady_clock Clock;
+      typedef std::pair<Sensor *, int> Key;  // RA/Dec requests have no Sensor.
+
+      struct Request {
+        std::vector<ImagePoint> imagePoints;
+        std::vector<CartesianVector> vectors;
+        Clock::time_point submitted;
+        Callback callback;
+
+        size_t points() const;
+      };
+
+      struct Queue {
+        std::deque<Request> requests;
+        size_t points;
+        Clock::time_point deadline;  // Oldest request's submission plus the latency budget.
+      };
+
+      static double checkedBudget(double latencyBudget, size_t maximumBatchPoints);
+      void enqueue(const Key &key, Request &request);
+      void dispatch();
+      void run(const Key &key, std::vector<Request> &batch);
+
+      Clock::duration m_latencyBudget;
+      size_t m_maximumBatchPoints;
+
+      std::unique_ptr<execution::ThreadPool> m_ownedPool;
+      execution::ThreadPool *m_pool;
+
+      std::mutex m_mutex;
+      std::condition_variable m_ready;  // Signals new work, and batches finishing.
+      std::map<Key, Queue> m_queues;
+      int m_running;                    // Batches handed to the pool and not yet finished.
+      bool m_stopping;
+
+      mutable std::mutex m_metricsMutex;
+      CoalescerMetrics m_metrics;
+
+      std::thread m_dispatcher;
+  };
+}
+
+#endif
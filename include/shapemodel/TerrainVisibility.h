@@ -0,0 +1,97 @@
+#ifndef TerrainVisibility_h
+#define TerrainVisibility_h
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "sensorcore.h"
+
+namespace shapemodel {
+
+  /**
+   * A digital elevation model on a regular grid in a local Cartesian frame: the cell at
+   * (line, sample) is at x = originX + sample * spacing, y = originY + line * spacing and has
+   * height z. All coordinates share one unit (e.g. km).
+   */
+  class ElevationModel {
+
+    public:
+      ElevationModel(int64_t lines, int64_t samples, const std::vector<double> &heights,
+                     double originX, double originY, double spacing);
+
+      int64_t lines() const;
+      int64_t samples() const;
+      double originX() const;
+      double originY() const;
+      double spacing() const;
+      double maximumHeight() const;
+
+      double height(int64_t line, int64_t sample) const;
+      double height(double x, double y) const;
+
+    private:
+      int64_t m_lines;
+      int64_t m_samples;
+      std::vector<double> m_heights;
+      double m_originX;
+      double m_originY;
+      double m_spacing;
+      double m_maximumHeight;
+  };
+
+
+  /**
+   * Terrain occlusion queries on an elevation model, served from precomputed horizon maps.
+   *
+   * For every DEM cell and each of a fixed number of azimuths, the constructor marches across
+   * the DEM once and stores the tangent of the horizon elevation angle. A point is then
+   * shadowed if the illuminator is below the horizon in its direction, and visible if the
+   * observer is above it: one table lookup (interpolated between the two nearest azimuths) and
+   * a comparison per point instead of a ray march.
+   *
+   * Points are taken to lie on the DEM surface at the nearest cell. The horizon maps include
+   * terrain at any distance, so visibility is exact only for observers beyond the terrain
+   * (e.g. orbiters). rayMarchShadowed and rayMarchVisible are the exact (slow) answers to
+   * validate against.
+   *
+   * Batch methods take interleaved (x, y, z) arrays and 0/1 masks, like the photometric
+   * batch kernels in SensorUtils.
+   */
+  class TerrainVisibility {
+
+    public:
+      TerrainVisibility(const std::shared_ptr<const ElevationModel> &elevation, int azimuths = 32);
+
+      int azimuths() const;
+      const ElevationModel &elevation() const;
+
+      double horizonSlope(int64_t line, int64_t sample, double azimuth) const;
+
+      bool isShadowed(const CartesianPoint &point, const CartesianVector &illuminatorDirection) const;
+      bool isVisible(const CartesianPoint &point, const CartesianPoint &observerPosition) const;
+
+      void shadowMask(const double *points, size_t count, const double *illuminatorDirections,
+                      size_t illuminatorStride, uint8_t *shadowed) const;
+      void visibilityMask(const double *points, size_t count, const double *observerPositions,
+                          size_t observerStride, uint8_t *visible) const;
+
+      bool rayMarchShadowed(const CartesianPoint &point,
+                            const CartesianVector &illuminatorDirection) const;
+      bool rayMarchVisible(const CartesianPoint &point,
+                           const CartesianPoint &observerPosition) const;
+
+    private:
+      bool nearestCell(double x, double y, int64_t &line, int64_t &sample) const;
+      bool aboveHorizon(int64_t line, int64_t sample, double dx, double dy, double dz) const;
+      bool rayBlocked(int64_t line, int64_t sample, double dx, double dy, double dz,
+                      double horizontalLimit) const;
+
+      std::shared_ptr<const ElevationModel> m_elevation;
+      int m_azimuths;
+      std::vector<float> m_horizons;  // Horizon slope per cell and azimuth, cell-major.
+  };
+}
+
+#endif
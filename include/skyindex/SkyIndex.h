@@ -0,0 +1,106 @@
+#ifndef SkyIndex_h
+#define SkyIndex_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sensorcore.h"
+
+namespace skyindex {
+
+  /** The deepest pixelization order supported (nside = 2^29). */
+  const int MAX_ORDER = 29;
+
+  int64_t pixelCount(int order);
+  double maxPixelRadius(int order);
+
+  int64_t vectorToPixel(const CartesianVector &direction, int order);
+  CartesianVector pixelToVector(int64_t pixel, int order);
+  void neighbors(int64_t pixel, int order, int64_t result[8]);
+
+  CartesianVector raDecToVector(double rightAscension, double declination);
+
+
+  /**
+   * A single star (or any other point source) to be placed in a SkyIndex.
+   */
+  struct CatalogEntry {
+    double rightAscension;  /**< Right ascension in radians, as returned by computeRADec. */
+    double declination;     /**< Declination in radians, as returned by computeRADec. */
+    uint64_t id;            /**< Caller-defined identifier (e.g. the catalog number). */
+    /**
+     * Creates a CatalogEntry with the passed values.
+     *
+     * @param rightAscension Right ascension in radians.
+     * @param declination Declination in radians.
+     * @param id Caller-defined identifier.
+     */
+    CatalogEntry(double rightAscension, double declination, uint64_t id):
+      rightAscension(rightAscension), declination(declination), id(id) {};
+  };
+
+
+  /**
+   * Catalog of sky positions sorted along the nested equal-area pixelization.
+   *
+   * Entries are kept as three parallel arrays (pixel numbers, unit vectors and ids) sorted by
+   * pixel so that a cone search touches a handful of contiguous runs located by binary search.
+   * The same layout is used on disk, so an index written with save() can be mapped read-only
+   * with load() without parsing or copying.
+   */
+  class SkyIndex {
+
+    public:
+      SkyIndex();
+      SkyIndex(const std::vector<CatalogEntry> &entries, int order);
+      ~SkyIndex();
+
+      static SkyIndex load(const std::string &path);
+      void save(const std::string &path) const;
+
+      int order() const;
+      size_t size() const;
+
+      int64_t pixel(size_t index) const;
+      CartesianVector direction(size_t index) const;
+      uint64_t id(size_t index) const;
+
+      void coneSearch(const CartesianVector &center, double radius,
+                      std::vector<size_t> &matches) const;
+      void coneSearch(const CartesianVector *centers, size_t count, double radius,
+                      std::vector<size_t> &offsets, std::vector<size_t> &matches) const;
+
+      SkyIndex(SkyIndex &&other);
+      SkyIndex &operator=(SkyIndex &&other);
+
+    private:
+      SkyIndex(const SkyIndex &);
+      SkyIndex &operator=(const SkyIndex &);
+
+      void release();
+      void searchRanges(const CartesianVector &center, double radius,
+                        std::vector<int64_t> &ranges) const;
+      void appendMatches(const CartesianVector &center, double radius,
+                         std::vector<int64_t> &ranges, std::vector<size_t> &matches) const;
+
+      int m_order;
+      size_t m_size;
+
+      // Owned storage, used when the index is built in memory.
+      std::vector<int64_t> m_pixelStorage;
+      std::vector<double> m_directionStorage;
+      std::vector<uint64_t> m_idStorage;
+
+      // Views onto either the owned storage or the mapped file.
+      const int64_t *m_pixels;
+      const double *m_directions;
+      const uint64_t *m_ids;
+
+      void *m_mapping;
+      size_t m_mappingSize;
+  };
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef StreamingStatistics_h
+#define StreamingStatistics_h
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct EncodedBuffer;
+
+namespace statistics {
+
+  /**
+   * Single-pass summary of a stream of values: count, minimum, maximum, mean, standard
+   * deviation and a fixed-range histogram.
+   *
+   * NaN and infinite values are counted as invalid and otherwise ignored. The mean and
+   * variance are accumulated with Welford's update and combined with Chan's pairwise formula,
+   * so partial summaries computed separately can be merged without keeping the values. Counts,
+   * extrema and histograms merge exactly; the mean and variance depend (in the last bits) on
+   * the merge order, which is why parallel producers merge partial summaries in a fixed block
+   * order.
+   */
+  class StreamingStatistics {
+
+    public:
+      StreamingStatistics(double histogramMinimum = 0.0, double histogramMaximum = M_PI,
+                          int bins = 180);
+
+      void add(double value);
+      void add(const double *values, size_t count);
+      void add(const EncodedBuffer &values, size_t count);
+      void merge(const StreamingStatistics &other);
+      void reset();
+
+      uint64_t count() const;
+      uint64_t invalidCount() const;
+      double minimum() const;
+      double maximum() const;
+      double mean() const;
+      double variance() const;
+      double standardDeviation() const;
+
+      int bins() const;
+      double histogramMinimum() const;
+      double histogramMaximum() const;
+      double binMinimum(int bin) const;
+      double quantile(double fraction) const;
+      const std::vector<uint64_t> &histogram() const;
+      uint64_t underflow() const;
+      uint64_t overflow() const;
+
+    private:
+      double m_histogramMinimum;
+      double m_histogramMaximum;
+      double m_binScale;
+
+      uint64_t m_count;
+      uint64_t m_invalid;
+      double m_minimum;
+      double m_maximum;
+      double m_mean;
+      double m_m2;
+
+      std::vector<uint64_t> m_histogram;
+      uint64_t m_underflow;
+      uint64_t m_overflow;
+  };
+}
+
+#endif
@@ -0,0 +1,353 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "SensorMath.h"
+#include "SensorUtils.h"
+
+/**
+ * Python bindings for the batch kernels.
+ *
+ * Every function takes float64 arrays through the buffer protocol (NumPy arrays, array.array,
+ * memoryview, ...) and works on their memory directly: inputs are never copied, and results
+ * are written straight into the optional out array or into a newly allocated NumPy array
+ * (a memoryview over a bytearray if NumPy is not installed). Inputs must be C-contiguous.
+ * The GIL is released while the kernels run, so Python threads can compute concurrently.
+ */
+namespace {
+
+  /**
+   * Holds a buffer obtained from a Python object and releases it when it goes out of scope.
+   */
+  class Buffer {
+
+    public:
+      Buffer() : m_held(false) {}
+
+      ~Buffer() {
+        if (m_held) {
+          PyBuffer_Release(&m_view);
+        }
+      }
+
+      /**
+       * Obtains a C-contiguous float64 buffer.
+       *
+       * @param object The object exposing the buffer.
+       * @param name The argument name used in error messages.
+       * @param writable Whether the buffer is written to.
+       *
+       * @return bool Returns false, with a Python exception set, if the object does not expose
+       *              a suitable buffer.
+       */
+      bool acquire(PyObject *object, const char *name, bool writable = false) {
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+        if (PyObject_GetBuffer(object, &m_view, flags) != 0) {
+          return false;
+        }
+        m_held = true;
+        const char *format = m_view.format ? m_view.format : "B";
+        if (std::strcmp(format, "d") != 0 && std::strcmp(format, "@d") != 0
+            && std::strcmp(format, "=d") != 0) {
+          PyErr_Format(PyExc_TypeError, "%s must be a float64 array, not format '%s'",
+                       name, format);
+          return false;
+        }
+        return true;
+      }
+
+      /**
+       * Checks that the buffer holds (x, y, z) points: its last dimension must be 3.
+       *
+       * @param name The argument name used in error messages.
+       *
+       * @return bool Returns false, with a Python exception set, if it does not.
+       */
+      bool requirePoints(const char *name) {
+        if (m_view.ndim < 1 || m_view.shape[m_view.ndim - 1] != 3) {
+          PyErr_Format(PyExc_ValueError, "%s must have shape (..., 3)", name);
+          return false;
+        }
+        return true;
+      }
+
+      double *data() const {
+        return static_cast<double *>(m_view.buf);
+      }
+
+      /**
+       * @return size_t Returns the number of doubles in the buffer.
+       */
+      size_t size() const {
+        return size_t(m_view.len) / sizeof(double);
+      }
+
+      /**
+       * @param trailing A number of trailing dimensions to leave out.
+       *
+       * @return std::vector<Py_ssize_t> Returns the shape without its trailing dimensions.
+       */
+      std::vector<Py_ssize_t> leadingShape(int trailing) const {
+        return std::vector<Py_ssize_t>(m_view.shape, m_view.shape + m_view.ndim - trailing);
+      }
+
+    private:
+      Py_buffer m_view;
+      bool m_held;
+  };
+
+
+  /**
+   * Allocates an uninitialized float64 array.
+   *
+   * @param shape The shape of the array.
+   *
+   * @return PyObject* Returns a NumPy array, or a memoryview over a bytearray if NumPy can not
+   *                   be imported. Returns NULL with a Python exception set on failure.
+   */
+  PyObject *allocate(const std::vector<Py_ssize_t> &shape) {
+    PyObject *shapeTuple = PyTuple_New(shape.size());
+    if (!shapeTuple) {
+      return NULL;
+    }
+    Py_ssize_t size = 1;
+    for (size_t i = 0; i < shape.size(); i++) {
+      PyTuple_SET_ITEM(shapeTuple, i, PyLong_FromSsize_t(shape[i]));
+      size *= shape[i];
+    }
+
+    PyObject *result = NULL;
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if (numpy) {
+      result = PyObject_CallMethod(numpy, "empty", "O", shapeTuple);
+      Py_DECREF(numpy);
+    }
+    else {
+      PyErr_Clear();
+      PyObject *bytes = PyByteArray_FromStringAndSize(NULL, size * Py_ssize_t(sizeof(double)));
+      if (bytes) {
+        PyObject *view = PyMemoryView_FromObject(bytes);
+        if (view) {
+          result = PyObject_CallMethod(view, "cast", "sO", "d", shapeTuple);
+          Py_DECREF(view);
+        }
+        Py_DECREF(bytes);
+      }
+    }
+    Py_DECREF(shapeTuple);
+    return result;
+  }
+
+
+  /**
+   * Returns the output array for a call: the caller's out array if one was passed, otherwise
+   * a new array of the passed shape. The output is acquired into buffer.
+   *
+   * @return PyObject* Returns a new reference to the output, or NULL with a Python exception
+   *                   set if out has the wrong type or size.
+   */
+  PyObject *output(PyObject *out, const std::vector<Py_ssize_t> &shape, Buffer &buffer) {
+    PyObject *result;
+    if (out && out != Py_None) {
+      Py_INCREF(out);
+      result = out;
+    }
+    else if (!(result = allocate(shape))) {
+      return NULL;
+    }
+
+    size_t size = 1;
+    for (size_t i = 0; i < shape.size(); i++) {
+      size *= size_t(shape[i]);
+    }
+    if (!buffer.acquire(result, "out", true)) {
+      Py_DECREF(result);
+      return NULL;
+    }
+    if (buffer.size() != size) {
+      PyErr_Format(PyExc_ValueError, "out must hold %zu values", size);
+      Py_DECREF(result);
+      return NULL;
+    }
+    return result;
+  }
+
+
+  /**
+   * Returns the stride, in doubles, of a position argument that is either a single point or one
+   * point per surface point.
+   *
+   * @return Py_ssize_t Returns 0 or 3, or -1 with a Python exception set.
+   */
+  Py_ssize_t positionStride(const Buffer &positions, size_t count, const char *name) {
+    if (positions.size() == 3) {
+      return 0;
+    }
+    if (positions.size() == 3 * count) {
+      return 3;
+    }
+    PyErr_Format(PyExc_ValueError, "%s must be a single point or one point per surface point",
+                 name);
+    return -1;
+  }
+
+
+  PyObject *phaseAngles(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"observer", "illuminator", "surface", "out", NULL};
+    PyObject *observerObject, *illuminatorObject, *surfaceObject, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|O", const_cast<char **>(keywords),
+                                     &observerObject, &illuminatorObject, &surfaceObject, &out)) {
+      return NULL;
+    }
+
+    Buffer observer, illuminator, surface, angles;
+    if (!observer.acquire(observerObject, "observer") || !observer.requirePoints("observer")
+        || !illuminator.acquire(illuminatorObject, "illuminator")
+        || !illuminator.requirePoints("illuminator")
+        || !surface.acquire(surfaceObject, "surface") || !surface.requirePoints("surface")) {
+      return NULL;
+    }
+    size_t count = surface.size() / 3;
+    Py_ssize_t observerStride = positionStride(observer, count, "observer");
+    Py_ssize_t illuminatorStride = positionStride(illuminator, count, "illuminator");
+    if (observerStride < 0 || illuminatorStride < 0) {
+      return NULL;
+    }
+    PyObject *result = output(out, surface.leadingShape(1), angles);
+    if (!result) {
+      return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    PhaseAngles(observer.data(), observerStride, illuminator.data(), illuminatorStride,
+                surface.data(), count, angles.data());
+    Py_END_ALLOW_THREADS
+    return result;
+  }
+
+
+  PyObject *emissionAngles(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"observer", "ground", "normal", "out", NULL};
+    PyObject *observerObject, *groundObject, *normalObject, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|O", const_cast<char **>(keywords),
+                                     &observerObject, &groundObject, &normalObject, &out)) {
+      return NULL;
+    }
+
+    Buffer observer, ground, normal, angles;
+    if (!observer.acquire(observerObject, "observer") || !observer.requirePoints("observer")
+        || !ground.acquire(groundObject, "ground") || !ground.requirePoints("ground")
+        || !normal.acquire(normalObject, "normal") || !normal.requirePoints("normal")) {
+      return NULL;
+    }
+    size_t count = ground.size() / 3;
+    if (normal.size() != ground.size()) {
+      PyErr_SetString(PyExc_ValueError, "normal must have one vector per ground point");
+      return NULL;
+    }
+    Py_ssize_t observerStride = positionStride(observer, count, "observer");
+    if (observerStride < 0) {
+      return NULL;
+    }
+    PyObject *result = output(out, ground.leadingShape(1), angles);
+    if (!result) {
+      return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    EmissionAngles(observer.data(), observerStride, ground.data(), normal.data(), count,
+                   angles.data());
+    Py_END_ALLOW_THREADS
+    return result;
+  }
+
+
+  PyObject *raDec(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"coords", "out", NULL};
+    PyObject *coordsObject, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char **>(keywords),
+                                     &coordsObject, &out)) {
+      return NULL;
+    }
+
+    Buffer coords, angles;
+    if (!coords.acquire(coordsObject, "coords") || !coords.requirePoints("coords")) {
+      return NULL;
+    }
+    std::vector<Py_ssize_t> shape = coords.leadingShape(1);
+    shape.push_back(2);
+    PyObject *result = output(out, shape, angles);
+    if (!result) {
+      return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    computeRADec(coords.data(), coords.size() / 3, angles.data());
+    Py_END_ALLOW_THREADS
+    return result;
+  }
+
+
+  PyObject *rect2lat(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"coords", "out", NULL};
+    PyObject *coordsObject, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char **>(keywords),
+                                     &coordsObject, &out)) {
+      return NULL;
+    }
+
+    Buffer coords, spherical;
+    if (!coords.acquire(coordsObject, "coords") || !coords.requirePoints("coords")) {
+      return NULL;
+    }
+    PyObject *result = output(out, coords.leadingShape(0), spherical);
+    if (!result) {
+      return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    sensormath::rect2lat(coords.data(), coords.size() / 3, spherical.data());
+    Py_END_ALLOW_THREADS
+    return result;
+  }
+
+
+  PyMethodDef methods[] = {
+    {"phase_angles", (PyCFunction)(void (*)(void))phaseAngles, METH_VARARGS | METH_KEYWORDS,
+     "phase_angles(observer, illuminator, surface, out=None)\n\n"
+     "Phase angles, in radians, at surface points of shape (..., 3). observer and illuminator\n"
+     "are a single point or one point per surface point. Returns an array of shape (...)."},
+    {"emission_angles", (PyCFunction)(void (*)(void))emissionAngles,
+     METH_VARARGS | METH_KEYWORDS,
+     "emission_angles(observer, ground, normal, out=None)\n\n"
+     "Emission angles, in radians, at ground points of shape (..., 3) with unit surface\n"
+     "normals of the same shape. observer is a single point or one point per ground point.\n"
+     "Returns an array of shape (...)."},
+    {"compute_ra_dec", (PyCFunction)(void (*)(void))raDec, METH_VARARGS | METH_KEYWORDS,
+     "compute_ra_dec(coords, out=None)\n\n"
+     "Right ascension in [0, 2 pi) and declination, in radians, of points of shape (..., 3).\n"
+     "Returns an array of shape (..., 2)."},
+    {"rect2lat", (PyCFunction)(void (*)(void))rect2lat, METH_VARARGS | METH_KEYWORDS,
+     "rect2lat(coords, out=None)\n\n"
+     "Radius, declination and right ascension (radians) of points of shape (..., 3).\n"
+     "Returns an array of shape (..., 3)."},
+    {NULL, NULL, 0, NULL}
+  };
+
+
+  PyModuleDef module = {
+    PyModuleDef_HEAD_INIT,
+    "sensorutils",
+    "Zero-copy batch sensor utilities over float64 buffers (NumPy arrays and the like).",
+    -1,
+    methods
+  };
+}
+
+
+PyMODINIT_FUNC PyInit_sensorutils(void) {
+  return PyModule_Create(&module);
+}
@@ -0,0 +1,95 @@
+"""Tests for the sensorutils extension module.
+
+Uses NumPy when it is installed and falls back to array/memoryview buffers otherwise.
+"""
+import array
+import math
+import threading
+import unittest
+
+import sensorutils
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+
+def points(values):
+    """Returns a C-contiguous float64 buffer of shape (len(values) / 3, 3)."""
+    buffer = memoryview(array.array('d', values)).cast('B')
+    return buffer.cast('d', (len(values) // 3, 3))
+
+
+class SensorUtilsTest(unittest.TestCase):
+
+    def test_phase_angles_single_observer(self):
+        angles = sensorutils.phase_angles(points([-1, 0, 0]), points([1, 0, 0, 0, 1, 0]),
+                                          points([0, 0, 0, 0, 0, 0]))
+        self.assertAlmostEqual(math.pi, angles[0])
+        self.assertAlmostEqual(math.pi / 2, angles[1])
+
+    def test_emission_angles(self):
+        angles = sensorutils.emission_angles(points([2, 0, 0, 1, 1, 1]),
+                                             points([1, 0, 0, 0, 0, 0]),
+                                             points([1, 0, 0, -2, -2, 2]))
+        self.assertAlmostEqual(0.0, angles[0])
+        self.assertAlmostEqual(math.pi, angles[1], places=5)
+
+    def test_compute_ra_dec(self):
+        radec = sensorutils.compute_ra_dec(points([-0.495304, -0.414169, -1.15686]))
+        self.assertAlmostEqual(219.90205833, math.degrees(radec[0, 0]), delta=1e-4)
+        self.assertAlmostEqual(-60.83399269, math.degrees(radec[0, 1]), delta=1e-4)
+
+    def test_rect2lat_writes_into_out(self):
+        out = points([0.0] * 6)
+        result = sensorutils.rect2lat(points([1, 1, 1, 0, 0, 0]), out=out)
+        self.assertIs(out, result)
+        self.assertAlmostEqual(math.sqrt(3), out[0, 0])
+        self.assertAlmostEqual(35.2643, math.degrees(out[0, 1]), delta=1e-4)
+        self.assertAlmostEqual(45.0, math.degrees(out[0, 2]), delta=1e-4)
+        self.assertEqual(0.0, out[1, 0])
+
+    def test_rejects_bad_buffers(self):
+        with self.assertRaises(TypeError):
+            sensorutils.rect2lat(array.array('f', [1, 2, 3]))
+        with self.assertRaises(ValueError):
+            sensorutils.rect2lat(memoryview(array.array('d', [1, 2, 3, 4])))
+        with self.assertRaises(ValueError):
+            sensorutils.rect2lat(points([1, 2, 3]), out=points([0.0] * 6))
+        with self.assertRaises(ValueError):
+            sensorutils.phase_angles(points([0, 0, 1] * 2), points([1, 0, 0]),
+                                     points([0, 0, 0] * 3))
+
+    def test_threads(self):
+        count = 100000
+        surface = points([0.0, 0.0, 0.0] * count)
+        results = [None] * 4
+
+        def work(index):
+            results[index] = sensorutils.phase_angles(points([1, 0, 0]), points([0, 1, 0]),
+                                                      surface)
+
+        threads = [threading.Thread(target=work, args=(i,)) for i in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        for result in results:
+            self.assertAlmostEqual(math.pi / 2, result[count - 1])
+
+    @unittest.skipIf(numpy is None, "NumPy is not installed")
+    def test_numpy(self):
+        surface = numpy.zeros((4, 5, 3))
+        surface[..., 2] = 1.0
+        angles = sensorutils.phase_angles(numpy.array([0.0, 0.0, 2.0]),
+                                          numpy.array([0.0, 1.0, 1.0]), surface)
+        self.assertIsInstance(angles, numpy.ndarray)
+        self.assertEqual((4, 5), angles.shape)
+        numpy.testing.assert_allclose(angles, math.pi / 2)
+        with self.assertRaises(BufferError):
+            sensorutils.rect2lat(surface[:, ::2])
+
+
+if __name__ == '__main__':
+    unittest.main()
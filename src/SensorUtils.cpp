@@ -202,3 +202,110 @@ arma::vec illuminatorPosition(const arma::vec &groundPointIntersection,
   // minus the illumination direction (center sun to ground point)
   return groundPointIntersection - illuminatorDirection;
 }
+
+
+/**
+ * Computes the phase angle, in radians, for an array of surface points, as PhaseAngle does
+ * for a single point. The observer and illuminator may be given per point (stride 3) or
+ * once for all points (stride 0).
+ *
+ * @param observerPositions Observer positions in the body-fixed coordinate system.
+ * @param observerStride Number of doubles between consecutive observer positions (3 or 0).
+ * @param illuminatorPositions Illuminator positions in the body-fixed coordinate system.
+ * @param illuminatorStride Number of doubles between consecutive illuminator positions (3 or 0).
+ * @param surfaceIntersections count interleaved (x, y, z) surface points.
+ * @param count Number of surface points.
+ * @param phaseAngles Receives count phase angles, in radians.
+ */
+void PhaseAngles(const double *observerPositions, size_t observerStride,
+                 const double *illuminatorPositions, size_t illuminatorStride,
+                 const double *surfaceIntersections, size_t count, double *phaseAngles) {
+  for (size_t i = 0; i < count; i++) {
+    const double *observer = observerPositions + i * observerStride;
+    const double *illuminator = illuminatorPositions + i * illuminatorStride;
+    const double *surface = surfaceIntersections + 3 * i;
+
+    double toObserver[3], toIlluminator[3];
+    double observerLength = 0.0, illuminatorLength = 0.0, dotProduct = 0.0;
+    for (int axis = 0; axis < 3; axis++) {
+      toObserver[axis] = observer[axis] - surface[axis];
+      toIlluminator[axis] = illuminator[axis] - surface[axis];
+      observerLength += toObserver[axis] * toObserver[axis];
+      illuminatorLength += toIlluminator[axis] * toIlluminator[axis];
+      dotProduct += toObserver[axis] * toIlluminator[axis];
+    }
+
+    // A zero vector normalises to zero, as in PhaseAngle.
+    double lengths = sqrt(observerLength) * sqrt(illuminatorLength);
+    double cos_angle = lengths > 0.0 ? dotProduct / lengths : 0.0;
+    if (cos_angle >= 1.0) {
+      phaseAngles[i] = 0.0;
+    }
+    else if (cos_angle <= -1.0) {
+      phaseAngles[i] = M_PI;
+    }
+    else {
+      phaseAngles[i] = acos(cos_angle);
+    }
+  }
+}
+
+
+/**
+ * Computes the emission angle, in radians, for an array of ground points, as EmissionAngle
+ * does for a single point. The observer may be given per point (stride 3) or once for all
+ * points (stride 0).
+ *
+ * @param observerPositions Observer positions in the body-fixed coordinate system.
+ * @param observerStride Number of doubles between consecutive observer positions (3 or 0).
+ * @param groundPtIntersections count interleaved (x, y, z) ground points.
+ * @param surfaceNormals count interleaved (x, y, z) surface normals (used as given).
+ * @param count Number of ground points.
+ * @param emissionAngles Receives count emission angles, in radians.
+ */
+void EmissionAngles(const double *observerPositions, size_t observerStride,
+                    const double *groundPtIntersections, const double *surfaceNormals,
+                    size_t count, double *emissionAngles) {
+  for (size_t i = 0; i < count; i++) {
+    const double *observer = observerPositions + i * observerStride;
+    const double *ground = groundPtIntersections + 3 * i;
+    const double *normal = surfaceNormals + 3 * i;
+
+    double lookLength = 0.0, dotProduct = 0.0;
+    for (int axis = 0; axis < 3; axis++) {
+      double look = observer[axis] - ground[axis];
+      lookLength += look * look;
+      dotProduct += look * normal[axis];
+    }
+
+    double cos_theta = lookLength > 0.0 ? dotProduct / sqrt(lookLength) : 0.0;
+    if (cos_theta >= 1.0) {
+      emissionAngles[i] = 0.0;
+    }
+    else if (cos_theta <= -1.0) {
+      emissionAngles[i] = M_PI;
+    }
+    else {
+      emissionAngles[i] = acos(cos_theta);
+    }
+  }
+}
+
+
+/**
+ * Computes the right ascension and declination of an array of points, as computeRADec does
+ * for a single point.
+ *
+ * @param rectangularCoords count interleaved (x, y, z) points.
+ * @param count Number of points.
+ * @param raDec Receives count interleaved (RightAscension, Declination) pairs in radians,
+ *              with the right ascension in [0, 2 pi).
+ */
+void computeRADec(const double *rectangularCoords, size_t count, double *raDec) {
+  for (size_t i = 0; i < count; i++) {
+    double radiusLatLong[3];
+    sensormath::rect2lat(rectangularCoords + 3 * i, 1, radiusLatLong);
+    raDec[2 * i] = radiusLatLong[2] < 0.0 ? radiusLatLong[2] + 2 * M_PI : radiusLatLong[2];
+    raDec[2 * i + 1] = radiusLatLong[1];
+  }
+}
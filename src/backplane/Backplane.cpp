@@ -0,0 +1,373 @@
+#include "Backplane.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "Sensor.h"
+#include "sensorcore.h"
+#include "StreamingStatistics.h"
+#include "ThreadPool.h"
+#include "Traversal.h"
+
+namespace backplane {
+
+  namespace {
+
+    int64_t levelSize(int64_t size, int level) {
+      return (size + (int64_t(1) << level) - 1) >> level;
+    }
+
+
+    // Averages each 2x2 block of a finer strip into one coarse pixel. Blocks cut off by the
+    // image edge average the pixels they have; invalid (NaN) pixels are ignored.
+    void reduce(const double *fine, int64_t fineLines, int64_t fineSamples, double *coarse,
+                int64_t coarseLines, int64_t coarseSamples) {
+      for (int64_t line = 0; line < coarseLines; line++) {
+        for (int64_t sample = 0; sample < coarseSamples; sample++) {
+          double sum = 0.0;
+          int count = 0;
+          for (int64_t l = 2 * line; l < std::min(2 * line + 2, fineLines); l++) {
+            for (int64_t s = 2 * sample; s < std::min(2 * sample + 2, fineSamples); s++) {
+              double value = fine[l * fineSamples + s];
+              if (!std::isnan(value)) {
+                sum += value;
+                count++;
+              }
+            }
+          }
+          coarse[line * coarseSamples + sample] = count ? sum / count : NAN;
+        }
+      }
+    }
+  }
+
+
+  /**
+   * Stores a strip in the raster of its level, growing the pyramid as needed.
+   */
+  void PyramidBuffer::write(int level, int64_t firstLine, int64_t lines, int64_t samples,
+                            const EncodedBuffer &values) {
+    if (int(levels.size()) <= level) {
+      levels.resize(level + 1);
+      codes.resize(level + 1);
+      this->samples.resize(level + 1, 0);
+    }
+    this->samples[level] = samples;
+    size_t end = size_t((firstLine + lines) * samples);
+    if (values.encoding == Encoding::Float64) {
+      const double *strip = static_cast<const double *>(values.data);
+      if (levels[level].size() < end) {
+        levels[level].resize(end);
+      }
+      std::copy(strip, strip + lines * samples, levels[level].begin() + firstLine * samples);
+    }
+    else {
+      const uint16_t *strip = static_cast<const uint16_t *>(values.data);
+      if (codes[level].size() < end) {
+        codes[level].resize(end);
+      }
+      std::copy(strip, strip + lines * samples, codes[level].begin() + firstLine * samples);
+    }
+  }
+
+
+  /**
+   * Evaluates a window of a backplane through the Sensor photometric path.
+   *
+   * Pixels are sampled at their centers using the convention that full-resolution pixel
+   * (line, sample) is centered on image point (sample + 0.5, line + 0.5). A pixel at a coarser
+   * level covers 2^level by 2^level full-resolution pixels and is sampled at the center of that
+   * block, so coarse levels are evaluated directly rather than by reading finer ones.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to compute.
+   * @param level Pyramid level of the window, 0 being full resolution.
+   * @param firstLine First line of the window, in pixels of the level.
+   * @param firstSample First sample of the window, in pixels of the level.
+   * @param lines Number of lines in the window.
+   * @param samples Number of samples in the window.
+   * @param values Receives lines * samples values, row-major, stored directly in the
+   *               buffer's encoding.
+   * @param statistics If not NULL, every unquantized value is also added to it.
+   */
+  void evaluate(Sensor &sensor, Quantity quantity, int level, int64_t firstLine,
+                int64_t firstSample, int lines, int samples, const EncodedBuffer &values,
+                statistics::StreamingStatistics *statistics) {
+    double scale = double(int64_t(1) << level);
+    std::vector<ImagePoint> row(samples);
+    for (int line = 0; line < lines; line++) {
+      double imageLine = (firstLine + line + 0.5) * scale;
+      for (int sample = 0; sample < samples; sample++) {
+        row[sample] = ImagePoint((firstSample + sample + 0.5) * scale, imageLine, 1.0);
+      }
+
+      EncodedBuffer out = values.offset(size_t(line) * samples);
+      switch (quantity) {
+        case Phase:
+          sensor.phaseAngles(row.data(), row.size(), out, statistics);
+          break;
+        case Emission:
+          sensor.emissionAngles(row.data(), row.size(), out, statistics);
+          break;
+        case Incidence:
+          sensor.incidenceAngles(row.data(), row.size(), out, statistics);
+          break;
+        case Resolution:
+          sensor.resolutions(row.data(), row.size(), out, statistics);
+          break;
+      }
+    }
+  }
+
+
+  /**
+   * Generates a backplane and its overview levels in a single pass over the image.
+   *
+   * The image is processed in full-width strips whose height is a multiple of 2^(levels - 1),
+   * so every strip maps onto whole lines of every coarser level. Each strip is evaluated at
+   * full resolution and written, then the same strip of each coarser level is either reduced
+   * from the strip just produced (Reduce) or evaluated through the Sensor at the coarse pixel
+   * centers (Direct), and written in turn. Only one strip per level is held in memory.
+   *
+   * With a 16-bit format and Direct mode, values are encoded as they are computed. Reduce
+   * averages unquantized values, so it keeps one double strip per level and encodes each
+   * strip just before it is written.
+   *
+   * Level k has ceil(lines / 2^k) lines and ceil(samples / 2^k) samples.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to compute.
+   * @param lines Number of lines in the full-resolution image.
+   * @param samples Number of samples in the full-resolution image.
+   * @param levels Number of pyramid levels to write, including full resolution.
+   * @param mode How the coarser levels are produced.
+   * @param writer Receives the strips of every level.
+   * @param stripLines Approximate number of full-resolution lines processed at a time.
+   * @param format The encoding of the strips handed to the writer.
+   * @param statistics If not NULL, every full-resolution value is also added to it.
+   *
+   * @throws std::invalid_argument If a dimension or the number of levels is not positive.
+   */
+  void generate(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples, int levels,
+                PyramidMode mode, BackplaneWriter &writer, int stripLines,
+                const EncodingFormat &format, statistics::StreamingStatistics *statistics) {
+    if (lines <= 0 || samples <= 0 || levels <= 0 || levels > 31 || stripLines <= 0) {
+      throw std::invalid_argument("Backplane dimensions and level count must be positive");
+    }
+    int64_t alignment = int64_t(1) << (levels - 1);
+    int64_t strip = ((stripLines + alignment - 1) / alignment) * alignment;
+    bool encoded = format.encoding != Encoding::Float64;
+    bool keepValues = !encoded || mode == Reduce;
+
+    std::vector<std::vector<double> > values(levels);
+    std::vector<std::vector<uint16_t> > codes(levels);
+    for (int level = 0; level < levels; level++) {
+      size_t size = size_t((strip >> level) * levelSize(samples, level));
+      if (keepValues) {
+        values[level].resize(size);
+      }
+      if (encoded) {
+        codes[level].resize(size);
+      }
+    }
+
+    for (int64_t start = 0; start < lines; start += strip) {
+      int64_t end = std::min(start + strip, lines);
+      for (int level = 0; level < levels; level++) {
+        int64_t firstLine = start >> level;
+        int64_t stripLevelLines = levelSize(end, level) - firstLine;
+        int64_t levelSamples = levelSize(samples, level);
+        EncodedBuffer output = encoded ? EncodedBuffer(format, codes[level].data())
+                                       : EncodedBuffer(values[level].data());
+
+        if (level == 0 || mode == Direct) {
+          evaluate(sensor, quantity, level, firstLine, 0, int(stripLevelLines), int(levelSamples),
+                   keepValues ? EncodedBuffer(values[level].data()) : output,
+                   level == 0 ? statistics : NULL);
+        }
+        else {
+          int64_t fineLines = levelSize(end, level - 1) - (start >> (level - 1));
+          reduce(values[level - 1].data(), fineLines, levelSize(samples, level - 1),
+                 values[level].data(), stripLevelLines, levelSamples);
+        }
+
+        if (encoded && keepValues) {
+          for (int64_t i = 0; i < stripLevelLines * levelSamples; i++) {
+            output.store(size_t(i), values[level][i]);
+          }
+        }
+        writer.write(level, firstLine, stripLevelLines, levelSamples, output);
+      }
+    }
+  }
+
+
+  /**
+   * Computes a full-resolution backplane in parallel.
+   *
+   * The image is split into blocks of consecutive lines (see execution::blockBegin) and block
+   * b is evaluated by item b of a parallelFor on the pool, so a values array allocated as an
+   * execution::FirstTouchBuffer with the same number of blocks is written entirely from the
+   * NUMA node that holds each block. The values are the same as those of generate().
+   *
+   * The Sensor (and its SensorModel) is called concurrently, so the model must be safe to
+   * share between threads.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to compute.
+   * @param lines Number of lines in the image.
+   * @param samples Number of samples in the image.
+   * @param values Receives lines * samples values, row-major, in the buffer's encoding.
+   * @param pool The threads to use.
+   * @param blocks Number of line blocks, or 0 for four per pool thread.
+   *
+   * @throws std::invalid_argument If a dimension or the block count is not positive.
+   */
+  void compute(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples,
+               const EncodedBuffer &values, execution::ThreadPool &pool, int64_t blocks) {
+    if (blocks == 0) {
+      blocks = std::min<int64_t>(lines, 4 * pool.threads());
+    }
+    if (lines <= 0 || samples <= 0 || blocks <= 0) {
+      throw std::invalid_argument("Backplane dimensions and block count must be positive");
+    }
+    pool.parallelFor(blocks, [&](int64_t block) {
+      int64_t first = execution::blockBegin(block, blocks, lines);
+      int64_t end = execution::blockBegin(block + 1, blocks, lines);
+      evaluate(sensor, quantity, 0, first, 0, int(end - first), int(samples),
+               values.offset(size_t(first * samples)));
+    });
+  }
+
+
+  /**
+   * Computes a full-resolution backplane in parallel, tile by tile in the order of a
+   * TraversalSchedule.
+   *
+   * The schedule is split into blocks of consecutive tiles (see execution::blockBegin), one
+   * per parallelFor item, so each thread works through a compact region of the image and,
+   * with a ground-aware schedule, of the ground: a SensorModel or DEM that caches ground data
+   * sees far fewer distinct tiles at once than with full-width line blocks. The values are the
+   * same as those of generate().
+   *
+   * The Sensor (and its SensorModel) is called concurrently, so the model must be safe to
+   * share between threads.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to compute.
+   * @param schedule The tiles of the image, in processing order.
+   * @param values Receives schedule.lines() * schedule.samples() values, row-major, in the
+   *               buffer's encoding.
+   * @param pool The threads to use.
+   * @param blocks Number of tile blocks, or 0 for four per pool thread.
+   *
+   * @throws std::invalid_argument If the block count is negative.
+   */
+  void compute(Sensor &sensor, Quantity quantity, const execution::TraversalSchedule &schedule,
+               const EncodedBuffer &values, execution::ThreadPool &pool, int64_t blocks) {
+    int64_t tiles = int64_t(schedule.size());
+    if (blocks == 0) {
+      blocks = std::min<int64_t>(tiles, 4 * pool.threads());
+    }
+    if (blocks <= 0) {
+      throw std::invalid_argument("The tile block count must be positive");
+    }
+    int64_t samples = schedule.samples();
+    pool.parallelFor(blocks, [&](int64_t block) {
+      int64_t end = execution::blockBegin(block + 1, blocks, tiles);
+      for (int64_t i = execution::blockBegin(block, blocks, tiles); i < end; i++) {
+        const execution::ImageTile &tile = schedule[size_t(i)];
+        for (int line = 0; line < tile.lines; line++) {
+          int64_t imageLine = tile.firstLine + line;
+          evaluate(sensor, quantity, 0, imageLine, tile.firstSample, 1, tile.samples,
+                   values.offset(size_t(imageLine * samples + tile.firstSample)));
+        }
+      }
+    });
+  }
+
+
+  /**
+   * Summarizes a full-resolution backplane without storing it, on a temporary unpinned pool
+   * of threads threads. Use the ThreadPool overload to reuse a long-lived (pinned) pool.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to summarize.
+   * @param lines Number of lines in the image.
+   * @param samples Number of samples in the image.
+   * @param result Receives the summary; its histogram configuration is used for the blocks
+   *               and anything it already holds is kept.
+   * @param threads Number of threads to use.
+   * @param blockLines Number of lines summarized per block.
+   *
+   * @throws std::invalid_argument If a dimension, the thread count or the block size is not
+   *                               positive.
+   */
+  void summarize(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples,
+                 statistics::StreamingStatistics &result, int threads, int blockLines) {
+    if (threads <= 0) {
+      throw std::invalid_argument("Backplane dimensions, threads and block size must be positive");
+    }
+    execution::ThreadPool pool(threads, execution::NoPinning);
+    summarize(sensor, quantity, lines, samples, result, pool, blockLines);
+  }
+
+
+  /**
+   * Summarizes a full-resolution backplane without storing it.
+   *
+   * The image is split into blocks of blockLines lines, which the pool summarizes one row at
+   * a time into a partial summary per block. Partial summaries are merged into result
+   * strictly in block order, so the summary is bit-for-bit the same for any number of threads.
+   * Memory use is one row per running block plus the partial summaries of blocks finished
+   * ahead of the next one to merge.
+   *
+   * With more than one thread the Sensor (and its SensorModel) is called concurrently, so the
+   * model must be safe to share between threads.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to summarize.
+   * @param lines Number of lines in the image.
+   * @param samples Number of samples in the image.
+   * @param result Receives the summary; its histogram configuration is used for the blocks
+   *               and anything it already holds is kept.
+   * @param pool The threads to use.
+   * @param blockLines Number of lines summarized per block.
+   *
+   * @throws std::invalid_argument If a dimension or the block size is not positive.
+   */
+  void summarize(Sensor &sensor, Quantity quantity, int64_t lines, int64_t samples,
+                 statistics::StreamingStatistics &result, execution::ThreadPool &pool,
+                 int blockLines) {
+    if (lines <= 0 || samples <= 0 || blockLines <= 0) {
+      throw std::invalid_argument("Backplane dimensions, threads and block size must be positive");
+    }
+    const int64_t blocks = (lines + blockLines - 1) / blockLines;
+    std::mutex mergeMutex;
+    std::map<int64_t, statistics::StreamingStatistics> finished;
+    int64_t nextMerge = 0;
+
+    pool.parallelFor(blocks, [&](int64_t block) {
+      std::vector<double> row(samples);
+      statistics::StreamingStatistics partial(result.histogramMinimum(),
+                                              result.histogramMaximum(), result.bins());
+      int64_t end = std::min(lines, (block + 1) * blockLines);
+      for (int64_t line = block * blockLines; line < end; line++) {
+        evaluate(sensor, quantity, 0, line, 0, 1, int(samples), row.data(), &partial);
+      }
+
+      std::lock_guard<std::mutex> lock(mergeMutex);
+      finished.insert(std::make_pair(block, partial));
+      while (!finished.empty() && finished.begin()->first == nextMerge) {
+        result.merge(finished.begin()->second);
+        finished.erase(finished.begin());
+        nextMerge++;
+      }
+    });
+  }
+}
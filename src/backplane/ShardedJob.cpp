@@ -0,0 +1,517 @@
+#include "ShardedJob.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Backplane.h"
+#include "Encoding.h"
+#include "FramingSensorModel.h"
+#include "sensorcore.h"
+#include "Sensor.h"
+
+namespace backplane {
+
+  namespace {
+
+    const char SHARD_MAGIC[8] = {'S', 'U', 'S', 'H', 'A', 'R', 'D', '1'};
+
+
+    // Fixed-size header at the start of every shard file.
+    struct ShardHeader {
+      char magic[8];
+      uint64_t fingerprint;   // Hash of the job text, so shards of another job are rejected.
+      int64_t firstTile;
+      int64_t tileCount;
+      uint64_t payloadBytes;  // Bytes of tile values following the header.
+    };
+
+
+    // Pixel rectangle of a tile.
+    struct TileBounds {
+      int64_t firstLine;
+      int64_t firstSample;
+      int64_t lines;
+      int64_t samples;
+    };
+
+
+    const char *QUANTITY_NAMES[] = {"phase", "emission", "incidence", "resolution"};
+    const char *ENCODING_NAMES[] = {"float64", "angle16", "half", "log16"};
+
+
+    std::string trim(const std::string &text) {
+      size_t first = text.find_first_not_of(" \t\r");
+      if (first == std::string::npos) {
+        return std::string();
+      }
+      size_t last = text.find_last_not_of(" \t\r");
+      return text.substr(first, last - first + 1);
+    }
+
+
+    // Parses exactly count whitespace-separated numbers.
+    void parseNumbers(const std::string &key, const std::string &value, double *numbers,
+                      int count) {
+      std::istringstream stream(value);
+      for (int i = 0; i < count; i++) {
+        if (!(stream >> numbers[i])) {
+          throw std::invalid_argument("Job key " + key + " needs " + std::to_string(count)
+                                      + " number(s)");
+        }
+      }
+      std::string rest;
+      if (stream >> rest) {
+        throw std::invalid_argument("Job key " + key + " has extra values");
+      }
+    }
+
+
+    // Parses a whole number in [minimum, maximum]. Fractions and exponents are rejected
+    // rather than truncated, so every machine reads a job file the same way.
+    int64_t parseInteger(const std::string &key, const std::string &value, int64_t minimum,
+                         int64_t maximum) {
+      const char *text = value.c_str();
+      char *end;
+      errno = 0;
+      long long number = std::strtoll(text, &end, 10);
+      if (end == text || *end != '\0') {
+        throw std::invalid_argument("Job key " + key + " needs a whole number");
+      }
+      if (errno == ERANGE || number < minimum || number > maximum) {
+        throw std::invalid_argument("Job key " + key + " is out of range");
+      }
+      return int64_t(number);
+    }
+
+
+    int findName(const std::string &key, const std::string &value, const char **names,
+                 int count) {
+      for (int i = 0; i < count; i++) {
+        if (value == names[i]) {
+          return i;
+        }
+      }
+      throw std::invalid_argument("Job key " + key + " has unknown value " + value);
+    }
+
+
+    // 64-bit FNV-1a.
+    uint64_t fingerprint(const JobDescription &job) {
+      std::ostringstream text;
+      writeJob(job, text);
+      uint64_t hash = 0xcbf29ce484222325ULL;
+      std::string bytes = text.str();
+      for (size_t i = 0; i < bytes.size(); i++) {
+        hash = (hash ^ uint64_t(static_cast<unsigned char>(bytes[i]))) * 0x100000001b3ULL;
+      }
+      return hash;
+    }
+
+
+    int64_t tilesAcross(const JobDescription &job) {
+      return (job.samples + job.tileSize - 1) / job.tileSize;
+    }
+
+
+    TileBounds tileBounds(const JobDescription &job, int64_t tile) {
+      TileBounds bounds;
+      bounds.firstLine = tile / tilesAcross(job) * job.tileSize;
+      bounds.firstSample = tile % tilesAcross(job) * job.tileSize;
+      bounds.lines = std::min<int64_t>(job.tileSize, job.lines - bounds.firstLine);
+      bounds.samples = std::min<int64_t>(job.tileSize, job.samples - bounds.firstSample);
+      return bounds;
+    }
+
+
+    ShardHeader expectedHeader(const JobDescription &job, int shard) {
+      ShardRange range = shardRange(job, shard);
+      ShardHeader header;
+      std::memcpy(header.magic, SHARD_MAGIC, sizeof(SHARD_MAGIC));
+      header.fingerprint = fingerprint(job);
+      header.firstTile = range.firstTile;
+      header.tileCount = range.tileCount;
+      header.payloadBytes = 0;
+      for (int64_t tile = range.firstTile; tile < range.firstTile + range.tileCount; tile++) {
+        TileBounds bounds = tileBounds(job, tile);
+        header.payloadBytes += uint64_t(bounds.lines * bounds.samples)
+                               * bytesPerValue(job.format.encoding);
+      }
+      return header;
+    }
+
+
+    void validate(const JobDescription &job) {
+      if (job.lines <= 0 || job.samples <= 0 || job.tileSize <= 0 || job.shards <= 0
+          || job.output.empty()) {
+        throw std::invalid_argument("Job needs positive dimensions, tile size and shard count, "
+                                    "and an output path");
+      }
+      checkEncodingRange(job.format.encoding, job.format.minimum, job.format.maximum);
+    }
+
+
+    // Writes a file through a temporary name and renames it into place, so a file with the
+    // final name is always complete.
+    void commit(const std::string &temporary, const std::string &path) {
+      if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot rename " + temporary + " to " + path);
+      }
+    }
+  }
+
+
+  /**
+   * Creates a job with a 256 pixel tile size, a single shard, Float64 values and no output.
+   */
+  JobDescription::JobDescription()
+      : quantity(Phase), lines(0), samples(0), tileSize(256), shards(1), omega(0.0), phi(0.0),
+        kappa(0.0), focalLength(0.0), pixelPitch(0.0), summing(1.0) {
+  }
+
+
+  /**
+   * Reads a job description.
+   *
+   * @param input The job text.
+   *
+   * @return JobDescription Returns the job.
+   *
+   * @throws std::invalid_argument If a line is malformed, a key is unknown or the job is
+   *                               incomplete.
+   */
+  JobDescription readJob(std::istream &input) {
+    JobDescription job;
+    std::string line;
+    while (std::getline(input, line)) {
+      line = trim(line.substr(0, line.find('#')));
+      if (line.empty()) {
+        continue;
+      }
+      size_t equals = line.find('=');
+      if (equals == std::string::npos) {
+        throw std::invalid_argument("Job line is not 'key = value': " + line);
+      }
+      std::string key = trim(line.substr(0, equals));
+      std::string value = trim(line.substr(equals + 1));
+      double numbers[3];
+
+      if (key == "quantity") {
+        job.quantity = Quantity(findName(key, value, QUANTITY_NAMES, 4));
+      }
+      else if (key == "encoding") {
+        job.format.encoding = Encoding(findName(key, value, ENCODING_NAMES, 4));
+      }
+      else if (key == "output") {
+        job.output = value;
+      }
+      else if (key == "camera_position" || key == "camera_angles" || key == "body_radii"
+               || key == "illuminator_position") {
+        parseNumbers(key, value, numbers, 3);
+        if (key == "camera_position") {
+          job.cameraPosition = CartesianPoint(numbers[0], numbers[1], numbers[2]);
+        }
+        else if (key == "camera_angles") {
+          job.omega = numbers[0];
+          job.phi = numbers[1];
+          job.kappa = numbers[2];
+        }
+        else if (key == "body_radii") {
+          job.bodyRadii = CartesianPoint(numbers[0], numbers[1], numbers[2]);
+        }
+        else {
+          job.illuminatorPosition = CartesianPoint(numbers[0], numbers[1], numbers[2]);
+        }
+      }
+      else if (key == "lines") {
+        job.lines = parseInteger(key, value, INT64_MIN, INT64_MAX);
+      }
+      else if (key == "samples") {
+        job.samples = parseInteger(key, value, INT64_MIN, INT64_MAX);
+      }
+      else if (key == "tile_size") {
+        job.tileSize = int(parseInteger(key, value, INT_MIN, INT_MAX));
+      }
+      else if (key == "shards") {
+        job.shards = int(parseInteger(key, value, INT_MIN, INT_MAX));
+      }
+      else {
+        parseNumbers(key, value, numbers, 1);
+        if (key == "encoding_minimum") {
+          job.format.minimum = numbers[0];
+        }
+        else if (key == "encoding_maximum") {
+          job.format.maximum = numbers[0];
+        }
+        else if (key == "focal_length") {
+          job.focalLength = numbers[0];
+        }
+        else if (key == "pixel_pitch") {
+          job.pixelPitch = numbers[0];
+        }
+        else if (key == "summing") {
+          job.summing = numbers[0];
+        }
+        else {
+          throw std::invalid_argument("Unknown job key " + key);
+        }
+      }
+    }
+    validate(job);
+    return job;
+  }
+
+
+  /**
+   * @param path Path of a job file.
+   *
+   * @return JobDescription Returns the job read from the file.
+   *
+   * @throws std::runtime_error If the file cannot be opened.
+   */
+  JobDescription readJob(const std::string &path) {
+    std::ifstream input(path.c_str());
+    if (!input) {
+      throw std::runtime_error("Cannot open job file " + path);
+    }
+    return readJob(input);
+  }
+
+
+  /**
+   * Writes a job description. Numbers are written with enough digits to read back exactly.
+   *
+   * @param job The job.
+   * @param output Receives the job text.
+   */
+  void writeJob(const JobDescription &job, std::ostream &output) {
+    std::ios::fmtflags flags = output.flags();
+    std::streamsize precision = output.precision(17);
+    output << "quantity = " << QUANTITY_NAMES[job.quantity] << "\n"
+           << "lines = " << job.lines << "\n"
+           << "samples = " << job.samples << "\n"
+           << "tile_size = " << job.tileSize << "\n"
+           << "shards = " << job.shards << "\n"
+           << "encoding = " << ENCODING_NAMES[int(job.format.encoding)] << "\n"
+           << "encoding_minimum = " << job.format.minimum << "\n"
+           << "encoding_maximum = " << job.format.maximum << "\n"
+           << "output = " << job.output << "\n"
+           << "camera_position = " << job.cameraPosition.x << " " << job.cameraPosition.y << " "
+           << job.cameraPosition.z << "\n"
+           << "camera_angles = " << job.omega << " " << job.phi << " " << job.kappa << "\n"
+           << "focal_length = " << job.focalLength << "\n"
+           << "pixel_pitch = " << job.pixelPitch << "\n"
+           << "summing = " << job.summing << "\n"
+           << "body_radii = " << job.bodyRadii.x << " " << job.bodyRadii.y << " "
+           << job.bodyRadii.z << "\n"
+           << "illuminator_position = " << job.illuminatorPosition.x << " "
+           << job.illuminatorPosition.y << " " << job.illuminatorPosition.z << "\n";
+    output.precision(precision);
+    output.flags(flags);
+  }
+
+
+  /**
+   * @param job The job.
+   * @param path Path of the job file to write.
+   *
+   * @throws std::runtime_error If the file cannot be written.
+   */
+  void writeJob(const JobDescription &job, const std::string &path) {
+    std::ofstream output(path.c_str());
+    writeJob(job, output);
+    if (!output) {
+      throw std::runtime_error("Cannot write job file " + path);
+    }
+  }
+
+
+  /**
+   * @return int64_t Returns the number of tiles covering the image.
+   */
+  int64_t tileCount(const JobDescription &job) {
+    return (job.lines + job.tileSize - 1) / job.tileSize * tilesAcross(job);
+  }
+
+
+  /**
+   * Splits the tiles evenly over the shards: shard s gets tiles [s T / S, (s + 1) T / S) of
+   * the T tiles in row-major order.
+   *
+   * @param job The job.
+   * @param shard A shard, from 0 to job.shards - 1.
+   *
+   * @return ShardRange Returns the tiles computed by the shard.
+   *
+   * @throws std::out_of_range If the shard does not exist.
+   */
+  ShardRange shardRange(const JobDescription &job, int shard) {
+    if (shard < 0 || shard >= job.shards) {
+      throw std::out_of_range("Shard " + std::to_string(shard) + " is not part of the job");
+    }
+    int64_t tiles = tileCount(job);
+    ShardRange range;
+    range.firstTile = tiles * shard / job.shards;
+    range.tileCount = tiles * (shard + 1) / job.shards - range.firstTile;
+    return range;
+  }
+
+
+  /**
+   * @return std::string Returns the path of a shard file: the output path followed by
+   *                     ".shard-" and the shard number.
+   */
+  std::string shardPath(const JobDescription &job, int shard) {
+    std::ostringstream path;
+    path << job.output << ".shard-" << std::setw(5) << std::setfill('0') << shard;
+    return path.str();
+  }
+
+
+  /**
+   * @param job The job.
+   * @param shard A shard.
+   *
+   * @return bool Returns true if the shard file exists, belongs to this job and has all its
+   *              values.
+   */
+  bool shardComplete(const JobDescription &job, int shard) {
+    ShardHeader expected = expectedHeader(job, shard);
+    std::ifstream input(shardPath(job, shard).c_str(), std::ios::binary | std::ios::ate);
+    if (!input) {
+      return false;
+    }
+    if (uint64_t(input.tellg()) != sizeof(ShardHeader) + expected.payloadBytes) {
+      return false;
+    }
+    ShardHeader header;
+    input.seekg(0);
+    input.read(reinterpret_cast<char *>(&header), sizeof(header));
+    return input && std::memcmp(&header, &expected, sizeof(header)) == 0;
+  }
+
+
+  /**
+   * Computes a shard with the frame camera described by the job.
+   *
+   * @param job The job.
+   * @param shard The shard to compute.
+   *
+   * @return bool Returns true if the shard was computed, false if it was already complete.
+   */
+  bool runShard(const JobDescription &job, int shard) {
+    FramingSensorModel model(job.cameraPosition, job.omega, job.phi, job.kappa,
+                             job.focalLength, job.pixelPitch, double(job.lines),
+                             double(job.samples), job.bodyRadii);
+    Sensor sensor(&model, job.illuminatorPosition);
+    sensor.setDetector(job.focalLength, job.pixelPitch, job.summing);
+    return runShard(job, shard, sensor);
+  }
+
+
+  /**
+   * Computes a shard and writes its file. The file is written under a temporary name and
+   * renamed when complete, so an interrupted shard is simply run again; a shard whose file
+   * is already complete is skipped. Only one process may run a given shard at a time.
+   *
+   * @param job The job.
+   * @param shard The shard to compute.
+   * @param sensor The sensor used to compute the quantity.
+   *
+   * @return bool Returns true if the shard was computed, false if it was already complete.
+   *
+   * @throws std::runtime_error If the shard file cannot be written.
+   */
+  bool runShard(const JobDescription &job, int shard, Sensor &sensor) {
+    validate(job);
+    if (shardComplete(job, shard)) {
+      return false;
+    }
+    ShardHeader header = expectedHeader(job, shard);
+    std::string path = shardPath(job, shard);
+    std::string temporary = path + ".partial";
+    std::ofstream output(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    size_t valueBytes = bytesPerValue(job.format.encoding);
+    std::vector<char> values(size_t(job.tileSize) * job.tileSize * valueBytes);
+    for (int64_t tile = header.firstTile; tile < header.firstTile + header.tileCount; tile++) {
+      TileBounds bounds = tileBounds(job, tile);
+      evaluate(sensor, job.quantity, 0, bounds.firstLine, bounds.firstSample, int(bounds.lines),
+               int(bounds.samples), EncodedBuffer(job.format, values.data()));
+      output.write(values.data(), std::streamsize(bounds.lines * bounds.samples * valueBytes));
+    }
+    output.close();
+    if (!output) {
+      throw std::runtime_error("Cannot write shard file " + temporary);
+    }
+    commit(temporary, path);
+    return true;
+  }
+
+
+  /**
+   * Assembles the shard files into the product. Shards are read in order, one full-width
+   * strip of tiles at a time, so the product is written sequentially and only one strip is
+   * held in memory.
+   *
+   * @param job The job.
+   *
+   * @throws std::runtime_error If a shard is missing or incomplete, or the product cannot be
+   *                            written.
+   */
+  void mergeShards(const JobDescription &job) {
+    validate(job);
+    for (int shard = 0; shard < job.shards; shard++) {
+      if (!shardComplete(job, shard)) {
+        throw std::runtime_error("Shard file " + shardPath(job, shard)
+                                 + " is missing or incomplete");
+      }
+    }
+
+    std::string temporary = job.output + ".partial";
+    std::ofstream output(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    size_t valueBytes = bytesPerValue(job.format.encoding);
+    size_t rowBytes = size_t(job.samples) * valueBytes;
+    std::vector<char> strip(size_t(job.tileSize) * rowBytes);
+    std::vector<char> values(size_t(job.tileSize) * job.tileSize * valueBytes);
+    int64_t across = tilesAcross(job);
+
+    for (int shard = 0; shard < job.shards; shard++) {
+      std::ifstream input(shardPath(job, shard).c_str(), std::ios::binary);
+      ShardHeader header;
+      input.read(reinterpret_cast<char *>(&header), sizeof(header));
+      for (int64_t tile = header.firstTile; tile < header.firstTile + header.tileCount;
+           tile++) {
+        TileBounds bounds = tileBounds(job, tile);
+        size_t tileRowBytes = size_t(bounds.samples) * valueBytes;
+        input.read(values.data(), std::streamsize(bounds.lines * tileRowBytes));
+        for (int64_t line = 0; line < bounds.lines; line++) {
+          std::memcpy(&strip[line * rowBytes + bounds.firstSample * valueBytes],
+                      &values[line * tileRowBytes], tileRowBytes);
+        }
+        if (tile % across == across - 1) {
+          output.write(strip.data(), std::streamsize(bounds.lines * rowBytes));
+        }
+      }
+      if (!input) {
+        throw std::runtime_error("Cannot read shard file " + shardPath(job, shard));
+      }
+    }
+    output.close();
+    if (!output) {
+      throw std::runtime_error("Cannot write product " + temporary);
+    }
+    commit(temporary, job.output);
+  }
+}
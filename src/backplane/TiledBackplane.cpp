@@ -0,0 +1,413 @@
+#include "TiledBackplane.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "Backplane.h"
+#include "Sensor.h"
+#include "ThreadPool.h"
+
+namespace backplane {
+
+  /**
+   * Creates a lazily evaluated backplane over an image. Nothing is computed until a tile is
+   * requested.
+   *
+   * @param sensor The sensor used to compute tiles. It must outlive the backplane.
+   * @param lines Number of lines in the full-resolution image.
+   * @param samples Number of samples in the full-resolution image.
+   * @param tileSize Edge length, in pixels, of the square tiles.
+   * @param cacheBytes Memory budget for cached tile values.
+   * @param prefetch Whether to compute neighboring tiles on the library-wide thread pool.
+   *
+   * @throws std::invalid_argument If the image or tile dimensions are not positive.
+   */
+  TiledBackplane::TiledBackplane(Sensor &sensor, int64_t lines, int64_t samples, int tileSize,
+                                 size_t cacheBytes, bool prefetch)
+      : m_sensor(sensor), m_lines(lines), m_samples(samples), m_tileSize(tileSize),
+        m_levels(1), m_cacheLimit(cacheBytes), m_cacheBytes(0), m_stopping(false),
+        m_pool(prefetch ? &execution::ThreadPool::shared() : NULL), m_prefetchTasks(0) {
+    initialize();
+  }
+
+
+  /**
+   * Creates a lazily evaluated backplane that computes neighboring tiles on a given pool.
+   *
+   * @param sensor The sensor used to compute tiles. It must outlive the backplane.
+   * @param pool The pool computing neighboring tiles. It must outlive the backplane.
+   * @param lines Number of lines in the full-resolution image.
+   * @param samples Number of samples in the full-resolution image.
+   * @param tileSize Edge length, in pixels, of the square tiles.
+   * @param cacheBytes Memory budget for cached tile values.
+   *
+   * @throws std::invalid_argument If the image or tile dimensions are not positive.
+   */
+  TiledBackplane::TiledBackplane(Sensor &sensor, execution::ThreadPool &pool, int64_t lines,
+                                 int64_t samples, int tileSize, size_t cacheBytes)
+      : m_sensor(sensor), m_lines(lines), m_samples(samples), m_tileSize(tileSize),
+        m_levels(1), m_cacheLimit(cacheBytes), m_cacheBytes(0), m_stopping(false),
+        m_pool(&pool), m_prefetchTasks(0) {
+    initialize();
+  }
+
+
+  /**
+   * Waits for running prefetches to finish. Prefetch tasks that have not started yet do
+   * nothing when they run, so the backplane may be destroyed from a task of its own pool.
+   */
+  TiledBackplane::~TiledBackplane() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+      m_queue.clear();
+    }
+    if (m_prefetchState) {
+      std::unique_lock<std::mutex> lock(m_prefetchState->mutex);
+      m_prefetchState->backplane = NULL;
+      while (m_prefetchState->running > 0) {
+        m_prefetchState->idle.wait(lock);
+      }
+    }
+  }
+
+
+  /**
+   * Sets how tiles of a quantity are stored. A 16-bit encoding (AngleFixed16 for angles, Half
+   * or LogScaled16 for resolution) lets the same memory budget hold four times as many tiles.
+   * Tiles of the quantity computed with the previous encoding are dropped from the cache.
+   *
+   * @param quantity The quantity whose storage to set.
+   * @param format The encoding of the quantity's tiles.
+   *
+   * @throws std::invalid_argument If the encoding is LogScaled16 and the range is invalid.
+   */
+  void TiledBackplane::setEncoding(Quantity quantity, const EncodingFormat &format) {
+    checkEncodingRange(format.encoding, format.minimum, format.maximum);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_formats[quantity] = format;
+    TileList::iterator tile = m_recent.begin();
+    while (tile != m_recent.end()) {
+      if ((*tile)->key.quantity == quantity) {
+        m_cacheBytes -= (*tile)->bytes();
+        m_cache.erase((*tile)->key);
+        tile = m_recent.erase(tile);
+      }
+      else {
+        ++tile;
+      }
+    }
+  }
+
+
+  /**
+   * Returns a tile, computing it if it is not cached. The neighbors of the tile are queued for
+   * background computation, replacing whatever was queued for earlier requests.
+   *
+   * @param key The tile to return.
+   *
+   * @return std::shared_ptr<const Tile> Returns the tile. The tile stays valid for as long as
+   *                                     the caller holds it, even if it is evicted.
+   *
+   * @throws std::out_of_range If the key is outside the backplane.
+   */
+  std::shared_ptr<const Tile> TiledBackplane::tile(const TileKey &key) {
+    if (!contains(key)) {
+      throw std::out_of_range("Tile is outside the backplane");
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::unordered_map<TileKey, TileList::iterator, TileKeyHash>::iterator cached = m_cache.find(key);
+    if (cached != m_cache.end()) {
+      m_statistics.hits++;
+      m_recent.splice(m_recent.begin(), m_recent, cached->second);
+      queueNeighbors(key);
+      return *cached->second;
+    }
+
+    m_statistics.misses++;
+    while (m_inFlight.count(key)) {
+      m_computed.wait(lock);
+    }
+    cached = m_cache.find(key);
+    if (cached != m_cache.end()) {
+      m_recent.splice(m_recent.begin(), m_recent, cached->second);
+      queueNeighbors(key);
+      return *cached->second;
+    }
+
+    // The neighbors are queued only once the requested tile is done, so prefetches never
+    // compete with it for the CPU.
+    m_inFlight.insert(key);
+    lock.unlock();
+    std::shared_ptr<const Tile> result;
+    try {
+      result = compute(key);
+    }
+    catch (...) {
+      lock.lock();
+      m_inFlight.erase(key);
+      m_computed.notify_all();
+      throw;
+    }
+    lock.lock();
+    insert(result);
+    m_inFlight.erase(key);
+    m_computed.notify_all();
+    queueNeighbors(key);
+    return result;
+  }
+
+
+  /**
+   * Returns a tile only if it is already cached. Never computes anything.
+   *
+   * @param key The tile to look up.
+   *
+   * @return std::shared_ptr<const Tile> Returns the tile, or an empty pointer if it is not
+   *                                     cached.
+   */
+  std::shared_ptr<const Tile> TiledBackplane::cachedTile(const TileKey &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unordered_map<TileKey, TileList::iterator, TileKeyHash>::iterator cached = m_cache.find(key);
+    if (cached == m_cache.end()) {
+      return std::shared_ptr<const Tile>();
+    }
+    m_recent.splice(m_recent.begin(), m_recent, cached->second);
+    return *cached->second;
+  }
+
+
+  /**
+   * Queues a tile for background computation. Does nothing if prefetching is disabled or the
+   * tile is outside the backplane, already cached or already being computed.
+   *
+   * @param key The tile to compute ahead of time.
+   */
+  void TiledBackplane::prefetch(const TileKey &key) {
+    if (!m_pool || !contains(key)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_cache.count(key) || m_inFlight.count(key)) {
+      return;
+    }
+    m_queue.push_back(key);
+    startPrefetch();
+  }
+
+
+  /**
+   * Blocks until no prefetch is queued or running. Must not be called from a task of the
+   * prefetching pool, which might then never get to the queued tiles.
+   */
+  void TiledBackplane::waitForPrefetch() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_queue.empty() || !m_inFlight.empty()) {
+      m_computed.wait(lock);
+    }
+  }
+
+
+  int TiledBackplane::levels() const {
+    return m_levels;
+  }
+
+
+  int TiledBackplane::tileSize() const {
+    return m_tileSize;
+  }
+
+
+  /**
+   * @param level Pyramid level.
+   *
+   * @return int64_t Returns the number of lines at a level (rounded up).
+   */
+  int64_t TiledBackplane::lines(int level) const {
+    return (m_lines + (int64_t(1) << level) - 1) >> level;
+  }
+
+
+  /**
+   * @param level Pyramid level.
+   *
+   * @return int64_t Returns the number of samples at a level (rounded up).
+   */
+  int64_t TiledBackplane::samples(int level) const {
+    return (m_samples + (int64_t(1) << level) - 1) >> level;
+  }
+
+
+  int64_t TiledBackplane::tileLines(int level) const {
+    return (lines(level) + m_tileSize - 1) / m_tileSize;
+  }
+
+
+  int64_t TiledBackplane::tileSamples(int level) const {
+    return (samples(level) + m_tileSize - 1) / m_tileSize;
+  }
+
+
+  /**
+   * @return size_t Returns the number of bytes of tile values currently cached.
+   */
+  size_t TiledBackplane::cacheBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cacheBytes;
+  }
+
+
+  TiledBackplane::CacheStatistics TiledBackplane::statistics() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+  }
+
+
+  void TiledBackplane::initialize() {
+    if (m_lines <= 0 || m_samples <= 0 || m_tileSize <= 0) {
+      throw std::invalid_argument("Backplane and tile dimensions must be positive");
+    }
+    while (lines(m_levels - 1) > m_tileSize || samples(m_levels - 1) > m_tileSize) {
+      m_levels++;
+    }
+    if (m_pool) {
+      m_prefetchState = std::make_shared<PrefetchState>();
+      m_prefetchState->backplane = this;
+      m_prefetchState->running = 0;
+    }
+  }
+
+
+  bool TiledBackplane::contains(const TileKey &key) const {
+    return key.level >= 0 && key.level < m_levels
+           && key.line >= 0 && key.line < tileLines(key.level)
+           && key.sample >= 0 && key.sample < tileSamples(key.level);
+  }
+
+
+  std::shared_ptr<const Tile> TiledBackplane::compute(const TileKey &key) {
+    std::shared_ptr<Tile> result = std::make_shared<Tile>(key);
+    result->firstLine = key.line * m_tileSize;
+    result->firstSample = key.sample * m_tileSize;
+    result->lines = int(std::min<int64_t>(m_tileSize, lines(key.level) - result->firstLine));
+    result->samples = int(std::min<int64_t>(m_tileSize, samples(key.level) - result->firstSample));
+    size_t count = size_t(result->lines) * result->samples;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      result->format = m_formats[key.quantity];
+    }
+    bool encoded = result->format.encoding != Encoding::Float64;
+    if (encoded) {
+      result->codes.resize(count);
+    }
+    else {
+      result->values.resize(count);
+    }
+    EncodedBuffer output = encoded ? EncodedBuffer(result->format, result->codes.data())
+                                   : EncodedBuffer(result->values.data());
+
+    evaluate(m_sensor, key.quantity, key.level, result->firstLine, result->firstSample,
+             result->lines, result->samples, output);
+    return result;
+  }
+
+
+  // Adds a tile to the front of the cache and evicts the least recently used tiles until the
+  // cache fits its budget again. The newest tile is never evicted. Called with m_mutex held.
+  void TiledBackplane::insert(const std::shared_ptr<const Tile> &tile) {
+    m_recent.push_front(tile);
+    m_cache[tile->key] = m_recent.begin();
+    m_cacheBytes += tile->bytes();
+
+    while (m_cacheBytes > m_cacheLimit && m_recent.size() > 1) {
+      const std::shared_ptr<const Tile> &oldest = m_recent.back();
+      m_cacheBytes -= oldest->bytes();
+      m_cache.erase(oldest->key);
+      m_recent.pop_back();
+      m_statistics.evictions++;
+    }
+  }
+
+
+  // Replaces the prefetch queue with the neighbors of a tile. Called with m_mutex held.
+  void TiledBackplane::queueNeighbors(const TileKey &key) {
+    if (!m_pool) {
+      return;
+    }
+    m_queue.clear();
+    for (int line = -1; line <= 1; line++) {
+      for (int sample = -1; sample <= 1; sample++) {
+        TileKey neighbor(key.level, key.line + line, key.sample + sample, key.quantity);
+        if ((line || sample) && contains(neighbor) && !m_cache.count(neighbor)
+            && !m_inFlight.count(neighbor)) {
+          m_queue.push_back(neighbor);
+        }
+      }
+    }
+    startPrefetch();
+  }
+
+
+  // Submits drain tasks until there is one per queued tile or per pool thread, whichever is
+  // fewer. Called with m_mutex held.
+  void TiledBackplane::startPrefetch() {
+    std::shared_ptr<PrefetchState> state = m_prefetchState;
+    while (m_prefetchTasks < m_pool->threads() && size_t(m_prefetchTasks) < m_queue.size()) {
+      m_prefetchTasks++;
+      m_pool->submit([state]() {
+        TiledBackplane *backplane;
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          backplane = state->backplane;
+          if (!backplane) {
+            return;
+          }
+          state->running++;
+        }
+        backplane->prefetchTiles();
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->running--;
+        }
+        state->idle.notify_all();
+      });
+    }
+  }
+
+
+  // Computes queued tiles until the queue is empty. Runs as a pool task.
+  void TiledBackplane::prefetchTiles() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping && !m_queue.empty()) {
+      TileKey key = m_queue.front();
+      m_queue.pop_front();
+      if (m_cache.count(key) || m_inFlight.count(key)) {
+        continue;
+      }
+
+      m_inFlight.insert(key);
+      lock.unlock();
+      std::shared_ptr<const Tile> result;
+      try {
+        result = compute(key);
+      }
+      catch (...) {
+        // A failed prefetch is dropped; a later tile() call computes the tile again and
+        // reports the error to its caller.
+      }
+      lock.lock();
+      if (result) {
+        insert(result);
+        m_statistics.prefetched++;
+      }
+      m_inFlight.erase(key);
+      m_computed.notify_all();
+    }
+    m_prefetchTasks--;
+    m_computed.notify_all();
+  }
+}
@@ -0,0 +1,434 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace execution {
+
+  namespace {
+
+    // The pool and node of the calling thread, if it is a pool worker.
+    thread_local const ThreadPool *t_pool = NULL;
+    thread_local int t_node = -1;
+
+
+    // CPUs the process may run on, or an empty list if that is unknown.
+    std::vector<int> allowedCpus() {
+      std::vector<int> cpus;
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+          if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+          }
+        }
+      }
+#endif
+      return cpus;
+    }
+
+
+    // Binds the calling thread to a set of CPUs. Failure (e.g. a CPU outside the process's
+    // cpuset) leaves the thread unpinned.
+    void pin(const std::vector<int> &cpus) {
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (size_t i = 0; i < cpus.size(); i++) {
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) {
+          CPU_SET(cpus[i], &set);
+        }
+      }
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    }
+  }
+
+
+  /**
+   * Parses a Linux CPU list such as "0-3,8,10-11".
+   *
+   * @param cpuList The list.
+   *
+   * @return std::vector<int> Returns the CPU numbers in the order listed.
+   *
+   * @throws std::invalid_argument If the list is malformed.
+   */
+  std::vector<int> parseCpuList(const std::string &cpuList) {
+    std::vector<int> cpus;
+    std::stringstream stream(cpuList);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+      range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+      if (range.empty()) {
+        continue;
+      }
+      char *end = NULL;
+      long first = std::strtol(range.c_str(), &end, 10);
+      long last = first;
+      if (*end == '-') {
+        last = std::strtol(end + 1, &end, 10);
+      }
+      if (*end != '\0' || end == range.c_str() || first < 0 || last < first) {
+        throw std::invalid_argument("Malformed CPU list: " + cpuList);
+      }
+      for (long cpu = first; cpu <= last; cpu++) {
+        cpus.push_back(int(cpu));
+      }
+    }
+    return cpus;
+  }
+
+
+  /**
+   * Reads the NUMA topology from a sysfs node directory: every "node<N>/cpulist" file in it,
+   * in node order. Nodes without CPUs are left out.
+   *
+   * @param nodeDirectory The directory, normally /sys/devices/system/node.
+   *
+   * @return Topology Returns the nodes found, or no nodes if the directory cannot be read.
+   */
+  Topology Topology::read(const std::string &nodeDirectory) {
+    std::vector<std::pair<int, std::string> > entries;
+    if (DIR *directory = opendir(nodeDirectory.c_str())) {
+      while (dirent *entry = readdir(directory)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0
+            && name.find_first_not_of("0123456789", 4) == std::string::npos) {
+          entries.push_back(std::make_pair(std::atoi(name.c_str() + 4), name));
+        }
+      }
+      closedir(directory);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    Topology topology;
+    for (size_t i = 0; i < entries.size(); i++) {
+      std::ifstream file((nodeDirectory + "/" + entries[i].second + "/cpulist").c_str());
+      std::string cpuList;
+      if (std::getline(file, cpuList)) {
+        std::vector<int> cpus = parseCpuList(cpuList);
+        if (!cpus.empty()) {
+          topology.nodes.push_back(cpus);
+        }
+      }
+    }
+    return topology;
+  }
+
+
+  /**
+   * Detects the NUMA topology of this machine, restricted to the CPUs the process may use.
+   * Without NUMA information (or off Linux) the machine is one node.
+   *
+   * @return Topology Returns at least one node with at least one CPU.
+   */
+  Topology Topology::detect() {
+    Topology topology = read("/sys/devices/system/node");
+    std::vector<int> allowed = allowedCpus();
+    if (!allowed.empty()) {
+      Topology usable;
+      for (size_t node = 0; node < topology.nodes.size(); node++) {
+        std::vector<int> cpus;
+        for (size_t i = 0; i < topology.nodes[node].size(); i++) {
+          int cpu = topology.nodes[node][i];
+          if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+            cpus.push_back(cpu);
+          }
+        }
+        if (!cpus.empty()) {
+          usable.nodes.push_back(cpus);
+        }
+      }
+      topology = usable;
+    }
+    if (topology.nodes.empty()) {
+      if (allowed.empty()) {
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+          allowed.push_back(int(cpu));
+        }
+      }
+      topology.nodes.push_back(allowed);
+    }
+    return topology;
+  }
+
+
+  /**
+   * @return int Returns the number of CPUs over all nodes.
+   */
+  int Topology::cpuCount() const {
+    size_t count = 0;
+    for (size_t node = 0; node < nodes.size(); node++) {
+      count += nodes[node].size();
+    }
+    return int(count);
+  }
+
+
+  /**
+   * Starts the worker threads, assigning them to nodes round-robin.
+   *
+   * @param threads Number of threads, or 0 for one per CPU of the topology.
+   * @param pinning How threads are bound to the CPUs of their node.
+   * @param topology The nodes to spread the threads over.
+   *
+   * @throws std::invalid_argument If threads is negative or the topology has no nodes.
+   */
+  ThreadPool::ThreadPool(int threads, Pinning pinning, const Topology &topology)
+      : m_pending(0), m_nextNode(0), m_stopping(false) {
+    if (threads < 0 || topology.nodes.empty()) {
+      throw std::invalid_argument("Thread pool needs a non-negative thread count and at least "
+                                  "one node");
+    }
+    if (threads == 0) {
+      threads = std::max(1, topology.cpuCount());
+    }
+    int nodes = std::min(threads, int(topology.nodes.size()));
+    if (pinning == PinToNode && nodes == 1) {
+      pinning = PinToCpu;
+    }
+
+    std::vector<int> nodeThreads(nodes, 0);
+    for (int thread = 0; thread < threads; thread++) {
+      nodeThreads[thread % nodes]++;
+    }
+    m_threadsBefore.push_back(0);
+    for (int node = 0; node < nodes; node++) {
+      m_queues.push_back(std::unique_ptr<NodeQueue>(new NodeQueue()));
+      m_threadsBefore.push_back(m_threadsBefore.back() + nodeThreads[node]);
+    }
+
+    for (int thread = 0; thread < threads; thread++) {
+      int node = thread % nodes;
+      const std::vector<int> &nodeCpus = topology.nodes[node];
+      std::vector<int> cpus;
+      if (pinning == PinToNode) {
+        cpus = nodeCpus;
+      }
+      else if (pinning == PinToCpu && !nodeCpus.empty()) {
+        cpus.push_back(nodeCpus[(thread / nodes) % nodeCpus.size()]);
+      }
+      m_workers.push_back(std::thread(&ThreadPool::work, this, node, cpus));
+    }
+  }
+
+
+  /**
+   * Runs every queued task, then stops the worker threads.
+   */
+  ThreadPool::~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+      m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_workers.size(); i++) {
+      m_workers[i].join();
+    }
+  }
+
+
+  int ThreadPool::threads() const {
+    return int(m_workers.size());
+  }
+
+
+  /**
+   * @return int Returns the number of nodes the pool threads are spread over.
+   */
+  int ThreadPool::nodes() const {
+    return int(m_queues.size());
+  }
+
+
+  /**
+   * @param index An item of a parallelFor.
+   * @param count The number of items of the parallelFor.
+   *
+   * @return int Returns the node whose queue receives the item.
+   */
+  int ThreadPool::nodeOf(int64_t index, int64_t count) const {
+    int node = nodes() - 1;
+    while (node > 0 && index < blockBegin(m_threadsBefore[node], threads(), count)) {
+      node--;
+    }
+    return node;
+  }
+
+
+  /**
+   * Queues a task. Tasks must not throw.
+   *
+   * @param task The task.
+   * @param node The node whose queue receives the task, or -1 for the calling worker's node
+   *             (round-robin from other threads).
+   */
+  void ThreadPool::submit(const std::function<void()> &task, int node) {
+    if (node < 0 || node >= nodes()) {
+      node = t_pool == this ? t_node : int(m_nextNode++ % unsigned(nodes()));
+    }
+    push(node, task);
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_wake.notify_one();
+  }
+
+
+  /**
+   * Calls body(i) for every i in [0, count) on the pool and waits for all of them. Item i is
+   * queued on node nodeOf(i, count). Called from a pool task, the calling thread runs queued
+   * tasks while it waits, so parallelFor may be nested.
+   *
+   * @param count Number of items.
+   * @param body The work for one item.
+   *
+   * @throws Any exception thrown by body (the first one, after every item has finished).
+   */
+  void ThreadPool::parallelFor(int64_t count, const std::function<void(int64_t index)> &body) {
+    if (count <= 0) {
+      return;
+    }
+    struct State {
+      std::atomic<int64_t> remaining;
+      std::mutex mutex;
+      std::condition_variable done;
+      std::exception_ptr error;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->remaining = count;
+    const std::function<void(int64_t)> *function = &body;
+
+    for (int node = 0; node < nodes(); node++) {
+      for (int64_t index = blockBegin(m_threadsBefore[node], threads(), count);
+           index < blockBegin(m_threadsBefore[node + 1], threads(), count); index++) {
+        push(node, [state, function, index]() {
+          try {
+            (*function)(index);
+          }
+          catch (...) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->error) {
+              state->error = std::current_exception();
+            }
+          }
+          if (--state->remaining == 0) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->done.notify_all();
+          }
+        });
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+      m_wake.notify_all();
+    }
+
+    if (t_pool == this) {
+      while (state->remaining > 0) {
+        if (!runOne(t_node)) {
+          std::this_thread::yield();
+        }
+      }
+    }
+    else {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->done.wait(lock, [&]() { return state->remaining == 0; });
+    }
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+  }
+
+
+  /**
+   * @return ThreadPool Returns the library-wide pool, with one thread per available CPU,
+   *                    created on first use.
+   */
+  ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+
+  /**
+   * @return int Returns the node of the calling pool thread, or -1 if it is not a pool thread.
+   */
+  int ThreadPool::currentNode() {
+    return t_node;
+  }
+
+
+  void ThreadPool::push(int node, const std::function<void()> &task) {
+    NodeQueue &queue = *m_queues[node];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(task);
+    m_pending++;
+  }
+
+
+  // Runs one task: the oldest of the node's own queue, or else the newest of another node's.
+  bool ThreadPool::runOne(int node) {
+    std::function<void()> task;
+    for (int k = 0; k < nodes() && !task; k++) {
+      NodeQueue &queue = *m_queues[(node + k) % nodes()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        if (k == 0) {
+          task = std::move(queue.tasks.front());
+          queue.tasks.pop_front();
+        }
+        else {
+          task = std::move(queue.tasks.back());
+          queue.tasks.pop_back();
+        }
+        m_pending--;
+      }
+    }
+    if (!task) {
+      return false;
+    }
+    task();
+    return true;
+  }
+
+
+  void ThreadPool::work(int node, const std::vector<int> &cpus) {
+    if (!cpus.empty()) {
+      pin(cpus);
+    }
+    t_pool = this;
+    t_node = node;
+    while (true) {
+      if (runOne(node)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_sleepMutex);
+      m_wake.wait(lock, [&]() { return m_stopping || m_pending > 0; });
+      if (m_stopping && m_pending == 0) {
+        return;
+      }
+    }
+  }
+}
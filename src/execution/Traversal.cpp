@@ -0,0 +1,331 @@
+#include "Traversal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "sensorcore.h"
+#include "SensorModel.h"
+
+namespace execution {
+
+  namespace {
+
+    // Spreads the 32 bits of value over the even bits of the result.
+    uint64_t spread(uint32_t value) {
+      uint64_t bits = value;
+      bits = (bits | (bits << 16)) & 0x0000ffff0000ffffULL;
+      bits = (bits | (bits << 8)) & 0x00ff00ff00ff00ffULL;
+      bits = (bits | (bits << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+      bits = (bits | (bits << 2)) & 0x3333333333333333ULL;
+      bits = (bits | (bits << 1)) & 0x5555555555555555ULL;
+      return bits;
+    }
+  }
+
+
+  /**
+   * @param x Column of the cell.
+   * @param y Row of the cell.
+   *
+   * @return uint64_t Returns the Morton (Z-order) index of the cell: the bits of x in the even
+   *                  bits and the bits of y in the odd bits.
+   */
+  uint64_t mortonIndex(uint32_t x, uint32_t y) {
+    return spread(x) | (spread(y) << 1);
+  }
+
+
+  /**
+   * @param bits The grid is 2^bits by 2^bits cells (1 to 32).
+   * @param x Column of the cell, less than 2^bits.
+   * @param y Row of the cell, less than 2^bits.
+   *
+   * @return uint64_t Returns the position of the cell along the Hilbert curve that starts at
+   *                  (0, 0) and ends at (2^bits - 1, 0).
+   */
+  uint64_t hilbertIndex(int bits, uint32_t x, uint32_t y) {
+    uint64_t index = 0;
+    uint64_t cx = x, cy = y;
+    for (uint64_t s = uint64_t(1) << (bits - 1); s > 0; s >>= 1) {
+      uint64_t rx = (cx & s) ? 1 : 0;
+      uint64_t ry = (cy & s) ? 1 : 0;
+      index += s * s * ((3 * rx) ^ ry);
+      // Rotate the quadrant so the curve inside it has the base orientation.
+      if (ry == 0) {
+        if (rx == 1) {
+          cx = s - 1 - (cx & (s - 1));
+          cy = s - 1 - (cy & (s - 1));
+        }
+        std::swap(cx, cy);
+      }
+    }
+    return index;
+  }
+
+
+  /**
+   * @param curve The order of the cells.
+   * @param bits The grid is 2^bits by 2^bits cells (used by Hilbert only).
+   * @param x Column of the cell.
+   * @param y Row of the cell.
+   *
+   * @return uint64_t Returns the position of the cell along the curve.
+   */
+  uint64_t curveIndex(Curve curve, int bits, uint32_t x, uint32_t y) {
+    switch (curve) {
+      case Morton:
+        return mortonIndex(x, y);
+      case Hilbert:
+        return hilbertIndex(bits, x, y);
+      default:
+        return (uint64_t(y) << 32) | x;
+    }
+  }
+
+
+  /**
+   * @param cells Number of cells along the longer side of a grid.
+   *
+   * @return int Returns the smallest bits (at least 1) with 2^bits >= cells.
+   */
+  int curveBits(int64_t cells) {
+    int bits = 1;
+    while (bits < 32 && (int64_t(1) << bits) < cells) {
+      bits++;
+    }
+    return bits;
+  }
+
+
+  /**
+   * Ground tiles of tileDegrees by tileDegrees of planetocentric longitude and latitude, for
+   * bodies without a DEM.
+   *
+   * @param tileDegrees Size of a tile (degrees).
+   * @param curve The order in which tiles are visited.
+   *
+   * @return GroundTileKey Returns the key function; points with NaN coordinates give -1.
+   *
+   * @throws std::invalid_argument If tileDegrees is not positive.
+   */
+  GroundTileKey planetocentricTiles(double tileDegrees, Curve curve) {
+    if (!(tileDegrees > 0.0)) {
+      throw std::invalid_argument("Ground tiles must have a positive size");
+    }
+    int64_t columns = int64_t(std::ceil(360.0 / tileDegrees));
+    int bits = curveBits(columns);
+    return [=](const CartesianPoint &point) -> int64_t {
+      double radius = std::sqrt(point.x * point.x + point.y * point.y + point.z * point.z);
+      if (!(radius > 0.0)) {
+        return -1;
+      }
+      double longitude = std::atan2(point.y, point.x) * 180.0 / M_PI;
+      if (longitude < 0.0) {
+        longitude += 360.0;
+      }
+      double latitude = std::asin(point.z / radius) * 180.0 / M_PI + 90.0;
+      int64_t column = std::min(columns - 1, int64_t(longitude / tileDegrees));
+      int64_t row = std::min(columns - 1, int64_t(latitude / tileDegrees));
+      return int64_t(curveIndex(curve, bits, uint32_t(column), uint32_t(row)));
+    };
+  }
+
+
+  /**
+   * Orders the tiles of an image along a curve.
+   *
+   * @param lines Number of image lines.
+   * @param samples Number of image samples.
+   * @param tileSize Size of the square tiles (pixels); edge tiles are clipped to the image.
+   * @param curve The order of the tiles.
+   *
+   * @throws std::invalid_argument If a dimension or the tile size is not positive.
+   */
+  TraversalSchedule::TraversalSchedule(int64_t lines, int64_t samples, int tileSize,
+                                       Curve curve)
+      : m_lines(lines), m_samples(samples), m_tileSize(tileSize) {
+    build(NULL, GroundTileKey(), curve);
+  }
+
+
+  /**
+   * Orders the tiles of an image by the ground tile they are predicted to see, and along a
+   * curve within each ground tile.
+   *
+   * @param model The model of the image, used to predict the ground tiles.
+   * @param lines Number of image lines.
+   * @param samples Number of image samples.
+   * @param tileSize Size of the square tiles (pixels); edge tiles are clipped to the image.
+   * @param groundTile Maps a ground point to its ground tile key.
+   * @param curve The order of the tiles within a ground tile.
+   *
+   * @throws std::invalid_argument If a dimension or the tile size is not positive.
+   */
+  TraversalSchedule::TraversalSchedule(const SensorModel &model, int64_t lines, int64_t samples,
+                                       int tileSize, const GroundTileKey &groundTile,
+                                       Curve curve)
+      : m_lines(lines), m_samples(samples), m_tileSize(tileSize) {
+    build(&model, groundTile, curve);
+  }
+
+
+  int64_t TraversalSchedule::lines() const {
+    return m_lines;
+  }
+
+
+  int64_t TraversalSchedule::samples() const {
+    return m_samples;
+  }
+
+
+  int TraversalSchedule::tileSize() const {
+    return m_tileSize;
+  }
+
+
+  /**
+   * @return size_t Returns the number of tiles.
+   */
+  size_t TraversalSchedule::size() const {
+    return m_tiles.size();
+  }
+
+
+  /**
+   * @param index Position in the schedule, less than size().
+   *
+   * @return const ImageTile& Returns the tile to process at that position.
+   */
+  const ImageTile &TraversalSchedule::operator[](size_t index) const {
+    return m_tiles[index];
+  }
+
+
+  /**
+   * @return size_t Returns the number of distinct ground tiles predicted, 0 if the schedule
+   *                was made without a sensor model.
+   */
+  size_t TraversalSchedule::groundTileCount() const {
+    std::set<int64_t> keys;
+    for (size_t i = 0; i < m_tiles.size(); i++) {
+      if (m_tiles[i].groundTile >= 0) {
+        keys.insert(m_tiles[i].groundTile);
+      }
+    }
+    return keys.size();
+  }
+
+
+  void TraversalSchedule::build(const SensorModel *model, const GroundTileKey &groundTile,
+                                Curve curve) {
+    if (m_lines <= 0 || m_samples <= 0 || m_tileSize <= 0) {
+      throw std::invalid_argument("Image and tile dimensions must be positive");
+    }
+    int64_t rows = (m_lines + m_tileSize - 1) / m_tileSize;
+    int64_t columns = (m_samples + m_tileSize - 1) / m_tileSize;
+    int bits = curveBits(std::max(rows, columns));
+
+    m_tiles.resize(size_t(rows * columns));
+    std::vector<uint64_t> imageKeys(m_tiles.size());
+    for (int64_t row = 0; row < rows; row++) {
+      for (int64_t column = 0; column < columns; column++) {
+        ImageTile &tile = m_tiles[row * columns + column];
+        tile.firstLine = row * m_tileSize;
+        tile.firstSample = column * m_tileSize;
+        tile.lines = int(std::min<int64_t>(m_tileSize, m_lines - tile.firstLine));
+        tile.samples = int(std::min<int64_t>(m_tileSize, m_samples - tile.firstSample));
+        tile.groundTile = -1;
+        imageKeys[row * columns + column] = curveIndex(curve, bits, uint32_t(column),
+                                                       uint32_t(row));
+      }
+    }
+
+    if (model) {
+      // The coarse grid: one point per tile center, then the corners of tiles that missed.
+      std::vector<ImagePoint> centers(m_tiles.size());
+      for (size_t i = 0; i < m_tiles.size(); i++) {
+        const ImageTile &tile = m_tiles[i];
+        centers[i] = ImagePoint(tile.firstSample + 0.5 * tile.samples,
+                                tile.firstLine + 0.5 * tile.lines, 1.0);
+      }
+      std::vector<CartesianPoint> ground(m_tiles.size());
+      model->imageToGround(centers.data(), centers.size(), ground.data());
+      for (size_t i = 0; i < m_tiles.size(); i++) {
+        ImageTile &tile = m_tiles[i];
+        tile.groundTile = std::isnan(ground[i].x) ? -1 : groundTile(ground[i]);
+        for (int corner = 0; corner < 4 && tile.groundTile < 0; corner++) {
+          ImagePoint image(double(tile.firstSample + (corner % 2) * tile.samples),
+                           double(tile.firstLine + (corner / 2) * tile.lines), 1.0);
+          CartesianPoint point = model->imageToGround(image);
+          tile.groundTile = std::isnan(point.x) ? -1 : groundTile(point);
+        }
+      }
+    }
+
+    std::vector<size_t> order(m_tiles.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    const std::vector<ImageTile> &tiles = m_tiles;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      uint64_t groundA = tiles[a].groundTile < 0 ? std::numeric_limits<uint64_t>::max()
+                                                 : uint64_t(tiles[a].groundTile);
+      uint64_t groundB = tiles[b].groundTile < 0 ? std::numeric_limits<uint64_t>::max()
+                                                 : uint64_t(tiles[b].groundTile);
+      return groundA != groundB ? groundA < groundB : imageKeys[a] < imageKeys[b];
+    });
+    std::vector<ImageTile> sorted(m_tiles.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      sorted[i] = m_tiles[order[i]];
+    }
+    m_tiles.swap(sorted);
+  }
+
+
+  /**
+   * Orders arbitrary image points along a curve over cells of cellSize by cellSize pixels, so
+   * a batch of scattered points (e.g. from many clients) can be processed coherently. Points
+   * in the same cell keep their relative order; points with NaN or negative coordinates come
+   * last.
+   *
+   * @param imagePoints The points.
+   * @param count Number of points.
+   * @param cellSize Size of the curve cells (pixels).
+   * @param curve The order of the cells.
+   *
+   * @return std::vector<size_t> Returns the indices of the points in processing order.
+   *
+   * @throws std::invalid_argument If cellSize is not positive.
+   */
+  std::vector<size_t> curveOrder(const ImagePoint *imagePoints, size_t count, double cellSize,
+                                 Curve curve) {
+    if (!(cellSize > 0.0)) {
+      throw std::invalid_argument("Curve cells must have a positive size");
+    }
+    std::vector<std::pair<uint64_t, size_t> > keys(count);
+    const double limit = 4294967295.0;
+    for (size_t i = 0; i < count; i++) {
+      double x = imagePoints[i].sample / cellSize, y = imagePoints[i].line / cellSize;
+      keys[i].second = i;
+      if (!(x >= 0.0 && y >= 0.0 && x <= limit && y <= limit)) {
+        keys[i].first = std::numeric_limits<uint64_t>::max();
+        continue;
+      }
+      keys[i].first = curveIndex(curve, 32, uint32_t(x), uint32_t(y));
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+      order[i] = keys[i].second;
+    }
+    return order;
+  }
+}
@@ -0,0 +1,422 @@
+#include "Scenario.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "FramingSensorModel.h"
+#include "LineScanSensorModel.h"
+#include "sensorcore.h"
+#include "TerrainVisibility.h"
+#include "Traversal.h"
+
+namespace scenario {
+
+  namespace {
+
+    // splitmix64: a tiny generator whose sequence is fixed by the seed alone, unlike the
+    // standard library distributions, which differ between implementations.
+    class Random {
+
+      public:
+        explicit Random(uint64_t seed) : m_state(seed) {
+        }
+
+        // Uniform in [minimum, maximum).
+        double uniform(double minimum, double maximum) {
+          m_state += 0x9e3779b97f4a7c15ULL;
+          uint64_t z = m_state;
+          z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+          z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+          z ^= z >> 31;
+          return minimum + (maximum - minimum) * double(z >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+      private:
+        uint64_t m_state;
+    };
+
+
+    struct Vector {
+      double x, y, z;
+    };
+
+
+    Vector scale(const Vector &v, double s) {
+      Vector result = {v.x * s, v.y * s, v.z * s};
+      return result;
+    }
+
+
+    Vector add(const Vector &a, const Vector &b) {
+      Vector result = {a.x + b.x, a.y + b.y, a.z + b.z};
+      return result;
+    }
+
+
+    double dot(const Vector &a, const Vector &b) {
+      return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+
+    Vector cross(const Vector &a, const Vector &b) {
+      Vector result = {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+      return result;
+    }
+
+
+    Vector normalize(const Vector &v) {
+      return scale(v, 1.0 / std::sqrt(dot(v, v)));
+    }
+
+
+    // result = a * b for row-major 3x3 matrices.
+    void multiply(const double a[9], const double b[9], double result[9]) {
+      for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+          result[3 * row + column] = a[3 * row] * b[column] + a[3 * row + 1] * b[3 + column]
+                                     + a[3 * row + 2] * b[6 + column];
+        }
+      }
+    }
+
+
+    // Passive rotation Rz(kappa) Ry(phi) Rx(omega), row-major, as in FramingSensorModel.
+    void angleRotation(double omega, double phi, double kappa, double result[9]) {
+      double co = std::cos(omega), so = std::sin(omega);
+      double cp = std::cos(phi), sp = std::sin(phi);
+      double ck = std::cos(kappa), sk = std::sin(kappa);
+      result[0] = ck * cp;
+      result[1] = ck * sp * so + sk * co;
+      result[2] = -ck * sp * co + sk * so;
+      result[3] = -sk * cp;
+      result[4] = -sk * sp * so + ck * co;
+      result[5] = sk * sp * co + ck * so;
+      result[6] = sp;
+      result[7] = -cp * so;
+      result[8] = cp * co;
+    }
+
+
+    // The circular orbit and the pointing drawn for a scenario.
+    struct Trajectory {
+      double radius;      // Orbit radius (km).
+      double rate;        // Angular rate (radians/s).
+      double node;        // Longitude of the ascending node (radians).
+      double inclination; // Radians.
+      double latitude;    // Argument of latitude at time 0 (radians).
+      double pointing[3]; // Roll, pitch and yaw off nadir (radians).
+      double jitter[3];   // Jitter amplitude about each camera axis (radians).
+      double jitterFrequency[3];
+      double jitterPhase[3];
+
+      // Position (km) and velocity direction at time t (s).
+      void state(double t, Vector &position, Vector &velocity) const {
+        double u = latitude + rate * t;
+        double cu = std::cos(u), su = std::sin(u);
+        double cn = std::cos(node), sn = std::sin(node);
+        double ci = std::cos(inclination), si = std::sin(inclination);
+        Vector p = {cn * cu - sn * su * ci, sn * cu + cn * su * ci, su * si};
+        Vector v = {-cn * su - sn * cu * ci, -sn * su + cn * cu * ci, cu * si};
+        position = scale(p, radius);
+        velocity = v;
+      }
+
+      // Camera angles (omega, phi, kappa) at time t: nadir pointing with the camera y axis
+      // along track, then the fixed off-nadir pointing and the jitter, about the camera axes.
+      void angles(double t, const Vector &position, const Vector &velocity,
+                  double result[3]) const {
+        Vector z = normalize(scale(position, -1.0));
+        Vector y = normalize(add(velocity, scale(z, -dot(velocity, z))));
+        Vector x = cross(y, z);
+        double nadir[9] = {x.x, x.y, x.z, y.x, y.y, y.z, z.x, z.y, z.z};
+
+        double offset[3];
+        for (int axis = 0; axis < 3; axis++) {
+          offset[axis] = pointing[axis]
+                         + jitter[axis] * std::sin(jitterFrequency[axis] * t + jitterPhase[axis]);
+        }
+        double extra[9], camera[9];
+        angleRotation(offset[0], offset[1], offset[2], extra);
+        multiply(extra, nadir, camera);
+        result[0] = std::atan2(-camera[7], camera[8]);
+        result[1] = std::asin(std::max(-1.0, std::min(1.0, camera[6])));
+        result[2] = std::atan2(-camera[3], camera[0]);
+      }
+    };
+
+
+    // 64-bit FNV-1a of values printed to 9 significant digits, so that last-bit differences
+    // between math libraries do not change it.
+    class Fingerprint {
+
+      public:
+        Fingerprint() : m_hash(0xcbf29ce484222325ULL) {
+        }
+
+        void add(double value) {
+          char text[32];
+          std::snprintf(text, sizeof(text), "%.9g;", value);
+          for (const char *c = text; *c; c++) {
+            m_hash = (m_hash ^ uint64_t(static_cast<unsigned char>(*c))) * 0x100000001b3ULL;
+          }
+        }
+
+        uint64_t value() const {
+          return m_hash;
+        }
+
+      private:
+        uint64_t m_hash;
+    };
+  }
+
+
+  ScenarioOptions::ScenarioOptions()
+      : seed(1), sensor(FrameCamera), lines(1024), samples(1024),
+        radii(3396.19, 3396.19, 3376.20), gravitationalParameter(42828.37), altitude(400.0),
+        focalLength(500.0), pixelPitch(0.00625), maximumOffNadir(0.05), jitter(2.0e-6),
+        sunDistance(2.28e8), elevationCells(256), relief(1.0) {
+  }
+
+
+  Scenario::Scenario()
+      : groundSampleDistance(0.0), fingerprint(0) {
+  }
+
+
+  /**
+   * @param point A body-fixed point (km).
+   *
+   * @return CartesianPoint Returns the point in the local east-north-up frame of the DEM.
+   */
+  CartesianPoint Scenario::toLocal(const CartesianPoint &point) const {
+    CartesianVector offset = toLocalDirection(
+        CartesianVector(point.x - center.x, point.y - center.y, point.z - center.z));
+    return CartesianPoint(offset.x, offset.y, offset.z);
+  }
+
+
+  /**
+   * @param vector A body-fixed vector.
+   *
+   * @return CartesianVector Returns the vector in the local east-north-up frame of the DEM.
+   */
+  CartesianVector Scenario::toLocalDirection(const CartesianVector &vector) const {
+    return CartesianVector(vector.x * east.x + vector.y * east.y + vector.z * east.z,
+                           vector.x * north.x + vector.y * north.y + vector.z * north.z,
+                           vector.x * up.x + vector.y * up.y + vector.z * up.z);
+  }
+
+
+  /**
+   * Square tiles of the DEM, as ground tiles for an execution::TraversalSchedule. The key
+   * function keeps its own copy of the local frame and DEM grid.
+   *
+   * @param tileCells DEM cells per side of a tile.
+   * @param curve The order in which tiles are visited.
+   *
+   * @return execution::GroundTileKey Returns the key function; points off the DEM give -1.
+   *
+   * @throws std::invalid_argument If tileCells is not positive.
+   * @throws std::runtime_error If the scenario has no DEM.
+   */
+  execution::GroundTileKey Scenario::elevationTiles(int tileCells, execution::Curve curve) const {
+    if (tileCells <= 0) {
+      throw std::invalid_argument("DEM tiles must have a positive size");
+    }
+    if (!elevation) {
+      throw std::runtime_error("The scenario has no DEM");
+    }
+    Scenario frame;
+    frame.center = center;
+    frame.east = east;
+    frame.north = north;
+    frame.up = up;
+    double originX = elevation->originX(), originY = elevation->originY();
+    double tileSize = tileCells * elevation->spacing();
+    int64_t columns = (elevation->samples() + tileCells - 1) / tileCells;
+    int64_t rows = (elevation->lines() + tileCells - 1) / tileCells;
+    int bits = execution::curveBits(std::max(rows, columns));
+    return [=](const CartesianPoint &point) -> int64_t {
+      CartesianPoint local = frame.toLocal(point);
+      double column = std::floor((local.x - originX) / tileSize);
+      double row = std::floor((local.y - originY) / tileSize);
+      if (!(column >= 0.0 && row >= 0.0 && column < columns && row < rows)) {
+        return -1;
+      }
+      return int64_t(execution::curveIndex(curve, bits, uint32_t(column), uint32_t(row)));
+    };
+  }
+
+
+  /**
+   * Generates a synthetic scenario: a circular orbit of random inclination and phase, a
+   * camera pointed near nadir with its lines along track, a sun at a random incidence angle
+   * (20 to 70 degrees) and azimuth over the image center, and, if options.elevationCells is
+   * positive, a DEM of sinusoidal terrain of several wavelengths covering the footprint.
+   *
+   * A FrameCamera scenario is exposed at time 0. A LineScanner scenario exposes its lines
+   * along the orbit, centered on time 0, at the rate that makes the along-track and
+   * cross-track nadir pixel sizes equal, with a slow sinusoidal attitude jitter.
+   *
+   * @param options The scenario options.
+   *
+   * @return Scenario Returns the scenario.
+   *
+   * @throws std::invalid_argument If a dimension, radius, distance or the camera is not
+   *                               positive, or the DEM has a single cell per side.
+   * @throws std::runtime_error If the image center misses the body.
+   */
+  Scenario createScenario(const ScenarioOptions &options) {
+    if (options.lines <= 0 || options.samples <= 0 || options.radii.x <= 0.0
+        || options.radii.y <= 0.0 || options.radii.z <= 0.0 || options.altitude <= 0.0
+        || options.gravitationalParameter <= 0.0 || options.focalLength <= 0.0
+        || options.pixelPitch <= 0.0 || options.sunDistance <= 0.0
+        || options.elevationCells < 0 || options.elevationCells == 1) {
+      throw std::invalid_argument("Scenario dimensions, radii, distances and camera must be "
+                                  "positive");
+    }
+    if (options.sensor == LineScanner && options.lines < 2) {
+      throw std::invalid_argument("A line-scan scenario needs two or more lines");
+    }
+
+    Scenario scenario;
+    scenario.options = options;
+    Random random(options.seed);
+
+    // Every draw happens in this order, whatever the options, so that changing e.g. the
+    // sensor type keeps the orbit and the sun.
+    Trajectory trajectory;
+    double meanRadius = (options.radii.x + options.radii.y + options.radii.z) / 3.0;
+    trajectory.radius = meanRadius + options.altitude;
+    trajectory.rate = std::sqrt(options.gravitationalParameter / std::pow(trajectory.radius, 3));
+    trajectory.node = random.uniform(0.0, 2.0 * M_PI);
+    trajectory.inclination = random.uniform(0.0, M_PI);
+    trajectory.latitude = random.uniform(0.0, 2.0 * M_PI);
+    for (int axis = 0; axis < 3; axis++) {
+      trajectory.pointing[axis] = random.uniform(-options.maximumOffNadir, options.maximumOffNadir);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      trajectory.jitter[axis] = options.sensor == LineScanner ? options.jitter : 0.0;
+      trajectory.jitterFrequency[axis] = 2.0 * M_PI * random.uniform(1.0, 5.0);
+      trajectory.jitterPhase[axis] = random.uniform(0.0, 2.0 * M_PI);
+    }
+    double incidence = random.uniform(20.0, 70.0) * M_PI / 180.0;
+    double azimuth = random.uniform(0.0, 2.0 * M_PI);
+
+    scenario.groundSampleDistance = options.altitude * options.pixelPitch / options.focalLength;
+    Fingerprint fingerprint;
+    if (options.sensor == FrameCamera) {
+      Vector position, velocity;
+      trajectory.state(0.0, position, velocity);
+      double angles[3];
+      trajectory.angles(0.0, position, velocity, angles);
+      scenario.model.reset(new FramingSensorModel(
+          CartesianPoint(position.x, position.y, position.z), angles[0], angles[1], angles[2],
+          options.focalLength, options.pixelPitch, double(options.lines),
+          double(options.samples), options.radii));
+      double values[6] = {position.x, position.y, position.z, angles[0], angles[1], angles[2]};
+      for (int i = 0; i < 6; i++) {
+        fingerprint.add(values[i]);
+      }
+    }
+    else {
+      double groundSpeed = trajectory.rate * meanRadius;
+      double lineTime = scenario.groundSampleDistance / groundSpeed;
+      std::vector<CartesianPoint> positions(options.lines);
+      std::vector<double> angles(3 * options.lines);
+      for (int64_t line = 0; line < options.lines; line++) {
+        double t = (double(line) + 0.5 - 0.5 * double(options.lines)) * lineTime;
+        Vector position, velocity;
+        trajectory.state(t, position, velocity);
+        trajectory.angles(t, position, velocity, &angles[3 * line]);
+        positions[line] = CartesianPoint(position.x, position.y, position.z);
+        double values[6] = {position.x, position.y, position.z, angles[3 * line],
+                            angles[3 * line + 1], angles[3 * line + 2]};
+        for (int i = 0; i < 6; i++) {
+          fingerprint.add(values[i]);
+        }
+      }
+      scenario.model.reset(new LineScanSensorModel(positions, angles, lineTime,
+                                                   options.focalLength, options.pixelPitch,
+                                                   double(options.samples), options.radii));
+    }
+
+    scenario.center = scenario.model->imageToGround(
+        ImagePoint(0.5 * double(options.samples), 0.5 * double(options.lines), 1.0));
+    if (std::isnan(scenario.center.x)) {
+      throw std::runtime_error("The scenario image center misses the body");
+    }
+    const CartesianPoint &c = scenario.center;
+    Vector up = normalize(Vector{c.x / (options.radii.x * options.radii.x),
+                                 c.y / (options.radii.y * options.radii.y),
+                                 c.z / (options.radii.z * options.radii.z)});
+    Vector pole = {0.0, 0.0, 1.0};
+    Vector eastward = cross(pole, up);
+    if (dot(eastward, eastward) < 1e-12) {
+      eastward = Vector{0.0, 1.0, 0.0};
+    }
+    Vector east = normalize(eastward);
+    Vector north = cross(up, east);
+    scenario.east = CartesianVector(east.x, east.y, east.z);
+    scenario.north = CartesianVector(north.x, north.y, north.z);
+    scenario.up = CartesianVector(up.x, up.y, up.z);
+
+    Vector horizontal = add(scale(east, std::cos(azimuth)), scale(north, std::sin(azimuth)));
+    Vector sun = add(scale(up, std::cos(incidence)), scale(horizontal, std::sin(incidence)));
+    scenario.illuminatorPosition = CartesianPoint(c.x + options.sunDistance * sun.x,
+                                                  c.y + options.sunDistance * sun.y,
+                                                  c.z + options.sunDistance * sun.z);
+    fingerprint.add(scenario.illuminatorPosition.x);
+    fingerprint.add(scenario.illuminatorPosition.y);
+    fingerprint.add(scenario.illuminatorPosition.z);
+
+    // The DEM spans 1.5 times the larger image dimension, for off-nadir stretch. Its terrain
+    // is a sum of octaves of plane waves whose amplitude falls with the wavelength.
+    if (options.elevationCells > 0) {
+      int64_t cells = options.elevationCells;
+      double extent = 1.5 * double(std::max(options.lines, options.samples))
+                      * scenario.groundSampleDistance;
+      double spacing = extent / double(cells - 1);
+      const int octaves = 6;
+      double waveX[octaves], waveY[octaves], phase[octaves], amplitude[octaves];
+      for (int octave = 0; octave < octaves; octave++) {
+        double wavelength = extent / double(1 << octave);
+        double direction = random.uniform(0.0, 2.0 * M_PI);
+        waveX[octave] = 2.0 * M_PI / wavelength * std::cos(direction);
+        waveY[octave] = 2.0 * M_PI / wavelength * std::sin(direction);
+        phase[octave] = random.uniform(0.0, 2.0 * M_PI);
+        amplitude[octave] = 0.5 * options.relief / double(1 << octave);
+      }
+      std::vector<double> heights(cells * cells);
+      double origin = -0.5 * extent;
+      for (int64_t line = 0; line < cells; line++) {
+        double y = origin + double(line) * spacing;
+        for (int64_t sample = 0; sample < cells; sample++) {
+          double x = origin + double(sample) * spacing;
+          double height = 0.0;
+          for (int octave = 0; octave < octaves; octave++) {
+            height += amplitude[octave]
+                      * std::sin(waveX[octave] * x + waveY[octave] * y + phase[octave]);
+          }
+          heights[line * cells + sample] = height;
+        }
+      }
+      for (int octave = 0; octave < octaves; octave++) {
+        fingerprint.add(waveX[octave]);
+        fingerprint.add(waveY[octave]);
+        fingerprint.add(phase[octave]);
+        fingerprint.add(amplitude[octave]);
+      }
+      scenario.elevation.reset(new shapemodel::ElevationModel(cells, cells, heights, origin,
+                                                              origin, spacing));
+    }
+    scenario.fingerprint = fingerprint.value();
+    return scenario;
+  }
+}
@@ -1,13 +1,103 @@
 #include "Sensor.h"
 
+#include <algorithm>
 #include <cmath>
 #include <string>
 #include <vector>
 
 #include "sensorcore.h"
 #include "SensorMath.h"
+#include "SensorModel.h"
+#include "SensorUtils.h"
+#include "StreamingStatistics.h"
 
-Sensor::Sensor(const std::string &metaData, const std::string &sensorName) {
+namespace {
+
+  // Angle between two vectors; a zero-length vector is treated as orthogonal to everything,
+  // and a vector with NaN or infinite components (e.g. a point off the body) gives NaN.
+  double angleBetween(const CartesianVector &a, const CartesianVector &b) {
+    if (!std::isfinite(a.x) || !std::isfinite(a.y) || !std::isfinite(a.z)
+        || !std::isfinite(b.x) || !std::isfinite(b.y) || !std::isfinite(b.z)) {
+      return NAN;
+    }
+    double lengths = std::sqrt((a.x * a.x + a.y * a.y + a.z * a.z)
+                               * (b.x * b.x + b.y * b.y + b.z * b.z));
+    double cosAngle = 0.0;
+    if (lengths > 0.0) {
+      cosAngle = (a.x * b.x + a.y * b.y + a.z * b.z) / lengths;
+    }
+    if (cosAngle >= 1.0) {
+      return 0.0;
+    }
+    if (cosAngle <= -1.0) {
+      return M_PI;
+    }
+    return std::acos(cosAngle);
+  }
+
+
+  // Emission angle from a ground point and the sensor-to-ground look vector.
+  double emission(const CartesianPoint &ground, const CartesianVector &look) {
+    return angleBetween(CartesianVector(-look.x, -look.y, -look.z), ground);
+  }
+
+
+  // Incidence angle at a ground point lit from an illuminator position.
+  double incidence(const CartesianPoint &ground, const CartesianPoint &illuminator) {
+    CartesianVector toIlluminator(illuminator.x - ground.x, illuminator.y - ground.y,
+                                  illuminator.z - ground.z);
+    return angleBetween(toIlluminator, ground);
+  }
+
+
+  // Phase angle from a ground point, the sensor-to-ground look vector and the illuminator.
+  double phase(const CartesianPoint &ground, const CartesianVector &look,
+               const CartesianPoint &illuminator) {
+    CartesianVector toIlluminator(illuminator.x - ground.x, illuminator.y - ground.y,
+                                  illuminator.z - ground.z);
+    return angleBetween(CartesianVector(-look.x, -look.y, -look.z), toIlluminator);
+  }
+}
+
+
+const size_t Sensor::BATCH_SIZE;
+
+
+Sensor::Sensor(const std::string &metaData, const std::string &sensorName)
+    : m_sensorModel(NULL), m_focalLength(0.0), m_pixelPitch(0.0), m_summing(1.0) {
+}
+
+
+/**
+ * Creates a Sensor that computes photometric angles through a sensor model.
+ *
+ * The look vector returned by SensorModel::groundToLook is taken to point from the sensor to
+ * the ground point, and the surface normal is taken to be the radial direction of the ground
+ * point (spherical body).
+ *
+ * @param sensorModel The model used to intersect image points with the ground. Not owned;
+ *                    it must outlive the Sensor. Only its const methods are called, so one
+ *                    model can be shared by several Sensors and threads.
+ * @param illuminatorPosition The illuminator (usually the sun) in the body-fixed frame.
+ */
+Sensor::Sensor(const SensorModel *sensorModel, const CartesianPoint &illuminatorPosition)
+    : m_sensorModel(sensorModel), m_illuminatorPosition(illuminatorPosition),
+      m_focalLength(0.0), m_pixelPitch(0.0), m_summing(1.0) {
+}
+
+
+/**
+ * Sets the detector parameters used to compute resolution. Until this is called, resolution
+ * is 0.0 everywhere.
+ *
+ * @param focalLength Focal length of the sensor (mm).
+ * @param pixelPitch Size of a pixel on the sensor (mm).
+ * @param summing Summing mode of the sensor.
+ */
+void Sensor::setDetector(double focalLength, double pixelPitch, double summing) {
+  m_focalLength = focalLength;
+  m_pixelPitch = pixelPitch;
+  m_summing = summing;
 }
 
 
@@ -25,23 +115,132 @@ double Sensor::declination(const CartesianVector &vector) {
 }
 
 
+/**
+ * Computes the emission angle (in radians) at a ground point: the angle between the surface
+ * normal and the vector from the ground point to the sensor.
+ *
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return Returns the emission angle in radians, or 0.0 if the Sensor has no sensor model.
+ */
 double Sensor::emissionAngle(const CartesianPoint &groundPoint) {
-  return 0.0;
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  return emission(groundPoint, m_sensorModel->groundToLook(groundPoint));
 }
 
 
+/**
+ * Computes the emission angle (in radians) at the ground point seen by an image point.
+ *
+ * @param imagePoint The image point to intersect with the ground.
+ *
+ * @return Returns the emission angle in radians, or 0.0 if the Sensor has no sensor model.
+ */
 double Sensor::emissionAngle(const ImagePoint &imagePoint) {
-  return 0.0;
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  return emissionAngle(m_sensorModel->imageToGround(imagePoint));
 }
 
 
+/**
+ * Computes the incidence angle (in radians) at a ground point: the angle between the surface
+ * normal and the vector from the ground point to the illuminator.
+ *
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return Returns the incidence angle in radians, or 0.0 if the Sensor has no sensor model.
+ */
+double Sensor::incidenceAngle(const CartesianPoint &groundPoint) {
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  return incidence(groundPoint, m_illuminatorPosition);
+}
+
+
+/**
+ * Computes the incidence angle (in radians) at the ground point seen by an image point.
+ *
+ * @param imagePoint The image point to intersect with the ground.
+ *
+ * @return Returns the incidence angle in radians, or 0.0 if the Sensor has no sensor model.
+ */
+double Sensor::incidenceAngle(const ImagePoint &imagePoint) {
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  return incidenceAngle(m_sensorModel->imageToGround(imagePoint));
+}
+
+
+/**
+ * Computes the phase angle (in radians) at a ground point: the angle between the vectors from
+ * the ground point to the sensor and from the ground point to the illuminator.
+ *
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return Returns the phase angle in radians, or 0.0 if the Sensor has no sensor model.
+ */
 double Sensor::phaseAngle(const CartesianPoint &groundPoint) {
-  return 0.0;
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  return phase(groundPoint, m_sensorModel->groundToLook(groundPoint), m_illuminatorPosition);
 }
 
 
+/**
+ * Computes the phase angle (in radians) at the ground point seen by an image point.
+ *
+ * @param imagePoint The image point to intersect with the ground.
+ *
+ * @return Returns the phase angle in radians, or 0.0 if the Sensor has no sensor model.
+ */
 double Sensor::phaseAngle(const ImagePoint &imagePoint) {
-  return 0.0;
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  return phaseAngle(m_sensorModel->imageToGround(imagePoint));
+}
+
+
+/**
+ * Computes the resolution (in meters/pixel) at a ground point, from the distance between the
+ * sensor and the ground point and the detector parameters. Body-fixed coordinates are taken
+ * to be in kilometers.
+ *
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return Returns the resolution in meters/pixel, or 0.0 if the Sensor has no sensor model or
+ *         no detector parameters.
+ */
+double Sensor::resolution(const CartesianPoint &groundPoint) {
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  CartesianVector look = m_sensorModel->groundToLook(groundPoint);
+  double distance = std::sqrt(look.x * look.x + look.y * look.y + look.z * look.z);
+  return ::resolution(distance, m_focalLength, m_pixelPitch, m_summing);
+}
+
+
+/**
+ * Computes the resolution (in meters/pixel) at the ground point seen by an image point.
+ *
+ * @param imagePoint The image point to intersect with the ground.
+ *
+ * @return Returns the resolution in meters/pixel, or 0.0 if the Sensor has no sensor model or
+ *         no detector parameters.
+ */
+double Sensor::resolution(const ImagePoint &imagePoint) {
+  if (!m_sensorModel) {
+    return 0.0;
+  }
+  return resolution(m_sensorModel->imageToGround(imagePoint));
 }
 
 
@@ -60,3 +259,133 @@ double Sensor::rightAscension(const CartesianVector &vector) {
   }
   return radiusRaDec[2];
 }
+
+
+
+/**
+ * Computes the emission angle for each of several image points. Points are intersected with
+ * the ground through the sensor model's batch methods, BATCH_SIZE points at a time.
+ *
+ * @param imagePoints The image points to intersect with the ground.
+ * @param count Number of image points.
+ * @param angles Receives count emission angles in radians, stored in the buffer's encoding.
+ * @param statistics If not NULL, every unquantized angle is also added to it.
+ */
+void Sensor::emissionAngles(const ImagePoint *imagePoints, size_t count,
+                            const EncodedBuffer &angles,
+                            statistics::StreamingStatistics *statistics) {
+  CartesianPoint ground[BATCH_SIZE];
+  CartesianVector look[BATCH_SIZE];
+  for (size_t first = 0; first < count; first += BATCH_SIZE) {
+    size_t points = std::min(BATCH_SIZE, count - first);
+    bool modeled = intersect(imagePoints + first, points, ground, look);
+    for (size_t i = 0; i < points; i++) {
+      double value = modeled ? emission(ground[i], look[i]) : 0.0;
+      angles.store(first + i, value);
+      if (statistics) {
+        statistics->add(value);
+      }
+    }
+  }
+}
+
+
+/**
+ * Computes the incidence angle for each of several image points.
+ *
+ * @param imagePoints The image points to intersect with the ground.
+ * @param count Number of image points.
+ * @param angles Receives count incidence angles in radians, stored in the buffer's encoding.
+ * @param statistics If not NULL, every unquantized angle is also added to it.
+ */
+void Sensor::incidenceAngles(const ImagePoint *imagePoints, size_t count,
+                             const EncodedBuffer &angles,
+                             statistics::StreamingStatistics *statistics) {
+  CartesianPoint ground[BATCH_SIZE];
+  for (size_t first = 0; first < count; first += BATCH_SIZE) {
+    size_t points = std::min(BATCH_SIZE, count - first);
+    bool modeled = intersect(imagePoints + first, points, ground, NULL);
+    for (size_t i = 0; i < points; i++) {
+      double value = modeled ? incidence(ground[i], m_illuminatorPosition) : 0.0;
+      angles.store(first + i, value);
+      if (statistics) {
+        statistics->add(value);
+      }
+    }
+  }
+}
+
+
+/**
+ * Computes the phase angle for each of several image points.
+ *
+ * @param imagePoints The image points to intersect with the ground.
+ * @param count Number of image points.
+ * @param angles Receives count phase angles in radians, stored in the buffer's encoding.
+ * @param statistics If not NULL, every unquantized angle is also added to it.
+ */
+void Sensor::phaseAngles(const ImagePoint *imagePoints, size_t count,
+                         const EncodedBuffer &angles,
+                         statistics::StreamingStatistics *statistics) {
+  CartesianPoint ground[BATCH_SIZE];
+  CartesianVector look[BATCH_SIZE];
+  for (size_t first = 0; first < count; first += BATCH_SIZE) {
+    size_t points = std::min(BATCH_SIZE, count - first);
+    bool modeled = intersect(imagePoints + first, points, ground, look);
+    for (size_t i = 0; i < points; i++) {
+      double value = modeled ? phase(ground[i], look[i], m_illuminatorPosition) : 0.0;
+      angles.store(first + i, value);
+      if (statistics) {
+        statistics->add(value);
+      }
+    }
+  }
+}
+
+
+/**
+ * Computes the resolution for each of several image points.
+ *
+ * @param imagePoints The image points to intersect with the ground.
+ * @param count Number of image points.
+ * @param resolutions Receives count resolutions in meters/pixel, stored in the buffer's
+ *                    encoding (Half or LogScaled16 are the compact choices).
+ * @param statistics If not NULL, every unquantized resolution is also added to it.
+ */
+void Sensor::resolutions(const ImagePoint *imagePoints, size_t count,
+                         const EncodedBuffer &resolutions,
+                         statistics::StreamingStatistics *statistics) {
+  CartesianPoint ground[BATCH_SIZE];
+  CartesianVector look[BATCH_SIZE];
+  for (size_t first = 0; first < count; first += BATCH_SIZE) {
+    size_t points = std::min(BATCH_SIZE, count - first);
+    bool modeled = intersect(imagePoints + first, points, ground, look);
+    for (size_t i = 0; i < points; i++) {
+      double value = 0.0;
+      if (modeled) {
+        double distance = std::sqrt(look[i].x * look[i].x + look[i].y * look[i].y
+                                    + look[i].z * look[i].z);
+        value = ::resolution(distance, m_focalLength, m_pixelPitch, m_summing);
+      }
+      resolutions.store(first + i, value);
+      if (statistics) {
+        statistics->add(value);
+      }
+    }
+  }
+}
+
+
+// Intersects image points with the ground and, if look is not NULL, computes the look vectors
+// to the ground points. Returns false (computing nothing) if the Sensor has no sensor model.
+bool Sensor::intersect(const ImagePoint *imagePoints, size_t count, CartesianPoint *ground,
+                       CartesianVector *look) const {
+  if (!m_sensorModel) {
+    return false;
+  }
+  m_sensorModel->imageToGround(imagePoints, count, ground);
+  if (look) {
+    m_sensorModel->groundToLook(ground, count, look);
+  }
+  return true;
+}
@@ -146,6 +146,38 @@ namespace sensormath {
    }
 
 
+  /**
+   * Converts an array of rectangular coordinates to [R,RightAscension,Declination], as
+   * rect2lat does for a single point. Works directly on caller-owned arrays so large point
+   * sets (e.g. NumPy arrays) are converted without copies.
+   *
+   * @param rectangularCoords count interleaved (x, y, z) points.
+   * @param count Number of points.
+   * @param radiusLatLong Receives count interleaved (R, Declination, RightAscension) triples,
+   *                      with the angles in radians. Zero vectors give all zeros. It may be
+   *                      rectangularCoords itself, to convert in place.
+   */
+  void rect2lat(const double *rectangularCoords, size_t count, double *radiusLatLong) {
+    for (size_t i = 0; i < count; i++) {
+      // Copied first, so writing the result cannot clobber the input when converting in place.
+      double x = rectangularCoords[3 * i];
+      double y = rectangularCoords[3 * i + 1];
+      double z = rectangularCoords[3 * i + 2];
+      double *result = radiusLatLong + 3 * i;
+      // hypot does not underflow or overflow for tiny or huge vectors, like Armadillo's norm.
+      double radius = std::hypot(std::hypot(x, y), z);
+      if (radius > 0.0) {
+        result[0] = radius;
+        result[1] = asin(z / radius);
+        result[2] = atan2(y, x);
+      }
+      else {
+        result[0] = result[1] = result[2] = 0.0;
+      }
+    }
+  }
+
+
   /**
    * @brief lat2rect
    * @author Tyler Wilson
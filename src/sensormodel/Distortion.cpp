@@ -0,0 +1,384 @@
+#include "Distortion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+  // Takes one Newton step towards distort(x, y) == (distortedX, distortedY). Returns the length
+  // of the step, or NaN if the Jacobian is singular (x and y are left unchanged).
+  double newtonStep(const DistortionModel &model, double distortedX, double distortedY,
+                    double &x, double &y) {
+    double currentX, currentY, jacobian[4];
+    model.distort(x, y, currentX, currentY, jacobian);
+    double determinant = jacobian[0] * jacobian[3] - jacobian[1] * jacobian[2];
+    if (determinant == 0.0 || !std::isfinite(determinant)) {
+      return NAN;
+    }
+    double errorX = currentX - distortedX;
+    double errorY = currentY - distortedY;
+    double stepX = (jacobian[3] * errorX - jacobian[1] * errorY) / determinant;
+    double stepY = (jacobian[0] * errorY - jacobian[2] * errorX) / determinant;
+    x -= stepX;
+    y -= stepY;
+    return std::sqrt(stepX * stepX + stepY * stepY);
+  }
+}
+
+
+/**
+ * Inverts the distortion at one point with Newton's method, starting from the distorted point.
+ *
+ * @param distortedX Distorted x.
+ * @param distortedY Distorted y.
+ * @param x Receives the undistorted x, or NaN if the solve did not converge.
+ * @param y Receives the undistorted y, or NaN if the solve did not converge.
+ * @param maxIterations Largest number of Newton steps taken.
+ * @param tolerance The solve stops once a step is shorter than tolerance times the distance
+ *                  of the point from the origin (or than tolerance, near the origin).
+ *
+ * @return bool Returns true if the solve converged.
+ */
+bool DistortionModel::undistort(double distortedX, double distortedY, double &x, double &y,
+                                int maxIterations, double tolerance) const {
+  x = distortedX;
+  y = distortedY;
+  double scale = std::max(1.0, std::sqrt(distortedX * distortedX + distortedY * distortedY));
+  for (int iteration = 0; iteration < maxIterations; iteration++) {
+    double step = newtonStep(*this, distortedX, distortedY, x, y);
+    if (std::isnan(step)) {
+      break;
+    }
+    if (step <= tolerance * scale) {
+      return true;
+    }
+  }
+  x = y = NAN;
+  return false;
+}
+
+
+/**
+ * Distorts an array of points.
+ *
+ * @param points count interleaved undistorted (x, y) points.
+ * @param count Number of points.
+ * @param distorted Receives count interleaved distorted points.
+ */
+void DistortionModel::distort(const double *points, size_t count, double *distorted) const {
+  for (size_t i = 0; i < count; i++) {
+    distort(points[2 * i], points[2 * i + 1], distorted[2 * i], distorted[2 * i + 1]);
+  }
+}
+
+
+/**
+ * Undistorts an array of points with the iterative solve.
+ *
+ * @param distorted count interleaved distorted (x, y) points.
+ * @param count Number of points.
+ * @param points Receives count interleaved undistorted points (NaN where the solve failed).
+ */
+void DistortionModel::undistort(const double *distorted, size_t count, double *points) const {
+  for (size_t i = 0; i < count; i++) {
+    undistort(distorted[2 * i], distorted[2 * i + 1], points[2 * i], points[2 * i + 1]);
+  }
+}
+
+
+/**
+ * Creates a radial distortion model.
+ *
+ * @param k1 Coefficient of r^2.
+ * @param k2 Coefficient of r^4.
+ * @param k3 Coefficient of r^6.
+ */
+RadialDistortion::RadialDistortion(double k1, double k2, double k3)
+    : m_k1(k1), m_k2(k2), m_k3(k3) {
+}
+
+
+void RadialDistortion::distort(double x, double y, double &distortedX, double &distortedY,
+                               double *jacobian) const {
+  double r2 = x * x + y * y;
+  double scale = 1.0 + r2 * (m_k1 + r2 * (m_k2 + r2 * m_k3));
+  distortedX = x * scale;
+  distortedY = y * scale;
+  if (jacobian) {
+    // d(scale)/dx = 2x * d(scale)/d(r2)
+    double derivative = 2.0 * (m_k1 + r2 * (2.0 * m_k2 + 3.0 * r2 * m_k3));
+    jacobian[0] = scale + x * x * derivative;
+    jacobian[1] = x * y * derivative;
+    jacobian[2] = jacobian[1];
+    jacobian[3] = scale + y * y * derivative;
+  }
+}
+
+
+/**
+ * Creates a polynomial distortion model.
+ *
+ * @param degree Highest total degree of the polynomials.
+ * @param xCoefficients termCount(degree) coefficients of distortedX.
+ * @param yCoefficients termCount(degree) coefficients of distortedY.
+ *
+ * @throws std::invalid_argument If the degree is negative or a coefficient count is wrong.
+ */
+PolynomialDistortion::PolynomialDistortion(int degree, const std::vector<double> &xCoefficients,
+                                           const std::vector<double> &yCoefficients)
+    : m_degree(degree), m_xCoefficients(xCoefficients), m_yCoefficients(yCoefficients) {
+  if (degree < 0 || xCoefficients.size() != termCount(degree)
+      || yCoefficients.size() != termCount(degree)) {
+    throw std::invalid_argument("Polynomial distortion needs (degree + 1)(degree + 2) / 2 "
+                                "coefficients per axis");
+  }
+}
+
+
+/**
+ * @param degree A polynomial degree.
+ *
+ * @return size_t Returns the number of terms of a bivariate polynomial of that degree.
+ */
+size_t PolynomialDistortion::termCount(int degree) {
+  return size_t(degree + 1) * size_t(degree + 2) / 2;
+}
+
+
+void PolynomialDistortion::distort(double x, double y, double &distortedX, double &distortedY,
+                                   double *jacobian) const {
+  // Powers of x and y up to the degree; index 0 is 1.
+  double xPowers[16], yPowers[16];
+  std::vector<double> xHeap, yHeap;
+  double *xPower = xPowers, *yPower = yPowers;
+  if (m_degree >= 16) {
+    xHeap.resize(m_degree + 1);
+    yHeap.resize(m_degree + 1);
+    xPower = xHeap.data();
+    yPower = yHeap.data();
+  }
+  xPower[0] = yPower[0] = 1.0;
+  for (int power = 1; power <= m_degree; power++) {
+    xPower[power] = xPower[power - 1] * x;
+    yPower[power] = yPower[power - 1] * y;
+  }
+
+  distortedX = distortedY = 0.0;
+  double dxdx = 0.0, dxdy = 0.0, dydx = 0.0, dydy = 0.0;
+  size_t term = 0;
+  for (int total = 0; total <= m_degree; total++) {
+    for (int j = 0; j <= total; j++, term++) {
+      int i = total - j;
+      double value = xPower[i] * yPower[j];
+      distortedX += m_xCoefficients[term] * value;
+      distortedY += m_yCoefficients[term] * value;
+      if (jacobian) {
+        double byX = i ? i * xPower[i - 1] * yPower[j] : 0.0;
+        double byY = j ? j * xPower[i] * yPower[j - 1] : 0.0;
+        dxdx += m_xCoefficients[term] * byX;
+        dxdy += m_xCoefficients[term] * byY;
+        dydx += m_yCoefficients[term] * byX;
+        dydy += m_yCoefficients[term] * byY;
+      }
+    }
+  }
+  if (jacobian) {
+    jacobian[0] = dxdx;
+    jacobian[1] = dxdy;
+    jacobian[2] = dydx;
+    jacobian[3] = dydy;
+  }
+}
+
+
+int PolynomialDistortion::degree() const {
+  return m_degree;
+}
+
+
+/**
+ * Builds the inverse grid of a distortion model, solving every node with the iterative
+ * inverse.
+ *
+ * @param model The distortion model to invert.
+ * @param minimumX Smallest distorted x covered.
+ * @param minimumY Smallest distorted y covered.
+ * @param maximumX Largest distorted x covered.
+ * @param maximumY Largest distorted y covered.
+ * @param columns Number of grid nodes along x (at least 2).
+ * @param rows Number of grid nodes along y (at least 2).
+ *
+ * @throws std::invalid_argument If the model is missing, the rectangle is empty, there are
+ *                               fewer than 2 nodes along an axis, or the model can not be
+ *                               inverted at a node.
+ */
+InverseDistortionGrid::InverseDistortionGrid(const std::shared_ptr<const DistortionModel> &model,
+                                             double minimumX, double minimumY, double maximumX,
+                                             double maximumY, int columns, int rows)
+    : m_model(model), m_minimumX(minimumX), m_minimumY(minimumY),
+      m_stepX((maximumX - minimumX) / (columns - 1)), m_stepY((maximumY - minimumY) / (rows - 1)),
+      m_columns(columns), m_rows(rows) {
+  if (!model || columns < 2 || rows < 2 || !(maximumX > minimumX) || !(maximumY > minimumY)) {
+    throw std::invalid_argument("Inverse distortion grid needs a model, a non-empty rectangle "
+                                "and at least 2 x 2 nodes");
+  }
+
+  m_nodes.resize(2 * size_t(columns) * rows);
+  for (int row = 0; row < rows; row++) {
+    double distortedY = minimumY + row * m_stepY;
+    for (int column = 0; column < columns; column++) {
+      double distortedX = minimumX + column * m_stepX;
+      double *node = &m_nodes[2 * (size_t(row) * columns + column)];
+      if (!m_model->undistort(distortedX, distortedY, node[0], node[1])) {
+        throw std::invalid_argument("Distortion can not be inverted over the grid rectangle");
+      }
+    }
+  }
+}
+
+
+/**
+ * Returns the inverse grid of an instrument, building it on first use. Later calls for the
+ * same instrument return the same grid (the other arguments are then ignored) for as long as
+ * any caller still holds it.
+ *
+ * @param instrument A name identifying the instrument (and its distortion).
+ *
+ * @return std::shared_ptr<const InverseDistortionGrid> Returns the shared grid.
+ */
+std::shared_ptr<const InverseDistortionGrid> InverseDistortionGrid::shared(
+    const std::string &instrument, const std::shared_ptr<const DistortionModel> &model,
+    double minimumX, double minimumY, double maximumX, double maximumY, int columns, int rows) {
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<const InverseDistortionGrid> > grids;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<const InverseDistortionGrid> grid = grids[instrument].lock();
+  if (!grid) {
+    grid = std::make_shared<InverseDistortionGrid>(model, minimumX, minimumY, maximumX,
+                                                   maximumY, columns, rows);
+    grids[instrument] = grid;
+  }
+  return grid;
+}
+
+
+/**
+ * Undistorts one point: bilinear interpolation of the grid followed by one Newton step.
+ * Points outside the grid use the model's iterative solve.
+ *
+ * @param distortedX Distorted x.
+ * @param distortedY Distorted y.
+ * @param x Receives the undistorted x.
+ * @param y Receives the undistorted y.
+ */
+void InverseDistortionGrid::undistort(double distortedX, double distortedY, double &x,
+                                      double &y) const {
+  double column = (distortedX - m_minimumX) / m_stepX;
+  double row = (distortedY - m_minimumY) / m_stepY;
+  if (!(column >= 0.0 && column <= m_columns - 1 && row >= 0.0 && row <= m_rows - 1)) {
+    m_model->undistort(distortedX, distortedY, x, y);
+    return;
+  }
+
+  int left = std::min(int(column), m_columns - 2);
+  int top = std::min(int(row), m_rows - 2);
+  double u = column - left;
+  double v = row - top;
+  const double *upper = &m_nodes[2 * (size_t(top) * m_columns + left)];
+  const double *lower = upper + 2 * size_t(m_columns);
+  x = (1.0 - v) * ((1.0 - u) * upper[0] + u * upper[2]) + v * ((1.0 - u) * lower[0] + u * lower[2]);
+  y = (1.0 - v) * ((1.0 - u) * upper[1] + u * upper[3]) + v * ((1.0 - u) * lower[1] + u * lower[3]);
+
+  newtonStep(*m_model, distortedX, distortedY, x, y);
+}
+
+
+/**
+ * Undistorts an array of points.
+ *
+ * @param distorted count interleaved distorted (x, y) points.
+ * @param count Number of points.
+ * @param points Receives count interleaved undistorted points.
+ */
+void InverseDistortionGrid::undistort(const double *distorted, size_t count,
+                                      double *points) const {
+  for (size_t i = 0; i < count; i++) {
+    undistort(distorted[2 * i], distorted[2 * i + 1], points[2 * i], points[2 * i + 1]);
+  }
+}
+
+
+/**
+ * Distorts an array of points with the grid's model, so callers holding only the grid can
+ * convert in both directions.
+ *
+ * @param points count interleaved undistorted (x, y) points.
+ * @param count Number of points.
+ * @param distorted Receives count interleaved distorted points.
+ */
+void InverseDistortionGrid::distort(const double *points, size_t count, double *distorted) const {
+  m_model->distort(points, count, distorted);
+}
+
+
+/**
+ * Measures the grid against the exact iterative inverse. Points are taken on a regular
+ * pattern of samplesPerCell x samplesPerCell points inside every grid cell, offset from the
+ * nodes so they land where the interpolation error is largest.
+ *
+ * @param samplesPerCell Number of points per cell along each axis.
+ *
+ * @return DistortionAccuracy Returns the error statistics.
+ */
+DistortionAccuracy InverseDistortionGrid::measureAccuracy(int samplesPerCell) const {
+  DistortionAccuracy accuracy;
+  double sumSquares = 0.0;
+  int columnSamples = (m_columns - 1) * samplesPerCell;
+  int rowSamples = (m_rows - 1) * samplesPerCell;
+  for (int row = 0; row < rowSamples; row++) {
+    double distortedY = m_minimumY + (row + 0.5) * m_stepY / samplesPerCell;
+    for (int column = 0; column < columnSamples; column++) {
+      double distortedX = m_minimumX + (column + 0.5) * m_stepX / samplesPerCell;
+      double exactX, exactY, x, y;
+      if (!m_model->undistort(distortedX, distortedY, exactX, exactY)) {
+        continue;
+      }
+      undistort(distortedX, distortedY, x, y);
+      double error = std::hypot(x - exactX, y - exactY);
+      double residualX, residualY;
+      m_model->distort(x, y, residualX, residualY);
+
+      accuracy.points++;
+      accuracy.maxError = std::max(accuracy.maxError, error);
+      accuracy.maxResidual = std::max(accuracy.maxResidual,
+                                      std::hypot(residualX - distortedX, residualY - distortedY));
+      sumSquares += error * error;
+    }
+  }
+  if (accuracy.points) {
+    accuracy.rmsError = std::sqrt(sumSquares / accuracy.points);
+  }
+  return accuracy;
+}
+
+
+const DistortionModel &InverseDistortionGrid::model() const {
+  return *m_model;
+}
+
+
+int InverseDistortionGrid::columns() const {
+  return m_columns;
+}
+
+
+int InverseDistortionGrid::rows() const {
+  return m_rows;
+}
@@ -0,0 +1,295 @@
+#include "FramingSensorModel.h"
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+
+#include "Distortion.h"
+#include "sensorcore.h"
+
+namespace {
+
+  // result = a * b for row-major 3x3 matrices.
+  void multiply(const double a[9], const double b[9], double result[9]) {
+    for (int row = 0; row < 3; row++) {
+      for (int column = 0; column < 3; column++) {
+        result[3 * row + column] = a[3 * row] * b[column] + a[3 * row + 1] * b[3 + column]
+                                   + a[3 * row + 2] * b[6 + column];
+      }
+    }
+  }
+
+
+  // Rotation (and its derivative) about one axis by an angle, as a passive rotation matrix.
+  void axisRotation(int axis, double angle, double rotation[9], double derivative[9]) {
+    double c = std::cos(angle), s = std::sin(angle);
+    int first = (axis + 1) % 3, second = (axis + 2) % 3;
+    for (int k = 0; k < 9; k++) {
+      rotation[k] = 0.0;
+      derivative[k] = 0.0;
+    }
+    rotation[4 * axis] = 1.0;
+    rotation[4 * first] = c;
+    rotation[3 * first + second] = s;
+    rotation[3 * second + first] = -s;
+    rotation[4 * second] = c;
+    derivative[4 * first] = -s;
+    derivative[3 * first + second] = c;
+    derivative[3 * second + first] = -c;
+    derivative[4 * second] = -s;
+  }
+}
+
+
+/**
+ * Creates a frame camera model without distortion.
+ *
+ * @param position The body-fixed position of the camera (km).
+ * @param omega Rotation about x (radians).
+ * @param phi Rotation about y (radians).
+ * @param kappa Rotation about z (radians).
+ * @param focalLength Focal length (mm).
+ * @param pixelPitch Size of a pixel (mm).
+ * @param lines Number of image lines; the boresight is at the image center.
+ * @param samples Number of image samples.
+ * @param radii Semi-axes of the body ellipsoid along x, y and z (km).
+ */
+FramingSensorModel::FramingSensorModel(const CartesianPoint &position, double omega, double phi,
+                                       double kappa, double focalLength, double pixelPitch,
+                                       double lines, double samples, const CartesianPoint &radii)
+    : m_focalLength(focalLength), m_pixelPitch(pixelPitch), m_centerLine(0.5 * lines),
+      m_centerSample(0.5 * samples), m_radii(radii) {
+  double parameters[6] = {position.x, position.y, position.z, omega, phi, kappa};
+  setParameters(parameters);
+}
+
+
+/**
+ * Sets the focal plane distortion. The grid is shared, not copied, so every model of the same
+ * instrument can use one grid.
+ *
+ * @param distortion The inverse grid of the distortion model, or an empty pointer for none.
+ */
+void FramingSensorModel::setDistortion(
+    const std::shared_ptr<const InverseDistortionGrid> &distortion) {
+  m_distortion = distortion;
+}
+
+
+/**
+ * Sets the sensor parameters, e.g. after a bundle adjustment iteration.
+ *
+ * @param parameters Position x, y, z (km) and angles omega, phi, kappa (radians).
+ */
+void FramingSensorModel::setParameters(const double parameters[6]) {
+  m_position = CartesianPoint(parameters[0], parameters[1], parameters[2]);
+  double rotations[3][9], derivatives[3][9];
+  for (int axis = 0; axis < 3; axis++) {
+    m_angles[axis] = parameters[3 + axis];
+    axisRotation(axis, m_angles[axis], rotations[axis], derivatives[axis]);
+  }
+
+  // rotation = Rz(kappa) Ry(phi) Rx(omega); each partial replaces one factor by its derivative.
+  double zy[9];
+  multiply(rotations[2], rotations[1], zy);
+  multiply(zy, rotations[0], m_rotation);
+  multiply(zy, derivatives[0], m_rotationPartials[0]);
+  double zdy[9], dzy[9];
+  multiply(rotations[2], derivatives[1], zdy);
+  multiply(zdy, rotations[0], m_rotationPartials[1]);
+  multiply(derivatives[2], rotations[1], dzy);
+  multiply(dzy, rotations[0], m_rotationPartials[2]);
+}
+
+
+/**
+ * @param parameters Receives position x, y, z (km) and angles omega, phi, kappa (radians).
+ */
+void FramingSensorModel::parameters(double parameters[6]) const {
+  parameters[0] = m_position.x;
+  parameters[1] = m_position.y;
+  parameters[2] = m_position.z;
+  for (int axis = 0; axis < 3; axis++) {
+    parameters[3 + axis] = m_angles[axis];
+  }
+}
+
+
+/**
+ * Intersects the line of sight of an image point with the ellipsoid.
+ *
+ * @param imagePoint The image point.
+ *
+ * @return CartesianPoint Returns the first intersection, or NaN coordinates if the line of
+ *                        sight misses the body.
+ */
+CartesianPoint FramingSensorModel::imageToGround(const ImagePoint &imagePoint) const {
+  double x = (imagePoint.sample - m_centerSample) * m_pixelPitch;
+  double y = (imagePoint.line - m_centerLine) * m_pixelPitch;
+  if (m_distortion) {
+    m_distortion->undistort(x, y, x, y);
+  }
+
+  // Camera ray (x, y, f) rotated back to the body-fixed frame (transpose of m_rotation),
+  // then scaled so the ellipsoid becomes the unit sphere.
+  double direction[3], origin[3];
+  const double radii[3] = {m_radii.x, m_radii.y, m_radii.z};
+  const double position[3] = {m_position.x, m_position.y, m_position.z};
+  for (int axis = 0; axis < 3; axis++) {
+    direction[axis] = (m_rotation[axis] * x + m_rotation[3 + axis] * y
+                       + m_rotation[6 + axis] * m_focalLength) / radii[axis];
+    origin[axis] = position[axis] / radii[axis];
+  }
+
+  double a = 0.0, b = 0.0, c = -1.0;
+  for (int axis = 0; axis < 3; axis++) {
+    a += direction[axis] * direction[axis];
+    b += 2.0 * origin[axis] * direction[axis];
+    c += origin[axis] * origin[axis];
+  }
+  double discriminant = b * b - 4.0 * a * c;
+  if (discriminant < 0.0) {
+    return CartesianPoint(NAN, NAN, NAN);
+  }
+  double t = (-b - std::sqrt(discriminant)) / (2.0 * a);
+  if (t < 0.0) {
+    return CartesianPoint(NAN, NAN, NAN);
+  }
+  return CartesianPoint(position[0] + t * direction[0] * radii[0],
+                        position[1] + t * direction[1] * radii[1],
+                        position[2] + t * direction[2] * radii[2]);
+}
+
+
+/**
+ * Projects a ground point into the image.
+ *
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return ImagePoint Returns the image point, or NaN coordinates if the point is behind the
+ *                    camera.
+ */
+ImagePoint FramingSensorModel::groundToImage(const CartesianPoint &groundPoint) const {
+  return project(groundPoint, NULL, NULL);
+}
+
+
+/**
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return CartesianVector Returns the vector from the camera to the ground point.
+ */
+CartesianVector FramingSensorModel::groundToLook(const CartesianPoint &groundPoint) const {
+  return CartesianVector(groundPoint.x - m_position.x, groundPoint.y - m_position.y,
+                         groundPoint.z - m_position.z);
+}
+
+
+/**
+ * @return double Returns 0.0: a frame is exposed at a single time.
+ */
+double FramingSensorModel::imageTime(const ImagePoint &) const {
+  return 0.0;
+}
+
+
+/**
+ * @return int Returns 6: position x, y, z and angles omega, phi, kappa.
+ */
+int FramingSensorModel::parameterCount() const {
+  return 6;
+}
+
+
+/**
+ * Projects several ground points into the image and computes the analytic partial
+ * derivatives of each (sample, line) with respect to the ground point and the six sensor
+ * parameters, in the same pass as the projection. Nothing is allocated, so the outputs can be
+ * reused across bundle adjustment iterations.
+ *
+ * @param groundPoints The body-fixed ground points to project.
+ * @param count Number of ground points.
+ * @param imagePoints Receives count image points.
+ * @param partials Receives the partial derivatives (NaN for points behind the camera).
+ */
+void FramingSensorModel::groundToImage(const CartesianPoint *groundPoints, size_t count,
+                                       ImagePoint *imagePoints,
+                                       const PartialsBuffer &partials) const {
+  double groundPartials[6], sensorPartials[12];
+  for (size_t i = 0; i < count; i++) {
+    imagePoints[i] = project(groundPoints[i], groundPartials, sensorPartials);
+    partials.store(i, groundPartials, 6, sensorPartials);
+  }
+}
+
+
+// Projects a ground point and, if groundPartials is not NULL, fills the row-major 2x3 ground
+// and 2x6 sensor partials of (sample, line).
+ImagePoint FramingSensorModel::project(const CartesianPoint &groundPoint, double *groundPartials,
+                                       double *sensorPartials) const {
+  double offset[3] = {groundPoint.x - m_position.x, groundPoint.y - m_position.y,
+                      groundPoint.z - m_position.z};
+  double camera[3];
+  for (int row = 0; row < 3; row++) {
+    camera[row] = m_rotation[3 * row] * offset[0] + m_rotation[3 * row + 1] * offset[1]
+                  + m_rotation[3 * row + 2] * offset[2];
+  }
+  if (!(camera[2] > 0.0)) {
+    if (groundPartials) {
+      for (int k = 0; k < 6; k++) {
+        groundPartials[k] = NAN;
+      }
+      for (int k = 0; k < 12; k++) {
+        sensorPartials[k] = NAN;
+      }
+    }
+    return ImagePoint(NAN, NAN, 1.0);
+  }
+
+  double scale = m_focalLength / camera[2];
+  double x = camera[0] * scale;
+  double y = camera[1] * scale;
+  double distortedX = x, distortedY = y;
+  double distortion[4] = {1.0, 0.0, 0.0, 1.0};
+  if (m_distortion) {
+    m_distortion->model().distort(x, y, distortedX, distortedY,
+                                  groundPartials ? distortion : NULL);
+  }
+  ImagePoint image(m_centerSample + distortedX / m_pixelPitch,
+                   m_centerLine + distortedY / m_pixelPitch, 1.0);
+  if (!groundPartials) {
+    return image;
+  }
+
+  // d(sample, line) / d(camera) = distortion * d(x, y) / d(camera) / pitch.
+  double focalPartials[6] = {scale, 0.0, -x / camera[2], 0.0, scale, -y / camera[2]};
+  double byCamera[6];
+  for (int row = 0; row < 2; row++) {
+    for (int column = 0; column < 3; column++) {
+      byCamera[3 * row + column] = (distortion[2 * row] * focalPartials[column]
+                                    + distortion[2 * row + 1] * focalPartials[3 + column])
+                                   / m_pixelPitch;
+    }
+  }
+
+  for (int row = 0; row < 2; row++) {
+    const double *r = byCamera + 3 * row;
+    for (int column = 0; column < 3; column++) {
+      // camera = rotation * (ground - position)
+      double byGround = r[0] * m_rotation[column] + r[1] * m_rotation[3 + column]
+                        + r[2] * m_rotation[6 + column];
+      groundPartials[3 * row + column] = byGround;
+      sensorPartials[6 * row + column] = -byGround;
+    }
+    for (int angle = 0; angle < 3; angle++) {
+      const double *partial = m_rotationPartials[angle];
+      double byAngle = 0.0;
+      for (int k = 0; k < 3; k++) {
+        byAngle += r[k] * (partial[3 * k] * offset[0] + partial[3 * k + 1] * offset[1]
+                           + partial[3 * k + 2] * offset[2]);
+      }
+      sensorPartials[6 * row + 3 + angle] = byAngle;
+    }
+  }
+  return image;
+}
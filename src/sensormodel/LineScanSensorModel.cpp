@@ -0,0 +1,277 @@
+#include "LineScanSensorModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "sensorcore.h"
+
+namespace {
+
+  // Passive rotation Rz(kappa) Ry(phi) Rx(omega), row-major, as in FramingSensorModel.
+  void angleRotation(double omega, double phi, double kappa, double result[9]) {
+    double co = std::cos(omega), so = std::sin(omega);
+    double cp = std::cos(phi), sp = std::sin(phi);
+    double ck = std::cos(kappa), sk = std::sin(kappa);
+    result[0] = ck * cp;
+    result[1] = ck * sp * so + sk * co;
+    result[2] = -ck * sp * co + sk * so;
+    result[3] = -sk * cp;
+    result[4] = -sk * sp * so + ck * co;
+    result[5] = sk * sp * co + ck * so;
+    result[6] = sp;
+    result[7] = -cp * so;
+    result[8] = cp * co;
+  }
+
+
+  // One row of rotation * (ground - position).
+  double cameraComponent(const double *row, const CartesianPoint &position,
+                         const CartesianPoint &groundPoint) {
+    return row[0] * (groundPoint.x - position.x) + row[1] * (groundPoint.y - position.y)
+           + row[2] * (groundPoint.z - position.z);
+  }
+}
+
+
+/**
+ * Creates a line-scan camera model.
+ *
+ * @param positions The body-fixed position of the camera (km) at the center of each line.
+ * @param angles Omega, phi and kappa (radians) at the center of each line, interleaved.
+ * @param lineTime Time between the exposures of consecutive lines (s).
+ * @param focalLength Focal length (mm).
+ * @param pixelPitch Size of a pixel (mm).
+ * @param samples Number of image samples; the boresight is at the center of the row.
+ * @param radii Semi-axes of the body ellipsoid along x, y and z (km).
+ *
+ * @throws std::invalid_argument If there are fewer than two lines, or not three angles per
+ *                               line.
+ */
+LineScanSensorModel::LineScanSensorModel(const std::vector<CartesianPoint> &positions,
+                                         const std::vector<double> &angles, double lineTime,
+                                         double focalLength, double pixelPitch, double samples,
+                                         const CartesianPoint &radii)
+    : m_positions(positions), m_angles(angles), m_rotations(9 * positions.size()),
+      m_lineTime(lineTime), m_focalLength(focalLength), m_pixelPitch(pixelPitch),
+      m_centerSample(0.5 * samples), m_radii(radii) {
+  if (positions.size() < 2 || angles.size() != 3 * positions.size()) {
+    throw std::invalid_argument("A line-scan model needs two or more lines with three angles "
+                                "each");
+  }
+  // Omega and kappa are unwrapped so that interpolating between lines on either side of +-pi
+  // takes the short way round rather than sweeping through 0.
+  for (size_t line = 1; line < positions.size(); line++) {
+    for (int angle = 0; angle < 3; angle += 2) {
+      double &current = m_angles[3 * line + angle];
+      double previous = m_angles[3 * (line - 1) + angle];
+      current -= 2.0 * M_PI * std::floor((current - previous + M_PI) / (2.0 * M_PI));
+    }
+  }
+  for (size_t line = 0; line < positions.size(); line++) {
+    angleRotation(m_angles[3 * line], m_angles[3 * line + 1], m_angles[3 * line + 2],
+                  &m_rotations[9 * line]);
+  }
+}
+
+
+/**
+ * @return double Returns the number of image lines.
+ */
+double LineScanSensorModel::lines() const {
+  return double(m_positions.size());
+}
+
+
+/**
+ * Intersects the line of sight of an image point with the ellipsoid.
+ *
+ * @param imagePoint The image point.
+ *
+ * @return CartesianPoint Returns the first intersection, or NaN coordinates if the line of
+ *                        sight misses the body.
+ */
+CartesianPoint LineScanSensorModel::imageToGround(const ImagePoint &imagePoint) const {
+  if (!std::isfinite(imagePoint.line) || !std::isfinite(imagePoint.sample)) {
+    return CartesianPoint(NAN, NAN, NAN);
+  }
+  CartesianPoint position;
+  double rotation[9];
+  pose(imagePoint.line, position, rotation);
+  double x = (imagePoint.sample - m_centerSample) * m_pixelPitch;
+
+  // Camera ray (x, 0, f) rotated back to the body-fixed frame, then scaled so the ellipsoid
+  // becomes the unit sphere.
+  double direction[3], origin[3];
+  const double radii[3] = {m_radii.x, m_radii.y, m_radii.z};
+  const double start[3] = {position.x, position.y, position.z};
+  for (int axis = 0; axis < 3; axis++) {
+    direction[axis] = (rotation[axis] * x + rotation[6 + axis] * m_focalLength) / radii[axis];
+    origin[axis] = start[axis] / radii[axis];
+  }
+
+  double a = 0.0, b = 0.0, c = -1.0;
+  for (int axis = 0; axis < 3; axis++) {
+    a += direction[axis] * direction[axis];
+    b += 2.0 * origin[axis] * direction[axis];
+    c += origin[axis] * origin[axis];
+  }
+  double discriminant = b * b - 4.0 * a * c;
+  if (discriminant < 0.0) {
+    return CartesianPoint(NAN, NAN, NAN);
+  }
+  double t = (-b - std::sqrt(discriminant)) / (2.0 * a);
+  if (t < 0.0) {
+    return CartesianPoint(NAN, NAN, NAN);
+  }
+  return CartesianPoint(start[0] + t * direction[0] * radii[0],
+                        start[1] + t * direction[1] * radii[1],
+                        start[2] + t * direction[2] * radii[2]);
+}
+
+
+/**
+ * Projects a ground point into the image: finds the line whose pose puts the point on the
+ * detector row, then the sample along the row.
+ *
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return ImagePoint Returns the image point, or NaN coordinates if no line sees the point in
+ *                    front of the camera.
+ */
+ImagePoint LineScanSensorModel::groundToImage(const CartesianPoint &groundPoint) const {
+  double line = locateLine(groundPoint);
+  if (std::isnan(line)) {
+    return ImagePoint(NAN, NAN, 1.0);
+  }
+  CartesianPoint position;
+  double rotation[9];
+  pose(line, position, rotation);
+  double x = cameraComponent(rotation, position, groundPoint);
+  double z = cameraComponent(rotation + 6, position, groundPoint);
+  if (!(z > 0.0)) {
+    return ImagePoint(NAN, NAN, 1.0);
+  }
+  return ImagePoint(m_centerSample + m_focalLength * x / z / m_pixelPitch, line, 1.0);
+}
+
+
+/**
+ * @param groundPoint The body-fixed ground point.
+ *
+ * @return CartesianVector Returns the vector from the camera, at the line that sees the point,
+ *                         to the ground point; NaN if no line sees it.
+ */
+CartesianVector LineScanSensorModel::groundToLook(const CartesianPoint &groundPoint) const {
+  double line = locateLine(groundPoint);
+  if (std::isnan(line)) {
+    return CartesianVector(NAN, NAN, NAN);
+  }
+  CartesianPoint position;
+  double rotation[9];
+  pose(line, position, rotation);
+  return CartesianVector(groundPoint.x - position.x, groundPoint.y - position.y,
+                         groundPoint.z - position.z);
+}
+
+
+/**
+ * @param imagePoint The image point.
+ *
+ * @return double Returns the exposure time of the point's line (s), 0.0 at the top edge of
+ *                the image.
+ */
+double LineScanSensorModel::imageTime(const ImagePoint &imagePoint) const {
+  return imagePoint.line * m_lineTime;
+}
+
+
+// Interpolated (or extrapolated) pose at an image line. Angles are interpolated rather than
+// matrices so that the rotation stays orthonormal. A NaN or infinite line gives a NaN pose.
+void LineScanSensorModel::pose(double line, CartesianPoint &position, double rotation[9]) const {
+  if (!std::isfinite(line)) {
+    position = CartesianPoint(NAN, NAN, NAN);
+    std::fill(rotation, rotation + 9, NAN);
+    return;
+  }
+  double t = line - 0.5;
+  size_t last = m_positions.size() - 1;
+  size_t index = t <= 0.0 ? 0 : t >= double(last - 1) ? last - 1 : size_t(t);
+  double fraction = t - double(index);
+  if (fraction == 0.0 || fraction == 1.0) {
+    size_t knot = index + size_t(fraction);
+    position = m_positions[knot];
+    std::copy(&m_rotations[9 * knot], &m_rotations[9 * knot] + 9, rotation);
+    return;
+  }
+  const CartesianPoint &p0 = m_positions[index], &p1 = m_positions[index + 1];
+  position = CartesianPoint(p0.x + fraction * (p1.x - p0.x), p0.y + fraction * (p1.y - p0.y),
+                            p0.z + fraction * (p1.z - p0.z));
+  const double *a0 = &m_angles[3 * index], *a1 = a0 + 3;
+  angleRotation(a0[0] + fraction * (a1[0] - a0[0]), a0[1] + fraction * (a1[1] - a0[1]),
+                a0[2] + fraction * (a1[2] - a0[2]), rotation);
+}
+
+
+// Finds the (fractional) image line whose pose puts a ground point at camera y = 0, or NaN.
+// The poses are bracketed by bisection over the precomputed ones, then refined by the secant
+// method on the interpolated pose.
+double LineScanSensorModel::locateLine(const CartesianPoint &groundPoint) const {
+  size_t last = m_positions.size() - 1;
+  double first = cameraComponent(&m_rotations[3], m_positions[0], groundPoint);
+  double final = cameraComponent(&m_rotations[9 * last + 3], m_positions[last], groundPoint);
+  if (std::isnan(first) || std::isnan(final)) {
+    return NAN;
+  }
+
+  // Knots t0 and t1 (image lines t + 0.5) to start the secant method from.
+  double t0, t1, g0, g1;
+  if ((first <= 0.0) != (final <= 0.0)) {
+    size_t low = 0, high = last;
+    while (high - low > 1) {
+      size_t middle = low + (high - low) / 2;
+      double g = cameraComponent(&m_rotations[9 * middle + 3], m_positions[middle], groundPoint);
+      if ((g <= 0.0) == (first <= 0.0)) {
+        low = middle;
+      }
+      else {
+        high = middle;
+      }
+    }
+    t0 = double(low);
+    t1 = double(high);
+  }
+  else if (std::fabs(first) < std::fabs(final)) {
+    t0 = 0.0;
+    t1 = 1.0;
+  }
+  else {
+    t0 = double(last - 1);
+    t1 = double(last);
+  }
+  g0 = cameraComponent(&m_rotations[9 * size_t(t0) + 3], m_positions[size_t(t0)], groundPoint);
+  g1 = cameraComponent(&m_rotations[9 * size_t(t1) + 3], m_positions[size_t(t1)], groundPoint);
+
+  CartesianPoint position;
+  double rotation[9];
+  for (int iteration = 0; iteration < 30; iteration++) {
+    if (g1 == g0) {
+      break;
+    }
+    double t2 = t1 - g1 * (t1 - t0) / (g1 - g0);
+    t0 = t1;
+    g0 = g1;
+    t1 = t2;
+    if (std::fabs(t1 - t0) < 1e-10) {
+      break;
+    }
+    pose(t1 + 0.5, position, rotation);
+    g1 = cameraComponent(rotation + 3, position, groundPoint);
+  }
+  if (g1 != 0.0 && !(std::fabs(t1 - t0) < 1e-6)) {
+    return NAN;
+  }
+  return t1 + 0.5;
+}
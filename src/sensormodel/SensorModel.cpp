@@ -0,0 +1,129 @@
+#include "SensorModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "sensorcore.h"
+
+/**
+ * Intersects several image points with the ground. The default calls the per-point
+ * imageToGround for each point; models that can do better (or that derive from
+ * SensorModelBase) override it.
+ *
+ * @param imagePoints The image points to intersect.
+ * @param count Number of image points.
+ * @param groundPoints Receives count body-fixed ground points.
+ */
+void SensorModel::imageToGround(const ImagePoint *imagePoints, size_t count,
+                                CartesianPoint *groundPoints) const {
+  for (size_t i = 0; i < count; i++) {
+    groundPoints[i] = imageToGround(imagePoints[i]);
+  }
+}
+
+
+/**
+ * Projects several ground points into the image. The default calls the per-point
+ * groundToImage for each point.
+ *
+ * @param groundPoints The body-fixed ground points to project.
+ * @param count Number of ground points.
+ * @param imagePoints Receives count image points.
+ */
+void SensorModel::groundToImage(const CartesianPoint *groundPoints, size_t count,
+                                ImagePoint *imagePoints) const {
+  for (size_t i = 0; i < count; i++) {
+    imagePoints[i] = groundToImage(groundPoints[i]);
+  }
+}
+
+
+/**
+ * Computes the look vectors to several ground points. The default calls the per-point
+ * groundToLook for each point.
+ *
+ * @param groundPoints The body-fixed ground points.
+ * @param count Number of ground points.
+ * @param lookVectors Receives count look vectors.
+ */
+void SensorModel::groundToLook(const CartesianPoint *groundPoints, size_t count,
+                               CartesianVector *lookVectors) const {
+  for (size_t i = 0; i < count; i++) {
+    lookVectors[i] = groundToLook(groundPoints[i]);
+  }
+}
+
+
+/**
+ * Computes the acquisition times of several image points. The default calls the per-point
+ * imageTime for each point.
+ *
+ * @param imagePoints The image points.
+ * @param count Number of image points.
+ * @param times Receives count times.
+ */
+void SensorModel::imageTime(const ImagePoint *imagePoints, size_t count, double *times) const {
+  for (size_t i = 0; i < count; i++) {
+    times[i] = imageTime(imagePoints[i]);
+  }
+}
+
+
+/**
+ * @return int Returns the number of adjustable sensor parameters whose partial derivatives
+ *             the batched groundToImage reports. The default model has none.
+ */
+int SensorModel::parameterCount() const {
+  return 0;
+}
+
+
+/**
+ * Projects several ground points into the image and computes the partial derivatives of each
+ * (sample, line) with respect to the ground point and the sensor parameters.
+ *
+ * The default differentiates groundToImage numerically with respect to the ground point
+ * (central differences, six extra projections per point). It has no way to vary the sensor
+ * parameters, so models with parameters must override it if sensor partials are requested.
+ * Models with analytic derivatives override it.
+ *
+ * @param groundPoints The body-fixed ground points to project.
+ * @param count Number of ground points.
+ * @param imagePoints Receives count image points.
+ * @param partials Receives the partial derivatives.
+ *
+ * @throws std::logic_error If sensor partials are requested and parameterCount() is not 0.
+ */
+void SensorModel::groundToImage(const CartesianPoint *groundPoints, size_t count,
+                                ImagePoint *imagePoints, const PartialsBuffer &partials) const {
+  int parameters = parameterCount();
+  bool sensorRequested = partials.layout == PartialsBuffer::BlockSparse
+                         ? partials.sensor != NULL : partials.sensorColumn >= 0;
+  if (parameters > 0 && sensorRequested) {
+    throw std::logic_error("Sensor model has parameters but does not compute their partials");
+  }
+  std::vector<double> sensorPartials(2 * parameters, 0.0);
+  for (size_t i = 0; i < count; i++) {
+    const CartesianPoint &ground = groundPoints[i];
+    imagePoints[i] = groundToImage(ground);
+
+    double step = 1e-6 * std::max(1.0, std::sqrt(ground.x * ground.x + ground.y * ground.y
+                                                 + ground.z * ground.z));
+    double groundPartials[6];
+    for (int axis = 0; axis < 3; axis++) {
+      CartesianPoint plus(ground), minus(ground);
+      double *plusComponent = axis == 0 ? &plus.x : axis == 1 ? &plus.y : &plus.z;
+      double *minusComponent = axis == 0 ? &minus.x : axis == 1 ? &minus.y : &minus.z;
+      *plusComponent += step;
+      *minusComponent -= step;
+      ImagePoint plusImage = groundToImage(plus);
+      ImagePoint minusImage = groundToImage(minus);
+      groundPartials[axis] = (plusImage.sample - minusImage.sample) / (2.0 * step);
+      groundPartials[3 + axis] = (plusImage.line - minusImage.line) / (2.0 * step);
+    }
+    partials.store(i, groundPartials, parameters, sensorPartials.data());
+  }
+}
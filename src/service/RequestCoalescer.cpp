@@ -0,0 +1,422 @@
+#include "RequestCoalescer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Backplane.h"
+#include "Encoding.h"
+#include "sensorcore.h"
+#include "Sensor.h"
+#include "SensorUtils.h"
+#include "StreamingStatistics.h"
+#include "ThreadPool.h"
+#include "Traversal.h"
+
+namespace service {
+
+  namespace {
+
+    // Kernel key of RA/Dec requests; the others use their backplane::Quantity.
+    const int RA_DEC = -1;
+
+    // Longest accepted latency budget (s). Far longer budgets would overflow the steady clock
+    // when added to a submission time.
+    const double MAXIMUM_LATENCY_BUDGET = 86400.0;
+
+
+    // Size (pixels) of the curve cells that order the points of a multi-request batch.
+    const double CURVE_CELL = 64.0;
+
+
+    // Wraps a promise in a callback, so both kinds of submission share one queue.
+    RequestCoalescer::Callback fulfill(
+        const std::shared_ptr<std::promise<std::vector<double> > > &promise) {
+      return [promise](std::vector<double> &values, std::exception_ptr error) {
+        if (error) {
+          promise->set_exception(error);
+        }
+        else {
+          promise->set_value(std::move(values));
+        }
+      };
+    }
+
+
+    double seconds(std::chrono::steady_clock::duration duration) {
+      return std::chrono::duration<double>(duration).count();
+    }
+  }
+
+
+  /**
+   * Creates empty metrics whose histograms suit a coalescer's settings: times are binned
+   * over ten latency budgets (at least a millisecond, so a zero budget still has a range),
+   * batch sizes over the largest batch.
+   *
+   * @param latencyBudget The coalescer's latency budget in seconds.
+   * @param maximumBatchPoints The coalescer's largest batch.
+   */
+  CoalescerMetrics::CoalescerMetrics(double latencyBudget, size_t maximumBatchPoints)
+      : queueTime(0.0, std::max(10.0 * latencyBudget, 1e-3), 1000),
+        latency(0.0, std::max(10.0 * latencyBudget, 1e-3), 1000),
+        batchPoints(0.0, double(maximumBatchPoints),
+                    int(std::min<size_t>(maximumBatchPoints, 1024))),
+        batchRequests(0.0, double(maximumBatchPoints),
+                      int(std::min<size_t>(maximumBatchPoints, 1024))) {
+  }
+
+
+  /**
+   * Creates a coalescer running its batches on a pool of its own.
+   *
+   * @param latencyBudget Longest time in seconds a request waits in its queue for others to
+   *                      join its batch.
+   * @param maximumBatchPoints Number of queued points that triggers a batch immediately.
+   * @param threads Number of threads running batches (an unpinned pool).
+   *
+   * @throws std::invalid_argument If the budget is negative or over a day, or the batch size or
+   *                               thread count is not positive.
+   */
+  RequestCoalescer::RequestCoalescer(double latencyBudget, size_t maximumBatchPoints,
+                                     int threads)
+      : m_latencyBudget(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(checkedBudget(latencyBudget, maximumBatchPoints)))),
+        m_maximumBatchPoints(maximumBatchPoints), m_pool(NULL), m_running(0),
+        m_stopping(false), m_metrics(latencyBudget, maximumBatchPoints) {
+    if (threads <= 0) {
+      throw std::invalid_argument("Request coalescer needs a non-negative latency budget and "
+                                  "a positive batch size and thread count");
+    }
+    m_ownedPool.reset(new execution::ThreadPool(threads, execution::NoPinning));
+    m_pool = m_ownedPool.get();
+    m_dispatcher = std::thread(&RequestCoalescer::dispatch, this);
+  }
+
+
+  /**
+   * Creates a coalescer running its batches on a shared pool.
+   *
+   * @param pool The pool running batches. It must outlive the coalescer.
+   * @param latencyBudget Longest time in seconds a request waits in its queue for others to
+   *                      join its batch.
+   * @param maximumBatchPoints Number of queued points that triggers a batch immediately.
+   *
+   * @throws std::invalid_argument If the budget is negative or over a day, or the batch size is
+   *                               not positive.
+   */
+  RequestCoalescer::RequestCoalescer(execution::ThreadPool &pool, double latencyBudget,
+                                     size_t maximumBatchPoints)
+      : m_latencyBudget(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(checkedBudget(latencyBudget, maximumBatchPoints)))),
+        m_maximumBatchPoints(maximumBatchPoints), m_pool(&pool), m_running(0),
+        m_stopping(false), m_metrics(latencyBudget, maximumBatchPoints) {
+    m_dispatcher = std::thread(&RequestCoalescer::dispatch, this);
+  }
+
+
+  /**
+   * Runs every queued request, then stops the dispatcher and waits for running batches.
+   */
+  RequestCoalescer::~RequestCoalescer() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_ready.notify_all();
+    m_dispatcher.join();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_ready.wait(lock, [this]() { return m_running == 0; });
+  }
+
+
+  /**
+   * Queues the computation of a photometric quantity at a few image points.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to compute.
+   * @param imagePoints The image points.
+   *
+   * @return std::future<std::vector<double>> Returns a future holding one value per image
+   *                                          point.
+   */
+  std::future<std::vector<double> > RequestCoalescer::submit(
+      Sensor &sensor, backplane::Quantity quantity, const std::vector<ImagePoint> &imagePoints) {
+    std::shared_ptr<std::promise<std::vector<double> > > promise =
+        std::make_shared<std::promise<std::vector<double> > >();
+    std::future<std::vector<double> > result = promise->get_future();
+    submit(sensor, quantity, imagePoints, fulfill(promise));
+    return result;
+  }
+
+
+  /**
+   * Queues the computation of a photometric quantity at a few image points.
+   *
+   * @param sensor The sensor used to compute the quantity.
+   * @param quantity The quantity to compute.
+   * @param imagePoints The image points.
+   * @param callback Receives one value per image point when the batch completes.
+   */
+  void RequestCoalescer::submit(Sensor &sensor, backplane::Quantity quantity,
+                                const std::vector<ImagePoint> &imagePoints,
+                                const Callback &callback) {
+    Request request;
+    request.imagePoints = imagePoints;
+    request.callback = callback;
+    enqueue(Key(&sensor, int(quantity)), request);
+  }
+
+
+  /**
+   * Queues the computation of right ascension and declination for a few vectors.
+   *
+   * @param vectors The vectors to project onto the celestial sphere.
+   *
+   * @return std::future<std::vector<double>> Returns a future holding interleaved
+   *                                          (RightAscension, Declination) pairs in radians.
+   */
+  std::future<std::vector<double> > RequestCoalescer::submitRADec(
+      const std::vector<CartesianVector> &vectors) {
+    std::shared_ptr<std::promise<std::vector<double> > > promise =
+        std::make_shared<std::promise<std::vector<double> > >();
+    std::future<std::vector<double> > result = promise->get_future();
+    submitRADec(vectors, fulfill(promise));
+    return result;
+  }
+
+
+  /**
+   * Queues the computation of right ascension and declination for a few vectors.
+   *
+   * @param vectors The vectors to project onto the celestial sphere.
+   * @param callback Receives interleaved (RightAscension, Declination) pairs in radians when
+   *                 the batch completes.
+   */
+  void RequestCoalescer::submitRADec(const std::vector<CartesianVector> &vectors,
+                                     const Callback &callback) {
+    Request request;
+    request.vectors = vectors;
+    request.callback = callback;
+    enqueue(Key(static_cast<Sensor *>(NULL), RA_DEC), request);
+  }
+
+
+  /**
+   * @return CoalescerMetrics Returns a snapshot of the metrics of every completed batch.
+   */
+  CoalescerMetrics RequestCoalescer::metrics() const {
+    std::lock_guard<std::mutex> lock(m_metricsMutex);
+    return m_metrics;
+  }
+
+
+  size_t RequestCoalescer::Request::points() const {
+    return imagePoints.size() + vectors.size();
+  }
+
+
+  // Adds a request to its queue and wakes the dispatcher if the request starts a queue (a new
+  // deadline) or fills it.
+  void RequestCoalescer::enqueue(const Key &key, Request &request) {
+    request.submitted = Clock::now();
+    bool wake;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stopping) {
+        throw std::runtime_error("Request coalescer is shutting down");
+      }
+      Queue &queue = m_queues[key];
+      if (queue.requests.empty()) {
+        queue.points = 0;
+        queue.deadline = request.submitted + m_latencyBudget;
+      }
+      bool wasFull = queue.points >= m_maximumBatchPoints;
+      queue.points += request.points();
+      queue.requests.push_back(std::move(request));
+      wake = queue.requests.size() == 1 || (!wasFull && queue.points >= m_maximumBatchPoints);
+    }
+    if (wake) {
+      m_ready.notify_one();
+    }
+  }
+
+
+  // Checks the settings shared by both constructors and returns the budget. It runs in the
+  // initializer of the first member, before the budget is converted to a clock duration and
+  // before the metrics histograms are sized from it.
+  double RequestCoalescer::checkedBudget(double latencyBudget, size_t maximumBatchPoints) {
+    if (!(latencyBudget >= 0.0 && latencyBudget <= MAXIMUM_LATENCY_BUDGET)
+        || maximumBatchPoints == 0) {
+      throw std::invalid_argument("Request coalescer needs a non-negative latency budget and "
+                                  "a positive batch size and thread count");
+    }
+    return latencyBudget;
+  }
+
+
+  // Dispatcher loop: while the pool has an idle thread, hands it the ready queue with the
+  // earliest deadline (up to m_maximumBatchPoints of its points) as one batch; otherwise
+  // sleeps until the next deadline or until a batch finishes.
+  void RequestCoalescer::dispatch() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      Clock::time_point now = Clock::now();
+      std::map<Key, Queue>::iterator ready = m_queues.end();
+      Clock::time_point earliest = Clock::time_point::max();
+      for (std::map<Key, Queue>::iterator it = m_queues.begin(); it != m_queues.end(); ++it) {
+        const Queue &queue = it->second;
+        if ((queue.points >= m_maximumBatchPoints || queue.deadline <= now || m_stopping)
+            && (ready == m_queues.end() || queue.deadline < ready->second.deadline)) {
+          ready = it;
+        }
+        earliest = std::min(earliest, queue.deadline);
+      }
+
+      if (ready == m_queues.end() || m_running >= m_pool->threads()) {
+        if (m_stopping && m_queues.empty()) {
+          return;
+        }
+        if (earliest == Clock::time_point::max() || ready != m_queues.end()) {
+          m_ready.wait(lock);
+        }
+        else {
+          m_ready.wait_until(lock, earliest);
+        }
+        continue;
+      }
+
+      Key key = ready->first;
+      Queue &queue = ready->second;
+      std::shared_ptr<std::vector<Request> > batch = std::make_shared<std::vector<Request> >();
+      size_t points = 0;
+      while (!queue.requests.empty()
+             && (batch->empty()
+                 || points + queue.requests.front().points() <= m_maximumBatchPoints)) {
+        points += queue.requests.front().points();
+        batch->push_back(std::move(queue.requests.front()));
+        queue.requests.pop_front();
+      }
+      queue.points -= points;
+      if (queue.requests.empty()) {
+        m_queues.erase(ready);
+      }
+      else {
+        queue.deadline = queue.requests.front().submitted + m_latencyBudget;
+      }
+
+      m_running++;
+      lock.unlock();
+      m_pool->submit([this, key, batch]() {
+        run(key, *batch);
+        // Notify under the lock: once it is released the destructor may return.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running--;
+        m_ready.notify_all();
+      });
+      lock.lock();
+    }
+  }
+
+
+  // Runs a batch through one kernel call, hands each request its slice of the results and
+  // records the metrics.
+  void RequestCoalescer::run(const Key &key, std::vector<Request> &batch) {
+    Clock::time_point started = Clock::now();
+    size_t points = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+      points += batch[i].points();
+    }
+    size_t valuesPerPoint = key.second == RA_DEC ? 2 : 1;
+    std::vector<double> values(points * valuesPerPoint);
+
+    std::exception_ptr error;
+    try {
+      if (key.second == RA_DEC) {
+        std::vector<double> coordinates;
+        coordinates.reserve(3 * points);
+        for (size_t i = 0; i < batch.size(); i++) {
+          for (size_t j = 0; j < batch[i].vectors.size(); j++) {
+            const CartesianVector &vector = batch[i].vectors[j];
+            coordinates.insert(coordinates.end(), {vector.x, vector.y, vector.z});
+          }
+        }
+        computeRADec(coordinates.data(), points, values.data());
+      }
+      else {
+        std::vector<ImagePoint> imagePoints;
+        imagePoints.reserve(points);
+        for (size_t i = 0; i < batch.size(); i++) {
+          imagePoints.insert(imagePoints.end(), batch[i].imagePoints.begin(),
+                             batch[i].imagePoints.end());
+        }
+        // Requests of different clients are scattered over the image: evaluate their points
+        // along a Hilbert curve so the model's ground accesses stay coherent, then scatter the
+        // values back.
+        std::vector<size_t> order;
+        std::vector<double> ordered;
+        EncodedBuffer out(values.data());
+        if (batch.size() > 1) {
+          order = execution::curveOrder(imagePoints.data(), points, CURVE_CELL);
+          std::vector<ImagePoint> sorted(points);
+          for (size_t i = 0; i < points; i++) {
+            sorted[i] = imagePoints[order[i]];
+          }
+          imagePoints.swap(sorted);
+          ordered.resize(points);
+          out = EncodedBuffer(ordered.data());
+        }
+        Sensor &sensor = *key.first;
+        switch (backplane::Quantity(key.second)) {
+          case backplane::Phase:
+            sensor.phaseAngles(imagePoints.data(), points, out);
+            break;
+          case backplane::Emission:
+            sensor.emissionAngles(imagePoints.data(), points, out);
+            break;
+          case backplane::Incidence:
+            sensor.incidenceAngles(imagePoints.data(), points, out);
+            break;
+          case backplane::Resolution:
+            sensor.resolutions(imagePoints.data(), points, out);
+            break;
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+          values[order[i]] = ordered[i];
+        }
+      }
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+
+    Clock::time_point completed = Clock::now();
+    {
+      std::lock_guard<std::mutex> lock(m_metricsMutex);
+      for (size_t i = 0; i < batch.size(); i++) {
+        m_metrics.queueTime.add(seconds(started - batch[i].submitted));
+        m_metrics.latency.add(seconds(completed - batch[i].submitted));
+      }
+      m_metrics.batchPoints.add(double(points));
+      m_metrics.batchRequests.add(double(batch.size()));
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+      size_t size = batch[i].points() * valuesPerPoint;
+      std::vector<double> result;
+      if (!error) {
+        result.assign(values.begin() + offset, values.begin() + offset + size);
+      }
+      offset += size;
+      batch[i].callback(result, error);
+    }
+  }
+}
@@ -0,0 +1,376 @@
+#include "TerrainVisibility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "sensorcore.h"
+
+namespace shapemodel {
+
+  /**
+   * Creates an elevation model.
+   *
+   * @param lines Number of grid lines (along y).
+   * @param samples Number of grid samples (along x).
+   * @param heights lines * samples heights, row-major (line by line).
+   * @param originX x of the cell at line 0, sample 0.
+   * @param originY y of the cell at line 0, sample 0.
+   * @param spacing Distance between neighboring cells.
+   *
+   * @throws std::invalid_argument If the grid is smaller than 2 x 2, the spacing is not
+   *                               positive or the number of heights is wrong.
+   */
+  ElevationModel::ElevationModel(int64_t lines, int64_t samples,
+                                 const std::vector<double> &heights, double originX,
+                                 double originY, double spacing)
+      : m_lines(lines), m_samples(samples), m_heights(heights), m_originX(originX),
+        m_originY(originY), m_spacing(spacing) {
+    if (lines < 2 || samples < 2 || !(spacing > 0.0)
+        || heights.size() != size_t(lines) * size_t(samples)) {
+      throw std::invalid_argument("Elevation model needs at least 2 x 2 heights and a positive "
+                                  "spacing");
+    }
+    m_maximumHeight = *std::max_element(heights.begin(), heights.end());
+  }
+
+
+  int64_t ElevationModel::lines() const {
+    return m_lines;
+  }
+
+
+  int64_t ElevationModel::samples() const {
+    return m_samples;
+  }
+
+
+  double ElevationModel::originX() const {
+    return m_originX;
+  }
+
+
+  double ElevationModel::originY() const {
+    return m_originY;
+  }
+
+
+  double ElevationModel::spacing() const {
+    return m_spacing;
+  }
+
+
+  double ElevationModel::maximumHeight() const {
+    return m_maximumHeight;
+  }
+
+
+  /**
+   * @return double Returns the height of a cell.
+   */
+  double ElevationModel::height(int64_t line, int64_t sample) const {
+    return m_heights[size_t(line) * size_t(m_samples) + size_t(sample)];
+  }
+
+
+  /**
+   * Interpolates the height bilinearly at a position.
+   *
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   *
+   * @return double Returns the height, or NaN outside the grid.
+   */
+  double ElevationModel::height(double x, double y) const {
+    double column = (x - m_originX) / m_spacing;
+    double row = (y - m_originY) / m_spacing;
+    if (!(column >= 0.0 && column <= m_samples - 1 && row >= 0.0 && row <= m_lines - 1)) {
+      return NAN;
+    }
+    int64_t left = std::min<int64_t>(int64_t(column), m_samples - 2);
+    int64_t top = std::min<int64_t>(int64_t(row), m_lines - 2);
+    double u = column - left;
+    double v = row - top;
+    const double *upper = &m_heights[size_t(top) * size_t(m_samples) + size_t(left)];
+    const double *lower = upper + m_samples;
+    return (1.0 - v) * ((1.0 - u) * upper[0] + u * upper[1])
+           + v * ((1.0 - u) * lower[0] + u * lower[1]);
+  }
+
+
+  /**
+   * Precomputes the horizon maps of an elevation model. Each cell marches outwards, one cell
+   * spacing per step, along every azimuth until it leaves the DEM, so the cost is about
+   * cells * azimuths * (DEM size in cells); it is paid once per DEM.
+   *
+   * @param elevation The elevation model. It is shared, not copied.
+   * @param azimuths Number of horizon directions per cell, evenly spaced from azimuth 0 (+x)
+   *                 counterclockwise towards +y.
+   *
+   * @throws std::invalid_argument If the elevation model is missing or azimuths < 4.
+   */
+  TerrainVisibility::TerrainVisibility(const std::shared_ptr<const ElevationModel> &elevation,
+                                       int azimuths)
+      : m_elevation(elevation), m_azimuths(azimuths) {
+    if (!elevation || azimuths < 4) {
+      throw std::invalid_argument("Terrain visibility needs an elevation model and at least 4 "
+                                  "azimuths");
+    }
+
+    const ElevationModel &dem = *m_elevation;
+    double spacing = dem.spacing();
+    m_horizons.resize(size_t(dem.lines()) * size_t(dem.samples()) * azimuths);
+    std::vector<double> cosines(azimuths), sines(azimuths);
+    for (int azimuth = 0; azimuth < azimuths; azimuth++) {
+      cosines[azimuth] = std::cos(2.0 * M_PI * azimuth / azimuths);
+      sines[azimuth] = std::sin(2.0 * M_PI * azimuth / azimuths);
+    }
+
+    float *horizon = m_horizons.data();
+    for (int64_t line = 0; line < dem.lines(); line++) {
+      double y = dem.originY() + line * spacing;
+      for (int64_t sample = 0; sample < dem.samples(); sample++) {
+        double x = dem.originX() + sample * spacing;
+        double base = dem.height(line, sample);
+        for (int azimuth = 0; azimuth < azimuths; azimuth++, horizon++) {
+          double slope = -std::numeric_limits<double>::infinity();
+          for (int64_t step = 1;; step++) {
+            double distance = step * spacing;
+            double height = dem.height(x + distance * cosines[azimuth],
+                                       y + distance * sines[azimuth]);
+            if (std::isnan(height)) {
+              break;
+            }
+            slope = std::max(slope, (height - base) / distance);
+            // Nothing further away can rise above the current horizon.
+            if ((dem.maximumHeight() - base) / distance <= slope) {
+              break;
+            }
+          }
+          *horizon = float(slope);
+        }
+      }
+    }
+  }
+
+
+  int TerrainVisibility::azimuths() const {
+    return m_azimuths;
+  }
+
+
+  const ElevationModel &TerrainVisibility::elevation() const {
+    return *m_elevation;
+  }
+
+
+  /**
+   * Returns the slope (tangent of the elevation angle) of the horizon seen from a cell,
+   * interpolated linearly between the two nearest precomputed azimuths.
+   *
+   * @param line DEM line.
+   * @param sample DEM sample.
+   * @param azimuth Direction in radians from +x towards +y.
+   *
+   * @return double Returns the horizon slope, or -infinity if the terrain in that direction
+   *                never rises into view before the edge of the DEM.
+   */
+  double TerrainVisibility::horizonSlope(int64_t line, int64_t sample, double azimuth) const {
+    double position = azimuth / (2.0 * M_PI) * m_azimuths;
+    position -= std::floor(position / m_azimuths) * m_azimuths;
+    int first = std::min(int(position), m_azimuths - 1);
+    int second = (first + 1) % m_azimuths;
+    double weight = position - first;
+
+    const float *horizons = &m_horizons[(size_t(line) * size_t(m_elevation->samples())
+                                         + size_t(sample)) * m_azimuths];
+    double firstSlope = horizons[first], secondSlope = horizons[second];
+    if (std::isinf(firstSlope) || std::isinf(secondSlope)) {
+      return weight < 0.5 ? firstSlope : secondSlope;
+    }
+    return (1.0 - weight) * firstSlope + weight * secondSlope;
+  }
+
+
+  /**
+   * @param point A point on the DEM.
+   * @param illuminatorDirection Direction from the surface towards the illuminator (a distant
+   *                             source such as the sun).
+   *
+   * @return bool Returns true if the terrain hides the illuminator from the point. Points off
+   *              the DEM are never shadowed.
+   */
+  bool TerrainVisibility::isShadowed(const CartesianPoint &point,
+                                     const CartesianVector &illuminatorDirection) const {
+    int64_t line, sample;
+    if (!nearestCell(point.x, point.y, line, sample)) {
+      return false;
+    }
+    return !aboveHorizon(line, sample, illuminatorDirection.x, illuminatorDirection.y,
+                         illuminatorDirection.z);
+  }
+
+
+  /**
+   * @param point A point on the DEM.
+   * @param observerPosition The observer, in the DEM frame.
+   *
+   * @return bool Returns true if the terrain does not hide the point from the observer. Points
+   *              off the DEM are always visible.
+   */
+  bool TerrainVisibility::isVisible(const CartesianPoint &point,
+                                    const CartesianPoint &observerPosition) const {
+    int64_t line, sample;
+    if (!nearestCell(point.x, point.y, line, sample)) {
+      return true;
+    }
+    const ElevationModel &dem = *m_elevation;
+    return aboveHorizon(line, sample,
+                        observerPosition.x - (dem.originX() + sample * dem.spacing()),
+                        observerPosition.y - (dem.originY() + line * dem.spacing()),
+                        observerPosition.z - dem.height(line, sample));
+  }
+
+
+  /**
+   * Computes a shadow mask for an array of points with the horizon maps. The illuminator
+   * direction may be given per point (stride 3) or once for all points (stride 0).
+   *
+   * @param points count interleaved (x, y, z) points on the DEM.
+   * @param count Number of points.
+   * @param illuminatorDirections Directions towards the illuminator.
+   * @param illuminatorStride Number of doubles between consecutive directions (3 or 0).
+   * @param shadowed Receives count values: 1 where the point is shadowed, 0 where it is lit.
+   */
+  void TerrainVisibility::shadowMask(const double *points, size_t count,
+                                     const double *illuminatorDirections,
+                                     size_t illuminatorStride, uint8_t *shadowed) const {
+    for (size_t i = 0; i < count; i++) {
+      const double *point = points + 3 * i;
+      const double *direction = illuminatorDirections + i * illuminatorStride;
+      shadowed[i] = isShadowed(CartesianPoint(point[0], point[1], point[2]),
+                               CartesianVector(direction[0], direction[1], direction[2]));
+    }
+  }
+
+
+  /**
+   * Computes a visibility mask for an array of points with the horizon maps. The observer may
+   * be given per point (stride 3) or once for all points (stride 0).
+   *
+   * @param points count interleaved (x, y, z) points on the DEM.
+   * @param count Number of points.
+   * @param observerPositions Observer positions.
+   * @param observerStride Number of doubles between consecutive positions (3 or 0).
+   * @param visible Receives count values: 1 where the point is visible, 0 where it is hidden.
+   */
+  void TerrainVisibility::visibilityMask(const double *points, size_t count,
+                                         const double *observerPositions, size_t observerStride,
+                                         uint8_t *visible) const {
+    for (size_t i = 0; i < count; i++) {
+      const double *point = points + 3 * i;
+      const double *observer = observerPositions + i * observerStride;
+      visible[i] = isVisible(CartesianPoint(point[0], point[1], point[2]),
+                             CartesianPoint(observer[0], observer[1], observer[2]));
+    }
+  }
+
+
+  /**
+   * The exact counterpart of isShadowed: marches the ray towards the illuminator across the
+   * DEM in half-cell steps.
+   */
+  bool TerrainVisibility::rayMarchShadowed(const CartesianPoint &point,
+                                           const CartesianVector &illuminatorDirection) const {
+    int64_t line, sample;
+    if (!nearestCell(point.x, point.y, line, sample)) {
+      return false;
+    }
+    return rayBlocked(line, sample, illuminatorDirection.x, illuminatorDirection.y,
+                      illuminatorDirection.z, std::numeric_limits<double>::infinity());
+  }
+
+
+  /**
+   * The exact counterpart of isVisible: marches the ray towards the observer in half-cell
+   * steps, stopping at the observer, so it is also exact for observers on or near the
+   * terrain.
+   */
+  bool TerrainVisibility::rayMarchVisible(const CartesianPoint &point,
+                                          const CartesianPoint &observerPosition) const {
+    int64_t line, sample;
+    if (!nearestCell(point.x, point.y, line, sample)) {
+      return true;
+    }
+    const ElevationModel &dem = *m_elevation;
+    double dx = observerPosition.x - (dem.originX() + sample * dem.spacing());
+    double dy = observerPosition.y - (dem.originY() + line * dem.spacing());
+    double dz = observerPosition.z - dem.height(line, sample);
+    return !rayBlocked(line, sample, dx, dy, dz, std::sqrt(dx * dx + dy * dy));
+  }
+
+
+  // Finds the DEM cell nearest to a position. Returns false off the DEM.
+  bool TerrainVisibility::nearestCell(double x, double y, int64_t &line, int64_t &sample) const {
+    const ElevationModel &dem = *m_elevation;
+    double column = std::floor((x - dem.originX()) / dem.spacing() + 0.5);
+    double row = std::floor((y - dem.originY()) / dem.spacing() + 0.5);
+    if (!(column >= 0.0 && column < dem.samples() && row >= 0.0 && row < dem.lines())) {
+      return false;
+    }
+    line = int64_t(row);
+    sample = int64_t(column);
+    return true;
+  }
+
+
+  // Whether a direction from a cell points above the cell's horizon.
+  bool TerrainVisibility::aboveHorizon(int64_t line, int64_t sample, double dx, double dy,
+                                       double dz) const {
+    double horizontal = std::sqrt(dx * dx + dy * dy);
+    if (horizontal == 0.0) {
+      return dz > 0.0;
+    }
+    return dz / horizontal > horizonSlope(line, sample, std::atan2(dy, dx));
+  }
+
+
+  // Marches from a cell along a direction until the terrain rises above the ray (blocked),
+  // the ray leaves the DEM or rises above all terrain, or the horizontal distance passes
+  // horizontalLimit.
+  bool TerrainVisibility::rayBlocked(int64_t line, int64_t sample, double dx, double dy,
+                                     double dz, double horizontalLimit) const {
+    const ElevationModel &dem = *m_elevation;
+    double horizontal = std::sqrt(dx * dx + dy * dy);
+    if (horizontal == 0.0) {
+      return dz <= 0.0;
+    }
+    double x = dem.originX() + sample * dem.spacing();
+    double y = dem.originY() + line * dem.spacing();
+    double base = dem.height(line, sample);
+    double slope = dz / horizontal;
+    double step = 0.5 * dem.spacing();
+
+    for (int64_t n = 1;; n++) {
+      double distance = n * step;
+      if (distance > horizontalLimit) {
+        return false;
+      }
+      double rayHeight = base + distance * slope;
+      if (slope >= 0.0 && rayHeight > dem.maximumHeight()) {
+        return false;
+      }
+      double height = dem.height(x + distance * dx / horizontal, y + distance * dy / horizontal);
+      if (std::isnan(height)) {
+        return false;
+      }
+      if (height > rayHeight) {
+        return true;
+      }
+    }
+  }
+}
@@ -0,0 +1,732 @@
+#include "SkyIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace skyindex {
+
+  namespace {
+
+    // Ring number of the southernmost corner of each base pixel, in units of nside.
+    const int jrll[12] = { 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4 };
+    // Longitude index of the center of each base pixel, in units of pi/4.
+    const int jpll[12] = { 1, 3, 5, 7, 0, 2, 4, 6, 1, 3, 5, 7 };
+
+    // Neighbor offsets in (x, y) face coordinates, ordered SW, W, NW, N, NE, E, SE, S.
+    const int nbXOffset[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+    const int nbYOffset[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+    // Base pixel across each edge/corner of a face, indexed by direction then face.
+    const int nbFaceArray[9][12] = {
+      { 8, 9, 10, 11, -1, -1, -1, -1, 10, 11, 8, 9 },  // S
+      { 5, 6, 7, 4, 8, 9, 10, 11, 9, 10, 11, 8 },      // SE
+      { -1, -1, -1, -1, 5, 6, 7, 4, -1, -1, -1, -1 },  // E
+      { 4, 5, 6, 7, 11, 8, 9, 10, 11, 8, 9, 10 },      // SW
+      { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },        // center
+      { 1, 2, 3, 0, 0, 1, 2, 3, 5, 6, 7, 4 },          // NE
+      { -1, -1, -1, -1, 7, 4, 5, 6, -1, -1, -1, -1 },  // W
+      { 3, 0, 1, 2, 3, 0, 1, 2, 4, 5, 6, 7 },          // NW
+      { 2, 3, 0, 1, -1, -1, -1, -1, 0, 1, 2, 3 }       // N
+    };
+
+    // Coordinate flips needed when crossing onto a neighboring face (1: x, 2: y, 4: swap).
+    const int nbSwapArray[9][3] = {
+      { 0, 0, 3 }, { 0, 0, 6 }, { 0, 0, 0 }, { 0, 0, 5 }, { 0, 0, 0 },
+      { 5, 0, 0 }, { 0, 0, 0 }, { 6, 0, 0 }, { 3, 0, 0 }
+    };
+
+    const char fileMagic[8] = { 'S', 'K', 'Y', 'I', 'D', 'X', '\0', '\1' };
+    const uint32_t fileVersion = 1;
+    const uint32_t byteOrderMark = 0x01020304;
+
+    /**
+     * Fixed-size header at the start of an index file. Every array that follows is 8-byte
+     * aligned because the header is a multiple of 8 bytes long.
+     */
+    struct FileHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t byteOrder;
+      uint32_t order;
+      uint32_t reserved;
+      uint64_t count;
+    };
+
+
+    // Interleaves the low 32 bits of v with zeros: ...b2b1b0 -> ...0b20b10b0.
+    int64_t spreadBits(int64_t v) {
+      uint64_t x = uint64_t(v) & 0xffffffffULL;
+      x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+      x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+      x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+      x = (x | (x << 2)) & 0x3333333333333333ULL;
+      x = (x | (x << 1)) & 0x5555555555555555ULL;
+      return int64_t(x);
+    }
+
+
+    // Inverse of spreadBits: collects every even bit of v.
+    int64_t compressBits(int64_t v) {
+      uint64_t x = uint64_t(v) & 0x5555555555555555ULL;
+      x = (x | (x >> 1)) & 0x3333333333333333ULL;
+      x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+      x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+      x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+      x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+      return int64_t(x);
+    }
+
+
+    int64_t xyfToNest(int64_t ix, int64_t iy, int face, int order) {
+      return (int64_t(face) << (2 * order)) + spreadBits(ix) + (spreadBits(iy) << 1);
+    }
+
+
+    void nestToXyf(int64_t pixel, int order, int64_t &ix, int64_t &iy, int &face) {
+      int64_t facePixels = int64_t(1) << (2 * order);
+      face = int(pixel >> (2 * order));
+      int64_t local = pixel & (facePixels - 1);
+      ix = compressBits(local);
+      iy = compressBits(local >> 1);
+    }
+
+
+    // Numerically robust angle between two vectors (does not lose precision near 0 or pi).
+    double angleBetween(const CartesianVector &a, const CartesianVector &b) {
+      double cx = a.y * b.z - a.z * b.y;
+      double cy = a.z * b.x - a.x * b.z;
+      double cz = a.x * b.y - a.y * b.x;
+      double cross = std::sqrt(cx * cx + cy * cy + cz * cz);
+      return std::atan2(cross, a.x * b.x + a.y * b.y + a.z * b.z);
+    }
+
+
+    CartesianVector unit(const CartesianVector &v) {
+      double length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+      if (length <= 0.0) {
+        return CartesianVector();
+      }
+      return CartesianVector(v.x / length, v.y / length, v.z / length);
+    }
+
+
+    void checkOrder(int order) {
+      if (order < 0 || order > MAX_ORDER) {
+        throw std::invalid_argument("Sky index order must be between 0 and "
+                                    + std::to_string(MAX_ORDER));
+      }
+    }
+  }
+
+
+  /**
+   * Computes the number of pixels covering the sphere at a given order.
+   *
+   * @param order Subdivision order; each order splits every pixel into four.
+   *
+   * @return int64_t Returns 12 * 4^order.
+   */
+  int64_t pixelCount(int order) {
+    return int64_t(12) << (2 * order);
+  }
+
+
+  /**
+   * Computes the largest angular distance between a pixel center and any point of that pixel
+   * at a given order. Used to decide conservatively whether a pixel can intersect a cone.
+   *
+   * @param order Subdivision order.
+   *
+   * @return double Returns the maximum pixel radius in radians.
+   */
+  double maxPixelRadius(int order) {
+    double nside = double(int64_t(1) << order);
+    double phi = M_PI / (4.0 * nside);
+    double z = 2.0 / 3.0;
+    double s = std::sqrt((1.0 - z) * (1.0 + z));
+    CartesianVector va(s * std::cos(phi), s * std::sin(phi), z);
+
+    double t = 1.0 - 1.0 / nside;
+    t *= t;
+    double zb = 1.0 - t / 3.0;
+    CartesianVector vb(std::sqrt((1.0 - zb) * (1.0 + zb)), 0.0, zb);
+    return angleBetween(va, vb);
+  }
+
+
+  /**
+   * Finds the nested-scheme pixel containing a direction. The direction does not need to be
+   * normalized.
+   *
+   * @param direction The direction to locate, e.g. a look vector in J2000.
+   * @param order Subdivision order.
+   *
+   * @return int64_t Returns the pixel number in [0, pixelCount(order)).
+   *
+   * @throws std::invalid_argument If a component of the direction is NaN or infinite.
+   */
+  int64_t vectorToPixel(const CartesianVector &direction, int order) {
+    checkOrder(order);
+    if (!std::isfinite(direction.x) || !std::isfinite(direction.y)
+        || !std::isfinite(direction.z)) {
+      throw std::invalid_argument("Sky index directions must be finite");
+    }
+    int64_t nside = int64_t(1) << order;
+    double equatorial = std::hypot(direction.x, direction.y);
+    double length = std::hypot(equatorial, direction.z);
+    if (length <= 0.0) {
+      return 0;
+    }
+    double z = direction.z / length;
+    double sinTheta = equatorial / length;
+    double phi = std::atan2(direction.y, direction.x);
+
+    double za = std::fabs(z);
+    double tt = std::fmod(phi / M_PI_2, 4.0);
+    if (tt < 0.0) {
+      tt += 4.0;
+    }
+
+    // Equatorial region
+    if (za <= 2.0 / 3.0) {
+      double temp1 = nside * (0.5 + tt);
+      double temp2 = nside * (z * 0.75);
+      int64_t jp = int64_t(temp1 - temp2);  // index of ascending edge line
+      int64_t jm = int64_t(temp1 + temp2);  // index of descending edge line
+      int64_t ifp = jp >> order;
+      int64_t ifm = jm >> order;
+      int face = int((ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : (ifm + 8)));
+      int64_t ix = jm & (nside - 1);
+      int64_t iy = nside - (jp & (nside - 1)) - 1;
+      return xyfToNest(ix, iy, face, order);
+    }
+
+    // Polar caps
+    int ntt = std::min(3, int(tt));
+    double tp = tt - ntt;
+    double tmp = (za < 0.99) ? nside * std::sqrt(3.0 * (1.0 - za))
+                             : nside * sinTheta / std::sqrt((1.0 + za) / 3.0);
+    int64_t jp = std::min(int64_t(tp * tmp), nside - 1);
+    int64_t jm = std::min(int64_t((1.0 - tp) * tmp), nside - 1);
+    if (z > 0.0) {
+      return xyfToNest(nside - jm - 1, nside - jp - 1, ntt, order);
+    }
+    return xyfToNest(jp, jm, ntt + 8, order);
+  }
+
+
+  /**
+   * Computes the unit vector through the center of a pixel.
+   *
+   * @param pixel Nested-scheme pixel number.
+   * @param order Subdivision order.
+   *
+   * @return CartesianVector Returns the unit vector at the pixel center.
+   */
+  CartesianVector pixelToVector(int64_t pixel, int order) {
+    checkOrder(order);
+    int64_t nside = int64_t(1) << order;
+    double fact2 = 4.0 / double(pixelCount(order));
+    double fact1 = double(nside << 1) * fact2;
+
+    int64_t ix, iy;
+    int face;
+    nestToXyf(pixel, order, ix, iy, face);
+
+    int64_t jr = (int64_t(jrll[face]) << order) - ix - iy - 1;
+    int64_t nr;
+    double z;
+    double sinTheta = -1.0;
+    if (jr < nside) {
+      nr = jr;
+      double tmp = double(nr * nr) * fact2;
+      z = 1.0 - tmp;
+      if (z > 0.99) {
+        sinTheta = std::sqrt(tmp * (2.0 - tmp));
+      }
+    }
+    else if (jr > 3 * nside) {
+      nr = nside * 4 - jr;
+      double tmp = double(nr * nr) * fact2;
+      z = tmp - 1.0;
+      if (z < -0.99) {
+        sinTheta = std::sqrt(tmp * (2.0 - tmp));
+      }
+    }
+    else {
+      nr = nside;
+      z = double(2 * nside - jr) * fact1;
+    }
+
+    int64_t tmp = int64_t(jpll[face]) * nr + ix - iy;
+    if (tmp < 0) {
+      tmp += 8 * nr;
+    }
+    double phi = (nr == nside) ? 0.75 * M_PI_2 * double(tmp) * fact1
+                               : (0.5 * M_PI_2 * double(tmp)) / double(nr);
+    if (sinTheta < 0.0) {
+      sinTheta = std::sqrt((1.0 - z) * (1.0 + z));
+    }
+    return CartesianVector(sinTheta * std::cos(phi), sinTheta * std::sin(phi), z);
+  }
+
+
+  /**
+   * Finds the (up to) eight pixels adjacent to a pixel.
+   *
+   * The neighbors are returned in the order SW, W, NW, N, NE, E, SE, S. A handful of pixels
+   * at the corners of the base faces only have seven neighbors; the missing entry is -1.
+   *
+   * @param pixel Nested-scheme pixel number.
+   * @param order Subdivision order.
+   * @param result Receives the eight neighbor pixel numbers.
+   */
+  void neighbors(int64_t pixel, int order, int64_t result[8]) {
+    checkOrder(order);
+    int64_t nside = int64_t(1) << order;
+    int64_t ix, iy;
+    int face;
+    nestToXyf(pixel, order, ix, iy, face);
+
+    if (ix > 0 && ix < nside - 1 && iy > 0 && iy < nside - 1) {
+      for (int m = 0; m < 8; m++) {
+        result[m] = xyfToNest(ix + nbXOffset[m], iy + nbYOffset[m], face, order);
+      }
+      return;
+    }
+
+    for (int i = 0; i < 8; i++) {
+      int64_t x = ix + nbXOffset[i];
+      int64_t y = iy + nbYOffset[i];
+      int direction = 4;
+      if (x < 0) {
+        x += nside;
+        direction -= 1;
+      }
+      else if (x >= nside) {
+        x -= nside;
+        direction += 1;
+      }
+      if (y < 0) {
+        y += nside;
+        direction -= 3;
+      }
+      else if (y >= nside) {
+        y -= nside;
+        direction += 3;
+      }
+
+      int neighborFace = nbFaceArray[direction][face];
+      if (neighborFace < 0) {
+        result[i] = -1;
+        continue;
+      }
+      int bits = nbSwapArray[direction][face >> 2];
+      if (bits & 1) {
+        x = nside - x - 1;
+      }
+      if (bits & 2) {
+        y = nside - y - 1;
+      }
+      if (bits & 4) {
+        std::swap(x, y);
+      }
+      result[i] = xyfToNest(x, y, neighborFace, order);
+    }
+  }
+
+
+  /**
+   * Converts a right ascension and declination (the output of computeRADec) to a unit vector.
+   *
+   * @param rightAscension Right ascension in radians.
+   * @param declination Declination in radians.
+   *
+   * @return CartesianVector Returns the unit look direction.
+   */
+  CartesianVector raDecToVector(double rightAscension, double declination) {
+    return CartesianVector(std::cos(declination) * std::cos(rightAscension),
+                           std::cos(declination) * std::sin(rightAscension),
+                           std::sin(declination));
+  }
+
+
+  /**
+   * Creates an empty index.
+   */
+  SkyIndex::SkyIndex() : m_order(0), m_size(0), m_pixels(NULL), m_directions(NULL),
+                         m_ids(NULL), m_mapping(NULL), m_mappingSize(0) {
+  }
+
+
+  /**
+   * Builds an index in memory from a list of catalog entries.
+   *
+   * The order sets the depth of the pixelization used to sort the catalog; a good choice
+   * puts a few entries in each pixel (order 6 has ~50000 pixels of ~0.9 degrees).
+   *
+   * @param entries The catalog to index.
+   * @param order Subdivision order used to sort the catalog.
+   *
+   * @throws std::invalid_argument If the order is out of range or an entry has a NaN or
+   *                               infinite right ascension or declination.
+   */
+  SkyIndex::SkyIndex(const std::vector<CatalogEntry> &entries, int order)
+      : m_order(order), m_size(entries.size()), m_pixels(NULL), m_directions(NULL),
+        m_ids(NULL), m_mapping(NULL), m_mappingSize(0) {
+    checkOrder(order);
+
+    std::vector<std::pair<int64_t, size_t> > keys(entries.size());
+    std::vector<CartesianVector> directions(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (!std::isfinite(entries[i].rightAscension) || !std::isfinite(entries[i].declination)) {
+        throw std::invalid_argument("Catalog entry " + std::to_string(entries[i].id)
+                                    + " has a non-finite position");
+      }
+      directions[i] = raDecToVector(entries[i].rightAscension, entries[i].declination);
+      keys[i] = std::make_pair(vectorToPixel(directions[i], order), i);
+    }
+    // Sorting on (pixel, input position) keeps the layout deterministic.
+    std::sort(keys.begin(), keys.end());
+
+    m_pixelStorage.resize(m_size);
+    m_directionStorage.resize(3 * m_size);
+    m_idStorage.resize(m_size);
+    for (size_t i = 0; i < m_size; i++) {
+      size_t source = keys[i].second;
+      m_pixelStorage[i] = keys[i].first;
+      m_directionStorage[3 * i] = directions[source].x;
+      m_directionStorage[3 * i + 1] = directions[source].y;
+      m_directionStorage[3 * i + 2] = directions[source].z;
+      m_idStorage[i] = entries[source].id;
+    }
+
+    m_pixels = m_pixelStorage.data();
+    m_directions = m_directionStorage.data();
+    m_ids = m_idStorage.data();
+  }
+
+
+  SkyIndex::~SkyIndex() {
+    release();
+  }
+
+
+  SkyIndex::SkyIndex(SkyIndex &&other)
+      : m_order(other.m_order), m_size(other.m_size),
+        m_pixelStorage(std::move(other.m_pixelStorage)),
+        m_directionStorage(std::move(other.m_directionStorage)),
+        m_idStorage(std::move(other.m_idStorage)),
+        m_pixels(other.m_pixels), m_directions(other.m_directions), m_ids(other.m_ids),
+        m_mapping(other.m_mapping), m_mappingSize(other.m_mappingSize) {
+    other.m_size = 0;
+    other.m_pixels = NULL;
+    other.m_directions = NULL;
+    other.m_ids = NULL;
+    other.m_mapping = NULL;
+    other.m_mappingSize = 0;
+  }
+
+
+  SkyIndex &SkyIndex::operator=(SkyIndex &&other) {
+    if (this != &other) {
+      release();
+      m_order = other.m_order;
+      m_size = other.m_size;
+      m_pixelStorage = std::move(other.m_pixelStorage);
+      m_directionStorage = std::move(other.m_directionStorage);
+      m_idStorage = std::move(other.m_idStorage);
+      m_pixels = other.m_pixels;
+      m_directions = other.m_directions;
+      m_ids = other.m_ids;
+      m_mapping = other.m_mapping;
+      m_mappingSize = other.m_mappingSize;
+      other.m_size = 0;
+      other.m_pixels = NULL;
+      other.m_directions = NULL;
+      other.m_ids = NULL;
+      other.m_mapping = NULL;
+      other.m_mappingSize = 0;
+    }
+    return *this;
+  }
+
+
+  void SkyIndex::release() {
+    if (m_mapping) {
+      munmap(m_mapping, m_mappingSize);
+      m_mapping = NULL;
+      m_mappingSize = 0;
+    }
+  }
+
+
+  /**
+   * Maps an index file written by save() into memory. The file is mapped read-only and is
+   * paged in lazily, so startup cost does not depend on the catalog size.
+   *
+   * @param path Path of the index file.
+   *
+   * @return SkyIndex Returns an index viewing the mapped file.
+   *
+   * @throws std::runtime_error If the file can not be mapped or is not a valid index.
+   */
+  SkyIndex SkyIndex::load(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Unable to open sky index [" + path + "]");
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(FileHeader)) {
+      close(fd);
+      throw std::runtime_error("Sky index [" + path + "] is truncated");
+    }
+    size_t fileSize = size_t(info.st_size);
+    void *mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      throw std::runtime_error("Unable to map sky index [" + path + "]");
+    }
+
+    const FileHeader *header = static_cast<const FileHeader *>(mapping);
+    uint64_t count = header->count;
+    const size_t entryBytes = 2 * sizeof(int64_t) + 3 * sizeof(double);
+    // The count is checked against the file before multiplying, so a corrupt count can not
+    // wrap the expected size around to the file size.
+    bool sized = count <= (fileSize - sizeof(FileHeader)) / entryBytes
+                 && fileSize == sizeof(FileHeader) + size_t(count) * entryBytes;
+    if (std::memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0
+        || header->version != fileVersion || header->byteOrder != byteOrderMark
+        || header->order > uint32_t(MAX_ORDER) || !sized) {
+      munmap(mapping, fileSize);
+      throw std::runtime_error("[" + path + "] is not a valid sky index");
+    }
+
+    SkyIndex index;
+    index.m_order = int(header->order);
+    index.m_size = size_t(count);
+    const char *data = static_cast<const char *>(mapping) + sizeof(FileHeader);
+    index.m_pixels = reinterpret_cast<const int64_t *>(data);
+    index.m_directions = reinterpret_cast<const double *>(data + count * sizeof(int64_t));
+    index.m_ids = reinterpret_cast<const uint64_t *>(data + count * (sizeof(int64_t) + 3 * sizeof(double)));
+    index.m_mapping = mapping;
+    index.m_mappingSize = fileSize;
+    return index;
+  }
+
+
+  /**
+   * Writes the index in the layout expected by load().
+   *
+   * @param path Path of the file to create or overwrite.
+   *
+   * @throws std::runtime_error If the file can not be written.
+   */
+  void SkyIndex::save(const std::string &path) const {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = fileVersion;
+    header.byteOrder = byteOrderMark;
+    header.order = uint32_t(m_order);
+    header.count = m_size;
+
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(m_pixels), m_size * sizeof(int64_t));
+    file.write(reinterpret_cast<const char *>(m_directions), 3 * m_size * sizeof(double));
+    file.write(reinterpret_cast<const char *>(m_ids), m_size * sizeof(uint64_t));
+    if (!file) {
+      throw std::runtime_error("Unable to write sky index [" + path + "]");
+    }
+  }
+
+
+  int SkyIndex::order() const {
+    return m_order;
+  }
+
+
+  size_t SkyIndex::size() const {
+    return m_size;
+  }
+
+
+  int64_t SkyIndex::pixel(size_t index) const {
+    return m_pixels[index];
+  }
+
+
+  CartesianVector SkyIndex::direction(size_t index) const {
+    return CartesianVector(m_directions[3 * index], m_directions[3 * index + 1],
+                           m_directions[3 * index + 2]);
+  }
+
+
+  uint64_t SkyIndex::id(size_t index) const {
+    return m_ids[index];
+  }
+
+
+  /**
+   * Finds every entry within an angular radius of a look direction.
+   *
+   * @param center The look direction; does not need to be normalized.
+   * @param radius Cone half-angle in radians.
+   * @param matches Receives the positions (see pixel(), direction(), id()) of the matching
+   *                entries in index order.
+   */
+  void SkyIndex::coneSearch(const CartesianVector &center, double radius,
+                            std::vector<size_t> &matches) const {
+    matches.clear();
+    std::vector<int64_t> ranges;
+    appendMatches(unit(center), radius, ranges, matches);
+  }
+
+
+  /**
+   * Runs a cone search around each of several look directions.
+   *
+   * Queries are processed in pixel order so that neighboring look directions reuse the same
+   * parts of the catalog, and results are returned in compressed-row form: the matches for
+   * centers[i] are matches[offsets[i]] .. matches[offsets[i + 1] - 1].
+   *
+   * @param centers The look directions.
+   * @param count Number of look directions.
+   * @param radius Cone half-angle in radians, shared by every query.
+   * @param offsets Receives count + 1 offsets into matches.
+   * @param matches Receives the positions of the matching entries.
+   *
+   * @throws std::invalid_argument If a look direction has a NaN or infinite component.
+   */
+  void SkyIndex::coneSearch(const CartesianVector *centers, size_t count, double radius,
+                            std::vector<size_t> &offsets, std::vector<size_t> &matches) const {
+    std::vector<std::pair<int64_t, size_t> > queryOrder(count);
+    for (size_t i = 0; i < count; i++) {
+      queryOrder[i] = std::make_pair(vectorToPixel(centers[i], m_order), i);
+    }
+    std::sort(queryOrder.begin(), queryOrder.end());
+
+    // Gather results in traversal order, then scatter them back into query order.
+    std::vector<size_t> found;
+    std::vector<size_t> foundStart(count + 1, 0);
+    std::vector<size_t> foundCount(count, 0);
+    std::vector<int64_t> ranges;
+    for (size_t i = 0; i < count; i++) {
+      size_t query = queryOrder[i].second;
+      size_t before = found.size();
+      appendMatches(unit(centers[query]), radius, ranges, found);
+      foundStart[query] = before;
+      foundCount[query] = found.size() - before;
+    }
+
+    offsets.assign(count + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+      offsets[i + 1] = offsets[i] + foundCount[i];
+    }
+    matches.resize(found.size());
+    for (size_t i = 0; i < count; i++) {
+      std::copy(found.begin() + foundStart[i], found.begin() + foundStart[i] + foundCount[i],
+                matches.begin() + offsets[i]);
+    }
+  }
+
+
+  /**
+   * Collects the pixel ranges (at the index order) that may hold entries inside a cone.
+   *
+   * The base pixels are refined hierarchically, discarding any pixel whose bounding circle
+   * misses the cone, and stopping early once a pixel is entirely inside the cone or small
+   * compared to the cone. Ranges are emitted as [begin, end, inside] triples in ascending
+   * pixel order, with adjacent ranges of the same kind merged.
+   */
+  void SkyIndex::searchRanges(const CartesianVector &center, double radius,
+                              std::vector<int64_t> &ranges) const {
+    ranges.clear();
+
+    int depthLimit = 0;
+    while (depthLimit < m_order && maxPixelRadius(depthLimit) > 0.25 * radius) {
+      depthLimit++;
+    }
+
+    std::vector<std::pair<int64_t, int> > stack;
+    for (int face = 11; face >= 0; face--) {
+      stack.push_back(std::make_pair(int64_t(face), 0));
+    }
+    while (!stack.empty()) {
+      int64_t pixel = stack.back().first;
+      int order = stack.back().second;
+      stack.pop_back();
+
+      double pixelRadius = maxPixelRadius(order);
+      double distance = angleBetween(center, pixelToVector(pixel, order));
+      if (distance > radius + pixelRadius) {
+        continue;
+      }
+      bool inside = distance + pixelRadius <= radius;
+      if (inside || order == depthLimit) {
+        int shift = 2 * (m_order - order);
+        int64_t begin = pixel << shift;
+        int64_t end = (pixel + 1) << shift;
+        size_t last = ranges.size();
+        if (last >= 3 && ranges[last - 2] == begin && ranges[last - 1] == int64_t(inside)) {
+          ranges[last - 2] = end;
+        }
+        else {
+          ranges.push_back(begin);
+          ranges.push_back(end);
+          ranges.push_back(int64_t(inside));
+        }
+        continue;
+      }
+      // Push children in reverse so they are visited in ascending pixel order.
+      for (int child = 3; child >= 0; child--) {
+        stack.push_back(std::make_pair(4 * pixel + child, order + 1));
+      }
+    }
+  }
+
+
+  void SkyIndex::appendMatches(const CartesianVector &center, double radius,
+                               std::vector<int64_t> &ranges, std::vector<size_t> &matches) const {
+    if (m_size == 0 || radius < 0.0) {
+      return;
+    }
+    searchRanges(center, radius, ranges);
+
+    double cosRadius = std::cos(std::min(radius, M_PI));
+    const int64_t *first = m_pixels;
+    const int64_t *last = m_pixels + m_size;
+    for (size_t r = 0; r < ranges.size(); r += 3) {
+      // Ranges ascend, so each search can start where the previous one ended.
+      const int64_t *begin = std::lower_bound(first, last, ranges[r]);
+      const int64_t *end = std::lower_bound(begin, last, ranges[r + 1]);
+      first = end;
+      size_t from = size_t(begin - m_pixels);
+      size_t to = size_t(end - m_pixels);
+      if (ranges[r + 2]) {
+        for (size_t i = from; i < to; i++) {
+          matches.push_back(i);
+        }
+        continue;
+      }
+      for (size_t i = from; i < to; i++) {
+        const double *d = m_directions + 3 * i;
+        if (d[0] * center.x + d[1] * center.y + d[2] * center.z >= cosRadius) {
+          matches.push_back(i);
+        }
+      }
+    }
+  }
+}
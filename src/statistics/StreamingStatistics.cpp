@@ -0,0 +1,282 @@
+#include "StreamingStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "Encoding.h"
+
+namespace statistics {
+
+  /**
+   * Creates an empty summary.
+   *
+   * @param histogramMinimum Lower edge of the first histogram bin.
+   * @param histogramMaximum Upper edge of the last histogram bin. Values equal to it are
+   *                         counted in the last bin.
+   * @param bins Number of equal-width histogram bins (0 disables the histogram).
+   *
+   * @throws std::invalid_argument If bins is negative or the range is empty.
+   */
+  StreamingStatistics::StreamingStatistics(double histogramMinimum, double histogramMaximum,
+                                           int bins)
+      : m_histogramMinimum(histogramMinimum), m_histogramMaximum(histogramMaximum),
+        m_binScale(0.0), m_histogram(bins < 0 ? 0 : bins, 0) {
+    if (bins < 0 || (bins > 0 && !(histogramMaximum > histogramMinimum))) {
+      throw std::invalid_argument("Histogram needs a non-negative bin count and a non-empty range");
+    }
+    if (bins > 0) {
+      m_binScale = bins / (histogramMaximum - histogramMinimum);
+    }
+    reset();
+  }
+
+
+  /**
+   * Adds one value to the summary.
+   *
+   * @param value The value to add; NaN and infinite values are counted as invalid, since a
+   *              single infinity would make the mean and variance meaningless for good.
+   */
+  void StreamingStatistics::add(double value) {
+    if (!std::isfinite(value)) {
+      m_invalid++;
+      return;
+    }
+
+    m_count++;
+    m_minimum = std::min(m_minimum, value);
+    m_maximum = std::max(m_maximum, value);
+    double delta = value - m_mean;
+    m_mean += delta / double(m_count);
+    m_m2 += delta * (value - m_mean);
+
+    if (m_histogram.empty()) {
+      return;
+    }
+    if (value < m_histogramMinimum) {
+      m_underflow++;
+    }
+    else if (value > m_histogramMaximum) {
+      m_overflow++;
+    }
+    else {
+      size_t bin = size_t((value - m_histogramMinimum) * m_binScale);
+      m_histogram[std::min(bin, m_histogram.size() - 1)]++;
+    }
+  }
+
+
+  /**
+   * Adds an array of values to the summary.
+   */
+  void StreamingStatistics::add(const double *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      add(values[i]);
+    }
+  }
+
+
+  /**
+   * Adds an array of encoded values to the summary, decoding them one at a time.
+   */
+  void StreamingStatistics::add(const EncodedBuffer &values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      add(values.load(i));
+    }
+  }
+
+
+  /**
+   * Merges another summary into this one, as if its values had been added after the values
+   * already summarized.
+   *
+   * @param other A summary with the same histogram configuration.
+   *
+   * @throws std::invalid_argument If the histogram configurations differ.
+   */
+  void StreamingStatistics::merge(const StreamingStatistics &other) {
+    if (other.m_histogram.size() != m_histogram.size()
+        || other.m_histogramMinimum != m_histogramMinimum
+        || other.m_histogramMaximum != m_histogramMaximum) {
+      throw std::invalid_argument("Can not merge statistics with different histograms");
+    }
+
+    m_invalid += other.m_invalid;
+    if (other.m_count == 0) {
+      return;
+    }
+    if (m_count == 0) {
+      m_count = other.m_count;
+      m_minimum = other.m_minimum;
+      m_maximum = other.m_maximum;
+      m_mean = other.m_mean;
+      m_m2 = other.m_m2;
+    }
+    else {
+      double total = double(m_count + other.m_count);
+      double delta = other.m_mean - m_mean;
+      m_mean += delta * (double(other.m_count) / total);
+      m_m2 += other.m_m2 + delta * delta * (double(m_count) * double(other.m_count) / total);
+      m_count += other.m_count;
+      m_minimum = std::min(m_minimum, other.m_minimum);
+      m_maximum = std::max(m_maximum, other.m_maximum);
+    }
+
+    for (size_t bin = 0; bin < m_histogram.size(); bin++) {
+      m_histogram[bin] += other.m_histogram[bin];
+    }
+    m_underflow += other.m_underflow;
+    m_overflow += other.m_overflow;
+  }
+
+
+  /**
+   * Empties the summary, keeping the histogram configuration.
+   */
+  void StreamingStatistics::reset() {
+    m_count = 0;
+    m_invalid = 0;
+    m_minimum = INFINITY;
+    m_maximum = -INFINITY;
+    m_mean = 0.0;
+    m_m2 = 0.0;
+    std::fill(m_histogram.begin(), m_histogram.end(), 0);
+    m_underflow = 0;
+    m_overflow = 0;
+  }
+
+
+  /**
+   * @return uint64_t Returns the number of valid (finite) values summarized.
+   */
+  uint64_t StreamingStatistics::count() const {
+    return m_count;
+  }
+
+
+  /**
+   * @return uint64_t Returns the number of NaN and infinite values seen.
+   */
+  uint64_t StreamingStatistics::invalidCount() const {
+    return m_invalid;
+  }
+
+
+  /**
+   * @return double Returns the smallest value, or NaN if there are no valid values.
+   */
+  double StreamingStatistics::minimum() const {
+    return m_count ? m_minimum : NAN;
+  }
+
+
+  /**
+   * @return double Returns the largest value, or NaN if there are no valid values.
+   */
+  double StreamingStatistics::maximum() const {
+    return m_count ? m_maximum : NAN;
+  }
+
+
+  /**
+   * @return double Returns the mean, or NaN if there are no valid values.
+   */
+  double StreamingStatistics::mean() const {
+    return m_count ? m_mean : NAN;
+  }
+
+
+  /**
+   * @return double Returns the sample variance (n - 1 denominator), or NaN with fewer than two
+   *                valid values.
+   */
+  double StreamingStatistics::variance() const {
+    return m_count > 1 ? m_m2 / double(m_count - 1) : NAN;
+  }
+
+
+  /**
+   * @return double Returns the sample standard deviation, or NaN with fewer than two valid
+   *                values.
+   */
+  double StreamingStatistics::standardDeviation() const {
+    return std::sqrt(variance());
+  }
+
+
+  int StreamingStatistics::bins() const {
+    return int(m_histogram.size());
+  }
+
+
+  double StreamingStatistics::histogramMinimum() const {
+    return m_histogramMinimum;
+  }
+
+
+  double StreamingStatistics::histogramMaximum() const {
+    return m_histogramMaximum;
+  }
+
+
+  /**
+   * @param bin A histogram bin.
+   *
+   * @return double Returns the lower edge of the bin.
+   */
+  double StreamingStatistics::binMinimum(int bin) const {
+    return m_histogramMinimum + bin * (m_histogramMaximum - m_histogramMinimum) / bins();
+  }
+
+
+  const std::vector<uint64_t> &StreamingStatistics::histogram() const {
+    return m_histogram;
+  }
+
+
+  /**
+   * Estimates a quantile from the histogram. The value returned is the upper edge of the bin
+   * in which the requested fraction of the valid values is reached, so it overestimates by at
+   * most one bin width; values outside the histogram range resolve to the minimum or maximum.
+   *
+   * @param fraction The fraction of valid values, in [0, 1] (e.g. 0.99 for the 99th
+   *                 percentile).
+   *
+   * @return double Returns the estimated quantile, or NaN if there are no valid values.
+   */
+  double StreamingStatistics::quantile(double fraction) const {
+    if (m_count == 0) {
+      return NAN;
+    }
+    double target = std::max(1.0, std::ceil(fraction * m_count));
+    double seen = double(m_underflow);
+    if (seen >= target) {
+      return m_minimum;
+    }
+    for (int bin = 0; bin < bins(); bin++) {
+      seen += double(m_histogram[bin]);
+      if (seen >= target) {
+        return std::min(binMinimum(bin + 1), m_maximum);
+      }
+    }
+    return m_maximum;
+  }
+
+
+  /**
+   * @return uint64_t Returns the number of values below the histogram range.
+   */
+  uint64_t StreamingStatistics::underflow() const {
+    return m_underflow;
+  }
+
+
+  /**
+   * @return uint64_t Returns the number of values above the histogram range.
+   */
+  uint64_t StreamingStatistics::overflow() const {
+    return m_overflow;
+  }
+}
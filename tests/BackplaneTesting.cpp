@@ -0,0 +1,312 @@
+#include "Backplane.h"
+#include "TiledBackplane.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Encoding.h"
+#include "sensorcore.h"
+#include "Sensor.h"
+#include "SensorModelFixtures.h"
+#include "ThreadPool.h"
+#include "Traversal.h"
+
+using namespace backplane;
+
+TEST(evaluate, matchesSensor) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  std::vector<double> values(4 * 5);
+  evaluate(sensor, Emission, 0, 10, 20, 4, 5, values.data());
+  for (int line = 0; line < 4; line++) {
+    for (int sample = 0; sample < 5; sample++) {
+      ImagePoint center(20 + sample + 0.5, 10 + line + 0.5, 1.0);
+      EXPECT_DOUBLE_EQ(sensor.emissionAngle(center), values[line * 5 + sample]);
+    }
+  }
+}
+
+
+TEST(evaluate, coarseLevelSamplesBlockCenters) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  double value;
+  // Level 2 pixel (3, 4) covers full-resolution lines 12-15 and samples 16-19.
+  evaluate(sensor, Phase, 2, 3, 4, 1, 1, &value);
+  EXPECT_DOUBLE_EQ(sensor.phaseAngle(ImagePoint(18.0, 14.0, 1.0)), value);
+}
+
+
+TEST(compute, matchesGenerate) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 50, 70, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  PyramidBuffer reference;
+  generate(sensor, Incidence, 50, 70, 1, Direct, reference);
+
+  execution::ThreadPool pool(3, execution::NoPinning);
+  execution::FirstTouchBuffer<double> values(pool, 50, 70, 9);
+  compute(sensor, Incidence, 50, 70, EncodedBuffer(values.data()), pool, 9);
+  ASSERT_EQ(reference.levels[0].size(), values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    EXPECT_EQ(reference.levels[0][i], values.data()[i]);
+  }
+
+  std::vector<uint16_t> codes(50 * 70);
+  compute(sensor, Incidence, 50, 70, EncodedBuffer(Encoding::AngleFixed16, codes.data()), pool);
+  for (size_t i = 0; i < codes.size(); i++) {
+    EXPECT_EQ(encodeAngle(reference.levels[0][i]), codes[i]);
+  }
+}
+
+
+TEST(compute, followsSchedule) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 50, 70, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  PyramidBuffer reference;
+  generate(sensor, Phase, 50, 70, 1, Direct, reference);
+
+  execution::ThreadPool pool(3, execution::NoPinning);
+  execution::TraversalSchedule schedule(model, 50, 70, 16, execution::planetocentricTiles(5.0));
+  std::vector<double> values(50 * 70, -1.0);
+  compute(sensor, Phase, schedule, values.data(), pool);
+  for (size_t i = 0; i < values.size(); i++) {
+    EXPECT_EQ(reference.levels[0][i], values[i]);
+  }
+  EXPECT_THROW(compute(sensor, Phase, schedule, values.data(), pool, -1),
+               std::invalid_argument);
+}
+
+
+TEST(TiledBackplane, dimensions) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 1000, 700, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 0.0, 0.0));
+  TiledBackplane backplane(sensor, 1000, 700, 128, 1 << 20, false);
+  EXPECT_EQ(4, backplane.levels());
+  EXPECT_EQ(8, backplane.tileLines(0));
+  EXPECT_EQ(6, backplane.tileSamples(0));
+  EXPECT_EQ(500, backplane.lines(1));
+  EXPECT_EQ(88, backplane.samples(3));
+  EXPECT_EQ(1, backplane.tileLines(3));
+  EXPECT_THROW(backplane.tile(TileKey(0, 8, 0, Phase)), std::out_of_range);
+  EXPECT_THROW(backplane.tile(TileKey(4, 0, 0, Phase)), std::out_of_range);
+}
+
+
+TEST(TiledBackplane, computesOnlyRequestedTiles) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 1000, 1000, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 0.0));
+  TiledBackplane backplane(sensor, 1000, 1000, 64, 1 << 20, false);
+
+  std::shared_ptr<const Tile> tile = backplane.tile(TileKey(0, 15, 15, Incidence));
+  EXPECT_EQ(40, tile->lines);
+  EXPECT_EQ(40, tile->samples);
+  EXPECT_EQ(960, tile->firstLine);
+  EXPECT_EQ(size_t(40 * 40), model.imageToGroundCalls());
+
+  std::vector<double> expected(40 * 40);
+  evaluate(sensor, Incidence, 0, 960, 960, 40, 40, expected.data());
+  EXPECT_EQ(expected, tile->values);
+
+  // A second request is served from the cache without calling the sensor.
+  std::shared_ptr<const Tile> again = backplane.tile(TileKey(0, 15, 15, Incidence));
+  EXPECT_EQ(tile.get(), again.get());
+  EXPECT_EQ(size_t(2 * 40 * 40), model.imageToGroundCalls());
+  EXPECT_EQ(size_t(1), backplane.statistics().hits);
+  EXPECT_EQ(size_t(1), backplane.statistics().misses);
+}
+
+
+TEST(TiledBackplane, evictsLeastRecentlyUsed) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 256, 256, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 0.0));
+  const size_t tileBytes = 32 * 32 * sizeof(double);
+  TiledBackplane backplane(sensor, 256, 256, 32, 2 * tileBytes, false);
+
+  std::shared_ptr<const Tile> first = backplane.tile(TileKey(0, 0, 0, Phase));
+  backplane.tile(TileKey(0, 0, 1, Phase));
+  backplane.tile(TileKey(0, 0, 0, Phase));
+  backplane.tile(TileKey(0, 0, 2, Phase));
+
+  EXPECT_EQ(2 * tileBytes, backplane.cacheBytes());
+  EXPECT_EQ(size_t(1), backplane.statistics().evictions);
+  EXPECT_TRUE(backplane.cachedTile(TileKey(0, 0, 0, Phase)).get() != NULL);
+  EXPECT_TRUE(backplane.cachedTile(TileKey(0, 0, 1, Phase)).get() == NULL);
+  // Evicted tiles stay valid for callers still holding them.
+  EXPECT_EQ(size_t(32 * 32), first->values.size());
+}
+
+
+TEST(TiledBackplane, prefetchesNeighbors) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 512, 512, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 0.0));
+  TiledBackplane backplane(sensor, 512, 512, 64, 1 << 22, true);
+
+  backplane.tile(TileKey(1, 1, 1, Emission));
+  backplane.waitForPrefetch();
+  for (int line = 0; line <= 2; line++) {
+    for (int sample = 0; sample <= 2; sample++) {
+      EXPECT_TRUE(backplane.cachedTile(TileKey(1, line, sample, Emission)).get() != NULL);
+    }
+  }
+  EXPECT_EQ(size_t(8), backplane.statistics().prefetched);
+  EXPECT_TRUE(backplane.cachedTile(TileKey(1, 3, 3, Emission)).get() == NULL);
+  EXPECT_TRUE(backplane.cachedTile(TileKey(0, 1, 1, Emission)).get() == NULL);
+
+  // Prefetched tiles are identical to tiles computed on demand.
+  std::vector<double> expected(64 * 64);
+  evaluate(sensor, Emission, 1, 0, 128, 64, 64, expected.data());
+  EXPECT_EQ(expected, backplane.tile(TileKey(1, 0, 2, Emission))->values);
+}
+
+
+TEST(TiledBackplane, prefetchesOnGivenPool) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 512, 512, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 0.0));
+  execution::ThreadPool pool(2, execution::NoPinning);
+  {
+    TiledBackplane backplane(sensor, pool, 512, 512, 64, 1 << 22);
+    backplane.tile(TileKey(0, 3, 3, Emission));
+    backplane.waitForPrefetch();
+    EXPECT_EQ(size_t(8), backplane.statistics().prefetched);
+    EXPECT_TRUE(backplane.cachedTile(TileKey(0, 2, 4, Emission)).get() != NULL);
+
+    // Destroying the backplane with prefetches still queued leaves the pool usable.
+    backplane.tile(TileKey(0, 6, 6, Emission));
+  }
+  std::vector<int> done(4, 0);
+  pool.parallelFor(4, [&](int64_t index) {
+    done[index] = 1;
+  });
+  EXPECT_EQ(std::vector<int>(4, 1), done);
+}
+
+
+TEST(TiledBackplane, failedTilesAreRetried) {
+  // Lines from 64 on fail, so tile (0, 0) succeeds and the tiles beneath it throw.
+  FailingSensorModel model(64.0);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 0.0));
+  TiledBackplane backplane(sensor, 256, 256, 64, 1 << 22, true);
+
+  EXPECT_TRUE(backplane.tile(TileKey(0, 0, 0, Phase)).get() != NULL);
+  // Failed prefetches are dropped rather than terminating the program.
+  backplane.waitForPrefetch();
+  EXPECT_EQ(size_t(1), backplane.statistics().prefetched);
+  EXPECT_TRUE(backplane.cachedTile(TileKey(0, 0, 1, Phase)).get() != NULL);
+  EXPECT_TRUE(backplane.cachedTile(TileKey(0, 1, 0, Phase)).get() == NULL);
+
+  // A failed request leaves nothing in flight, so the next one fails too instead of waiting.
+  EXPECT_THROW(backplane.tile(TileKey(0, 1, 0, Phase)), std::runtime_error);
+  EXPECT_THROW(backplane.tile(TileKey(0, 1, 0, Phase)), std::runtime_error);
+  backplane.waitForPrefetch();
+}
+
+
+TEST(generate, reducePyramid) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 37, 23, 0.01);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  PyramidBuffer pyramid;
+  generate(sensor, Phase, 37, 23, 3, Reduce, pyramid, 5);
+
+  ASSERT_EQ(size_t(3), pyramid.levels.size());
+  EXPECT_EQ(size_t(37 * 23), pyramid.levels[0].size());
+  EXPECT_EQ(size_t(19 * 12), pyramid.levels[1].size());
+  EXPECT_EQ(size_t(10 * 6), pyramid.levels[2].size());
+
+  std::vector<double> full(37 * 23);
+  evaluate(sensor, Phase, 0, 0, 0, 37, 23, full.data());
+  EXPECT_EQ(full, pyramid.levels[0]);
+
+  const std::vector<double> &fine = pyramid.levels[1];
+  const std::vector<double> &coarse = pyramid.levels[2];
+  // Interior pixel: mean of four finer pixels.
+  EXPECT_DOUBLE_EQ((fine[2 * 12 + 2] + fine[2 * 12 + 3] + fine[3 * 12 + 2] + fine[3 * 12 + 3]) / 4.0,
+                   coarse[1 * 6 + 1]);
+  // Bottom row of level 2 only has one line of level 1 beneath it.
+  EXPECT_DOUBLE_EQ((fine[18 * 12 + 0] + fine[18 * 12 + 1]) / 2.0, coarse[9 * 6 + 0]);
+  EXPECT_DOUBLE_EQ((pyramid.levels[0][0] + pyramid.levels[0][1] + pyramid.levels[0][23]
+                    + pyramid.levels[0][24]) / 4.0, fine[0]);
+}
+
+
+TEST(generate, directPyramid) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 64, 50, 0.01);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  PyramidBuffer pyramid;
+  generate(sensor, Incidence, 64, 50, 4, Direct, pyramid, 16);
+
+  ASSERT_EQ(size_t(4), pyramid.levels.size());
+  for (int level = 0; level < 4; level++) {
+    int lines = (64 + (1 << level) - 1) >> level;
+    int samples = (50 + (1 << level) - 1) >> level;
+    std::vector<double> expected(lines * samples);
+    evaluate(sensor, Incidence, level, 0, 0, lines, samples, expected.data());
+    EXPECT_EQ(expected, pyramid.levels[level]);
+    EXPECT_EQ(samples, pyramid.samples[level]);
+  }
+}
+
+
+TEST(generate, invalidArguments) {
+  Sensor sensor("test", "test");
+  PyramidBuffer pyramid;
+  EXPECT_THROW(generate(sensor, Phase, 0, 10, 1, Reduce, pyramid), std::invalid_argument);
+  EXPECT_THROW(generate(sensor, Phase, 10, 10, 0, Reduce, pyramid), std::invalid_argument);
+}
+
+
+TEST(TiledBackplane, encodedTiles) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 256, 256, 0.002);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 0.0));
+  sensor.setDetector(500.0, 0.1, 1.0);
+  TiledBackplane backplane(sensor, 256, 256, 64, 1 << 20, false);
+  backplane.setEncoding(Phase, EncodingFormat(Encoding::AngleFixed16));
+  backplane.setEncoding(Resolution, EncodingFormat(Encoding::Half));
+  EncodingFormat invalid(Encoding::Half);
+  invalid.encoding = Encoding::LogScaled16;
+  EXPECT_THROW(backplane.setEncoding(Resolution, invalid), std::invalid_argument);
+
+  std::shared_ptr<const Tile> phase = backplane.tile(TileKey(0, 1, 2, Phase));
+  std::shared_ptr<const Tile> resolution = backplane.tile(TileKey(0, 1, 2, Resolution));
+  EXPECT_TRUE(phase->values.empty());
+  EXPECT_EQ(size_t(64 * 64), phase->codes.size());
+  EXPECT_EQ(2 * 64 * 64 * sizeof(uint16_t), backplane.cacheBytes());
+
+  std::vector<double> expectedPhase(64 * 64), expectedResolution(64 * 64);
+  evaluate(sensor, Phase, 0, 64, 128, 64, 64, expectedPhase.data());
+  evaluate(sensor, Resolution, 0, 64, 128, 64, 64, expectedResolution.data());
+  for (int line = 0; line < 64; line++) {
+    for (int sample = 0; sample < 64; sample++) {
+      EXPECT_NEAR(expectedPhase[line * 64 + sample], phase->value(line, sample),
+                  ANGLE_QUANTIZATION_ERROR);
+      EXPECT_NEAR(expectedResolution[line * 64 + sample], resolution->value(line, sample),
+                  expectedResolution[line * 64 + sample] / 2048.0);
+    }
+  }
+}
+
+
+TEST(generate, encodedPyramid) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 40, 30, 0.01);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  PyramidBuffer reference, direct, reduced;
+  generate(sensor, Emission, 40, 30, 3, Reduce, reference, 8);
+  generate(sensor, Emission, 40, 30, 3, Direct, direct, 8, EncodingFormat(Encoding::AngleFixed16));
+  generate(sensor, Emission, 40, 30, 3, Reduce, reduced, 8, EncodingFormat(Encoding::AngleFixed16));
+
+  ASSERT_EQ(size_t(3), reduced.codes.size());
+  for (size_t i = 0; i < reference.levels[0].size(); i++) {
+    EXPECT_EQ(encodeAngle(reference.levels[0][i]), direct.codes[0][i]);
+  }
+  for (int level = 0; level < 3; level++) {
+    ASSERT_EQ(reference.levels[level].size(), reduced.codes[level].size());
+    EXPECT_TRUE(reduced.levels[level].empty());
+    for (size_t i = 0; i < reference.levels[level].size(); i++) {
+      EXPECT_EQ(encodeAngle(reference.levels[level][i]), reduced.codes[level][i]);
+    }
+  }
+}
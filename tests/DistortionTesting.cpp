@@ -0,0 +1,121 @@
+#include "Distortion.h"
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+  // Compares a model's Jacobian with central differences.
+  void expectJacobian(const DistortionModel &model, double x, double y) {
+    const double h = 1e-6;
+    double jacobian[4], dx, dy, xPlus, yPlus, xMinus, yMinus;
+    model.distort(x, y, dx, dy, jacobian);
+    model.distort(x + h, y, xPlus, yPlus);
+    model.distort(x - h, y, xMinus, yMinus);
+    EXPECT_NEAR((xPlus - xMinus) / (2 * h), jacobian[0], 1e-7);
+    EXPECT_NEAR((yPlus - yMinus) / (2 * h), jacobian[2], 1e-7);
+    model.distort(x, y + h, xPlus, yPlus);
+    model.distort(x, y - h, xMinus, yMinus);
+    EXPECT_NEAR((xPlus - xMinus) / (2 * h), jacobian[1], 1e-7);
+    EXPECT_NEAR((yPlus - yMinus) / (2 * h), jacobian[3], 1e-7);
+  }
+
+
+  std::shared_ptr<const DistortionModel> transverse() {
+    std::vector<double> xCoefficients = {0.01, 1.0, 0.002, 1e-4, -2e-5, 3e-5, 1e-6, 0.0, 2e-6, 0.0};
+    std::vector<double> yCoefficients = {-0.02, 0.001, 1.0, 2e-5, 1e-4, -4e-5, 0.0, 1e-6, 0.0, 3e-6};
+    return std::make_shared<PolynomialDistortion>(3, xCoefficients, yCoefficients);
+  }
+}
+
+
+TEST(RadialDistortion, jacobian) {
+  RadialDistortion model(-2e-4, 3e-7, -1e-10);
+  expectJacobian(model, 3.0, -7.0);
+  expectJacobian(model, 0.0, 0.0);
+}
+
+
+TEST(PolynomialDistortion, identity) {
+  PolynomialDistortion model(1, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0});
+  double x, y;
+  model.distort(2.5, -4.0, x, y);
+  EXPECT_DOUBLE_EQ(2.5, x);
+  EXPECT_DOUBLE_EQ(-4.0, y);
+}
+
+
+TEST(PolynomialDistortion, jacobian) {
+  expectJacobian(*transverse(), 4.0, -6.0);
+}
+
+
+TEST(PolynomialDistortion, rejectsWrongCoefficientCount) {
+  EXPECT_THROW(PolynomialDistortion(2, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}), std::invalid_argument);
+}
+
+
+TEST(DistortionModel, undistortInvertsDistort) {
+  std::shared_ptr<const DistortionModel> model = transverse();
+  double points[] = {0.0, 0.0, 9.0, -9.0, -5.0, 3.0};
+  double distorted[6], undistorted[6];
+  model->distort(points, 3, distorted);
+  model->undistort(distorted, 3, undistorted);
+  for (int i = 0; i < 6; i++) {
+    EXPECT_NEAR(points[i], undistorted[i], 1e-12);
+  }
+}
+
+
+TEST(InverseDistortionGrid, matchesExactInverse) {
+  std::shared_ptr<const DistortionModel> models[] = {
+    std::make_shared<RadialDistortion>(-2e-4, 3e-7), transverse()};
+  for (int i = 0; i < 2; i++) {
+    InverseDistortionGrid grid(models[i], -10.0, -10.0, 10.0, 10.0, 33, 33);
+    DistortionAccuracy accuracy = grid.measureAccuracy(4);
+    EXPECT_EQ(size_t(32 * 4 * 32 * 4), accuracy.points);
+    // Millimeters: about 1e-7 of a 10 micron pixel.
+    EXPECT_LT(accuracy.maxError, 1e-9);
+    EXPECT_LT(accuracy.maxResidual, 1e-9);
+    EXPECT_LE(accuracy.rmsError, accuracy.maxError);
+  }
+}
+
+
+TEST(InverseDistortionGrid, batchAndOutsideGrid) {
+  std::shared_ptr<const DistortionModel> model = std::make_shared<RadialDistortion>(-2e-4);
+  InverseDistortionGrid grid(model, -5.0, -5.0, 5.0, 5.0, 17, 17);
+  double distorted[] = {1.0, 2.0, 5.0, 5.0, 8.0, -7.0};
+  double points[6];
+  grid.undistort(distorted, 3, points);
+  for (int i = 0; i < 3; i++) {
+    double x, y;
+    model->undistort(distorted[2 * i], distorted[2 * i + 1], x, y);
+    EXPECT_NEAR(x, points[2 * i], 1e-10);
+    EXPECT_NEAR(y, points[2 * i + 1], 1e-10);
+  }
+}
+
+
+TEST(InverseDistortionGrid, sharedPerInstrument) {
+  std::shared_ptr<const DistortionModel> model = std::make_shared<RadialDistortion>(-2e-4);
+  std::shared_ptr<const InverseDistortionGrid> first =
+      InverseDistortionGrid::shared("test camera", model, -5.0, -5.0, 5.0, 5.0, 9, 9);
+  std::shared_ptr<const InverseDistortionGrid> second =
+      InverseDistortionGrid::shared("test camera", model, -5.0, -5.0, 5.0, 5.0, 9, 9);
+  std::shared_ptr<const InverseDistortionGrid> other =
+      InverseDistortionGrid::shared("other camera", model, -5.0, -5.0, 5.0, 5.0, 9, 9);
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_NE(first.get(), other.get());
+}
+
+
+TEST(InverseDistortionGrid, rejectsDegenerateGrid) {
+  std::shared_ptr<const DistortionModel> model = std::make_shared<RadialDistortion>(-2e-4);
+  EXPECT_THROW(InverseDistortionGrid(model, 0.0, 0.0, 1.0, 1.0, 1, 5), std::invalid_argument);
+  EXPECT_THROW(InverseDistortionGrid(model, 1.0, 0.0, 1.0, 1.0, 5, 5), std::invalid_argument);
+}
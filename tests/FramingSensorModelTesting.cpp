@@ -0,0 +1,195 @@
+#include "FramingSensorModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Distortion.h"
+#include "sensorcore.h"
+#include "SensorModel.h"
+
+namespace {
+
+  // A 1024 x 1024 frame camera about 600 km above a Mars-sized ellipsoid, looking down.
+  FramingSensorModel camera() {
+    return FramingSensorModel(CartesianPoint(4000.0, 100.0, 50.0), 0.01, -M_PI / 2.0 + 0.02,
+                              0.03, 350.0, 0.007, 1024, 1024,
+                              CartesianPoint(3396.19, 3396.19, 3376.2));
+  }
+
+
+  std::shared_ptr<const InverseDistortionGrid> distortion() {
+    return InverseDistortionGrid::shared("framing test camera",
+                                         std::make_shared<RadialDistortion>(-3e-5, 2e-8),
+                                         -4.0, -4.0, 4.0, 4.0, 33, 33);
+  }
+
+
+  std::vector<CartesianPoint> groundPoints(const FramingSensorModel &model) {
+    std::vector<CartesianPoint> points;
+    for (int line = 0; line <= 1024; line += 256) {
+      for (int sample = 0; sample <= 1024; sample += 256) {
+        points.push_back(model.imageToGround(ImagePoint(sample, line, 1.0)));
+      }
+    }
+    return points;
+  }
+
+
+  // Forwards to a FramingSensorModel through the per-point methods only, so the partials come
+  // from the SensorModel default.
+  class PerPointModel : public SensorModel {
+
+    public:
+      PerPointModel(const FramingSensorModel &model) : m_model(model) {}
+
+      CartesianPoint imageToGround(const ImagePoint &imagePoint) const {
+        return m_model.imageToGround(imagePoint);
+      }
+
+      ImagePoint groundToImage(const CartesianPoint &groundPoint) const {
+        return m_model.groundToImage(groundPoint);
+      }
+
+      CartesianVector groundToLook(const CartesianPoint &groundPoint) const {
+        return m_model.groundToLook(groundPoint);
+      }
+
+      double imageTime(const ImagePoint &imagePoint) const {
+        return m_model.imageTime(imagePoint);
+      }
+
+    private:
+      const FramingSensorModel &m_model;
+  };
+}
+
+
+TEST(FramingSensorModel, roundTrip) {
+  FramingSensorModel model = camera();
+  model.setDistortion(distortion());
+  for (int line = 0; line <= 1024; line += 128) {
+    for (int sample = 0; sample <= 1024; sample += 128) {
+      CartesianPoint ground = model.imageToGround(ImagePoint(sample, line, 1.0));
+      ASSERT_FALSE(std::isnan(ground.x));
+      ImagePoint image = model.groundToImage(ground);
+      EXPECT_NEAR(sample, image.sample, 1e-6);
+      EXPECT_NEAR(line, image.line, 1e-6);
+    }
+  }
+}
+
+
+TEST(FramingSensorModel, missIsNaN) {
+  FramingSensorModel model(CartesianPoint(4000.0, 0.0, 0.0), 0.0, M_PI / 2.0, 0.0, 350.0, 0.007,
+                           1024, 1024, CartesianPoint(3396.19, 3396.19, 3376.2));
+  EXPECT_TRUE(std::isnan(model.imageToGround(ImagePoint(512.0, 512.0, 1.0)).x));
+  EXPECT_TRUE(std::isnan(model.groundToImage(CartesianPoint(3396.19, 0.0, 0.0)).sample));
+}
+
+
+TEST(FramingSensorModel, partialsMatchFiniteDifferences) {
+  FramingSensorModel model = camera();
+  model.setDistortion(distortion());
+  std::vector<CartesianPoint> ground = groundPoints(model);
+  std::vector<ImagePoint> images(ground.size());
+  std::vector<double> groundPartials(6 * ground.size()), sensorPartials(12 * ground.size());
+  model.groundToImage(ground.data(), ground.size(), images.data(),
+                      PartialsBuffer(groundPartials.data(), sensorPartials.data()));
+
+  double parameters[6];
+  model.parameters(parameters);
+  const double steps[6] = {1e-4, 1e-4, 1e-4, 1e-8, 1e-8, 1e-8};
+  for (size_t i = 0; i < ground.size(); i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      CartesianPoint plus(ground[i]), minus(ground[i]);
+      (axis == 0 ? plus.x : axis == 1 ? plus.y : plus.z) += 1e-4;
+      (axis == 0 ? minus.x : axis == 1 ? minus.y : minus.z) -= 1e-4;
+      ImagePoint plusImage = model.groundToImage(plus), minusImage = model.groundToImage(minus);
+      EXPECT_NEAR((plusImage.sample - minusImage.sample) / 2e-4, groundPartials[6 * i + axis],
+                  1e-4);
+      EXPECT_NEAR((plusImage.line - minusImage.line) / 2e-4, groundPartials[6 * i + 3 + axis],
+                  1e-4);
+    }
+    for (int parameter = 0; parameter < 6; parameter++) {
+      FramingSensorModel plus(model), minus(model);
+      double changed[6];
+      std::copy(parameters, parameters + 6, changed);
+      changed[parameter] += steps[parameter];
+      plus.setParameters(changed);
+      changed[parameter] -= 2.0 * steps[parameter];
+      minus.setParameters(changed);
+      ImagePoint plusImage = plus.groundToImage(ground[i]);
+      ImagePoint minusImage = minus.groundToImage(ground[i]);
+      double expectedSample = (plusImage.sample - minusImage.sample) / (2.0 * steps[parameter]);
+      double expectedLine = (plusImage.line - minusImage.line) / (2.0 * steps[parameter]);
+      double tolerance = 1e-5 * std::max(1.0, std::fabs(expectedSample) + std::fabs(expectedLine));
+      EXPECT_NEAR(expectedSample, sensorPartials[12 * i + parameter], tolerance);
+      EXPECT_NEAR(expectedLine, sensorPartials[12 * i + 6 + parameter], tolerance);
+    }
+    ImagePoint image = model.groundToImage(ground[i]);
+    EXPECT_DOUBLE_EQ(image.sample, images[i].sample);
+    EXPECT_DOUBLE_EQ(image.line, images[i].line);
+  }
+}
+
+
+TEST(FramingSensorModel, denseLayoutMatchesBlockSparse) {
+  FramingSensorModel model = camera();
+  std::vector<CartesianPoint> ground = groundPoints(model);
+  size_t count = ground.size();
+  std::vector<ImagePoint> images(count);
+  std::vector<double> groundPartials(6 * count), sensorPartials(12 * count);
+  model.groundToImage(ground.data(), count, images.data(),
+                      PartialsBuffer(groundPartials.data(), sensorPartials.data()));
+
+  // One image (6 columns) followed by one ground point per observation (3 columns each), with
+  // the observations starting at row 2.
+  size_t columns = 6 + 3 * count;
+  std::vector<double> matrix((2 + 2 * count) * columns, -1.0);
+  std::vector<size_t> groundColumns(count);
+  for (size_t i = 0; i < count; i++) {
+    groundColumns[i] = 6 + 3 * i;
+  }
+  model.groundToImage(ground.data(), count, images.data(),
+                      PartialsBuffer(matrix.data(), columns, 2, groundColumns.data(), 0));
+
+  for (size_t column = 0; column < columns; column++) {
+    EXPECT_EQ(-1.0, matrix[column]);
+  }
+  for (size_t i = 0; i < count; i++) {
+    for (int row = 0; row < 2; row++) {
+      const double *values = &matrix[(2 + 2 * i + row) * columns];
+      for (int k = 0; k < 6; k++) {
+        EXPECT_EQ(sensorPartials[12 * i + 6 * row + k], values[k]);
+      }
+      for (size_t point = 0; point < count; point++) {
+        for (int k = 0; k < 3; k++) {
+          double expected = point == i ? groundPartials[6 * i + 3 * row + k] : -1.0;
+          EXPECT_EQ(expected, values[6 + 3 * point + k]);
+        }
+      }
+    }
+  }
+}
+
+
+TEST(SensorModel, defaultPartialsAreNumerical) {
+  FramingSensorModel model = camera();
+  PerPointModel perPoint(model);
+  std::vector<CartesianPoint> ground = groundPoints(model);
+  size_t count = ground.size();
+  std::vector<ImagePoint> images(count), perPointImages(count);
+  std::vector<double> analytic(6 * count), numerical(6 * count);
+  model.groundToImage(ground.data(), count, images.data(), PartialsBuffer(analytic.data(), NULL));
+  const SensorModel &base = perPoint;
+  EXPECT_EQ(0, base.parameterCount());
+  base.groundToImage(ground.data(), count, perPointImages.data(),
+                     PartialsBuffer(numerical.data(), NULL));
+  for (size_t i = 0; i < 6 * count; i++) {
+    EXPECT_NEAR(analytic[i], numerical[i], 1e-3);
+  }
+}
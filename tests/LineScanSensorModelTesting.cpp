@@ -0,0 +1,132 @@
+#include "LineScanSensorModel.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "FramingSensorModel.h"
+#include "sensorcore.h"
+
+namespace {
+
+  const CartesianPoint MARS(3396.19, 3396.19, 3376.2);
+
+
+  // 1000 lines of a camera 400 km above the +x side of the body, looking down and moving
+  // along +y with a small yaw wobble.
+  LineScanSensorModel scanner() {
+    std::vector<CartesianPoint> positions;
+    std::vector<double> angles;
+    for (int line = 0; line < 1000; line++) {
+      positions.push_back(CartesianPoint(3800.0, -2.0 + 0.004 * line, 0.1));
+      angles.push_back(0.002);
+      angles.push_back(-M_PI / 2.0);
+      angles.push_back(0.001 * std::sin(line / 100.0));
+    }
+    return LineScanSensorModel(positions, angles, 0.001, 350.0, 0.007, 2048, MARS);
+  }
+}
+
+
+TEST(LineScanSensorModel, constantPoseMatchesFrameCamera) {
+  std::vector<CartesianPoint> positions(4, CartesianPoint(4000.0, 100.0, 50.0));
+  std::vector<double> angles;
+  for (int line = 0; line < 4; line++) {
+    angles.push_back(0.01);
+    angles.push_back(-M_PI / 2.0 + 0.02);
+    angles.push_back(0.03);
+  }
+  LineScanSensorModel lineScan(positions, angles, 0.001, 350.0, 0.007, 1024, MARS);
+  FramingSensorModel frame(CartesianPoint(4000.0, 100.0, 50.0), 0.01, -M_PI / 2.0 + 0.02, 0.03,
+                           350.0, 0.007, 1024, 1024, MARS);
+  for (double sample = 0.0; sample <= 1024.0; sample += 128.0) {
+    CartesianPoint expected = frame.imageToGround(ImagePoint(sample, 512.0, 1.0));
+    CartesianPoint ground = lineScan.imageToGround(ImagePoint(sample, 2.7, 1.0));
+    EXPECT_NEAR(expected.x, ground.x, 1e-9);
+    EXPECT_NEAR(expected.y, ground.y, 1e-9);
+    EXPECT_NEAR(expected.z, ground.z, 1e-9);
+  }
+}
+
+
+TEST(LineScanSensorModel, roundTrip) {
+  LineScanSensorModel model = scanner();
+  EXPECT_EQ(1000.0, model.lines());
+  for (double line = 0.0; line <= 1000.0; line += 124.75) {
+    for (double sample = 0.0; sample <= 2048.0; sample += 255.5) {
+      CartesianPoint ground = model.imageToGround(ImagePoint(sample, line, 1.0));
+      ASSERT_FALSE(std::isnan(ground.x));
+      ImagePoint image = model.groundToImage(ground);
+      EXPECT_NEAR(sample, image.sample, 1e-6);
+      EXPECT_NEAR(line, image.line, 1e-6);
+
+      // The look vector starts at the pose of the line that sees the point.
+      CartesianVector look = model.groundToLook(ground);
+      CartesianPoint origin(ground.x - look.x, ground.y - look.y, ground.z - look.z);
+      EXPECT_NEAR(3800.0, origin.x, 1e-9);
+      EXPECT_NEAR(-2.0 + 0.004 * (line - 0.5), origin.y, 1e-8);
+    }
+  }
+  EXPECT_DOUBLE_EQ(0.25, model.imageTime(ImagePoint(10.0, 250.0, 1.0)));
+}
+
+
+TEST(LineScanSensorModel, batchMatchesPerPoint) {
+  LineScanSensorModel model = scanner();
+  std::vector<ImagePoint> images;
+  for (int i = 0; i < 50; i++) {
+    images.push_back(ImagePoint(40.0 * i, 19.5 * i, 1.0));
+  }
+  std::vector<CartesianPoint> grounds(images.size());
+  std::vector<ImagePoint> projected(images.size());
+  model.imageToGround(images.data(), images.size(), grounds.data());
+  model.groundToImage(grounds.data(), grounds.size(), projected.data());
+  for (size_t i = 0; i < images.size(); i++) {
+    ImagePoint expected = model.groundToImage(model.imageToGround(images[i]));
+    EXPECT_EQ(expected.sample, projected[i].sample);
+    EXPECT_EQ(expected.line, projected[i].line);
+  }
+}
+
+
+TEST(LineScanSensorModel, missesAreNaN) {
+  LineScanSensorModel model = scanner();
+  EXPECT_TRUE(std::isnan(model.imageToGround(ImagePoint(1.0e6, 10.0, 1.0)).x));
+  // A point above the camera is behind it.
+  EXPECT_TRUE(std::isnan(model.groundToImage(CartesianPoint(3900.0, 0.0, 0.0)).line));
+  EXPECT_TRUE(std::isnan(model.imageToGround(ImagePoint(10.0, NAN, 1.0)).x));
+  EXPECT_TRUE(std::isnan(model.imageToGround(ImagePoint(NAN, 10.0, 1.0)).x));
+  EXPECT_TRUE(std::isnan(model.imageToGround(ImagePoint(10.0, INFINITY, 1.0)).x));
+  EXPECT_TRUE(std::isnan(model.groundToImage(CartesianPoint(NAN, 0.0, 0.0)).line));
+}
+
+
+TEST(LineScanSensorModel, anglesWrapAround) {
+  // Kappa crosses +-pi between the two lines, so halfway it is pi, not 0.
+  std::vector<CartesianPoint> positions(2, CartesianPoint(4000.0, 100.0, 50.0));
+  std::vector<double> angles{0.01, -M_PI / 2.0 + 0.02, M_PI - 0.001,
+                             0.01, -M_PI / 2.0 + 0.02, -M_PI + 0.001};
+  LineScanSensorModel lineScan(positions, angles, 0.001, 350.0, 0.007, 1024, MARS);
+  FramingSensorModel frame(CartesianPoint(4000.0, 100.0, 50.0), 0.01, -M_PI / 2.0 + 0.02, M_PI,
+                           350.0, 0.007, 1024, 1024, MARS);
+  for (double sample = 0.0; sample <= 1024.0; sample += 256.0) {
+    CartesianPoint expected = frame.imageToGround(ImagePoint(sample, 512.0, 1.0));
+    CartesianPoint ground = lineScan.imageToGround(ImagePoint(sample, 1.0, 1.0));
+    EXPECT_NEAR(expected.x, ground.x, 1e-6);
+    EXPECT_NEAR(expected.y, ground.y, 1e-6);
+    EXPECT_NEAR(expected.z, ground.z, 1e-6);
+  }
+}
+
+
+TEST(LineScanSensorModel, invalid) {
+  std::vector<CartesianPoint> positions(1, CartesianPoint(4000.0, 0.0, 0.0));
+  std::vector<double> angles(3, 0.0);
+  EXPECT_THROW(LineScanSensorModel(positions, angles, 0.001, 350.0, 0.007, 10, MARS),
+               std::invalid_argument);
+  positions.push_back(CartesianPoint(4000.0, 1.0, 0.0));
+  EXPECT_THROW(LineScanSensorModel(positions, angles, 0.001, 350.0, 0.007, 10, MARS),
+               std::invalid_argument);
+}
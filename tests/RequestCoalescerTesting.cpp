@@ -0,0 +1,201 @@
+#include "RequestCoalescer.h"
+
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Backplane.h"
+#include "sensorcore.h"
+#include "Sensor.h"
+#include "SensorModelFixtures.h"
+#include "ThreadPool.h"
+
+using namespace service;
+
+namespace {
+
+  std::vector<ImagePoint> requestPoints(int client, int request) {
+    std::vector<ImagePoint> points;
+    for (int i = 0; i < 4; i++) {
+      points.push_back(ImagePoint(10.0 + 7.0 * client + i, 5.0 + 3.0 * request, 1.0));
+    }
+    return points;
+  }
+}
+
+
+TEST(RequestCoalescer, futuresMatchSensor) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  const int clients = 8, requests = 50;
+  std::vector<std::vector<double> > phases(clients * requests), emissions(clients * requests);
+
+  {
+    RequestCoalescer coalescer(0.002, 256, 2);
+    std::vector<std::thread> threads;
+    for (int client = 0; client < clients; client++) {
+      threads.push_back(std::thread([&, client]() {
+        for (int request = 0; request < requests; request++) {
+          std::vector<ImagePoint> points = requestPoints(client, request);
+          std::future<std::vector<double> > phase = coalescer.submit(sensor, backplane::Phase,
+                                                                      points);
+          std::future<std::vector<double> > emission =
+              coalescer.submit(sensor, backplane::Emission, points);
+          phases[client * requests + request] = phase.get();
+          emissions[client * requests + request] = emission.get();
+        }
+      }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+      threads[i].join();
+    }
+
+    CoalescerMetrics metrics = coalescer.metrics();
+    EXPECT_EQ(uint64_t(2 * clients * requests), metrics.queueTime.count());
+    EXPECT_EQ(uint64_t(2 * clients * requests), metrics.latency.count());
+    // Concurrent clients share batches.
+    EXPECT_GT(metrics.batchRequests.mean(), 1.0);
+    EXPECT_LE(metrics.batchPoints.maximum(), 256.0);
+    EXPECT_NEAR(4.0 * metrics.batchRequests.mean(), metrics.batchPoints.mean(), 1e-9);
+  }
+
+  for (int client = 0; client < clients; client++) {
+    for (int request = 0; request < requests; request++) {
+      std::vector<ImagePoint> points = requestPoints(client, request);
+      const std::vector<double> &phase = phases[client * requests + request];
+      const std::vector<double> &emission = emissions[client * requests + request];
+      ASSERT_EQ(points.size(), phase.size());
+      ASSERT_EQ(points.size(), emission.size());
+      for (size_t i = 0; i < points.size(); i++) {
+        EXPECT_DOUBLE_EQ(sensor.phaseAngle(points[i]), phase[i]);
+        EXPECT_DOUBLE_EQ(sensor.emissionAngle(points[i]), emission[i]);
+      }
+    }
+  }
+}
+
+
+TEST(RequestCoalescer, fullBatchRunsBeforeBudget) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  // A ten second budget: only filling the batch can run it in time.
+  RequestCoalescer coalescer(10.0, 8);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::future<std::vector<double> > first = coalescer.submit(sensor, backplane::Incidence,
+                                                             requestPoints(0, 0));
+  std::future<std::vector<double> > second = coalescer.submit(sensor, backplane::Incidence,
+                                                              requestPoints(0, 1));
+  EXPECT_EQ(4u, first.get().size());
+  EXPECT_EQ(4u, second.get().size());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+  EXPECT_EQ(8.0, coalescer.metrics().batchPoints.maximum());
+}
+
+
+TEST(RequestCoalescer, budgetBoundsQueueTime) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  RequestCoalescer coalescer(0.005, 4096);
+  for (int request = 0; request < 20; request++) {
+    coalescer.submit(sensor, backplane::Resolution, requestPoints(1, request)).get();
+  }
+  CoalescerMetrics metrics = coalescer.metrics();
+  EXPECT_EQ(20u, metrics.batchRequests.count());
+  // A lone request waits out the budget, but not much longer.
+  EXPECT_GE(metrics.queueTime.minimum(), 0.005);
+  EXPECT_LT(metrics.queueTime.quantile(0.99), 0.05);
+}
+
+
+TEST(RequestCoalescer, callbacksAndRADec) {
+  std::vector<CartesianVector> vectors;
+  vectors.push_back(CartesianVector(1.0, 1.0, 0.0));
+  vectors.push_back(CartesianVector(0.0, -1.0, 1.0));
+
+  std::mutex mutex;
+  std::vector<double> received;
+  std::exception_ptr receivedError;
+  {
+    RequestCoalescer coalescer(0.001);
+    std::future<std::vector<double> > raDec = coalescer.submitRADec(vectors);
+    std::vector<double> values = raDec.get();
+    ASSERT_EQ(4u, values.size());
+    EXPECT_NEAR(M_PI / 4.0, values[0], 1e-12);
+    EXPECT_NEAR(0.0, values[1], 1e-12);
+    EXPECT_NEAR(1.5 * M_PI, values[2], 1e-12);
+    EXPECT_NEAR(M_PI / 4.0, values[3], 1e-12);
+
+    coalescer.submitRADec(vectors, [&](std::vector<double> &values, std::exception_ptr error) {
+      std::lock_guard<std::mutex> lock(mutex);
+      received = values;
+      receivedError = error;
+    });
+  }
+  // The destructor ran the queued request.
+  EXPECT_EQ(4u, received.size());
+  EXPECT_FALSE(receivedError);
+}
+
+
+TEST(RequestCoalescer, sharedPool) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  execution::ThreadPool pool(2, execution::NoPinning);
+  RequestCoalescer coalescer(pool, 0.001, 64);
+  std::vector<std::future<std::vector<double> > > results;
+  for (int request = 0; request < 40; request++) {
+    results.push_back(coalescer.submit(sensor, backplane::Emission, requestPoints(2, request)));
+  }
+  for (int request = 0; request < 40; request++) {
+    std::vector<double> values = results[request].get();
+    std::vector<ImagePoint> points = requestPoints(2, request);
+    for (size_t i = 0; i < points.size(); i++) {
+      EXPECT_DOUBLE_EQ(sensor.emissionAngle(points[i]), values[i]);
+    }
+  }
+  EXPECT_LE(coalescer.metrics().batchPoints.maximum(), 64.0);
+}
+
+
+TEST(RequestCoalescer, zeroBudget) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  RequestCoalescer coalescer(0.0);
+  std::vector<ImagePoint> points = requestPoints(3, 0);
+  std::vector<double> values = coalescer.submit(sensor, backplane::Phase, points).get();
+  ASSERT_EQ(points.size(), values.size());
+  EXPECT_DOUBLE_EQ(sensor.phaseAngle(points[0]), values[0]);
+  EXPECT_EQ(1u, coalescer.metrics().queueTime.count());
+}
+
+
+TEST(RequestCoalescer, failedBatchFailsEveryRequest) {
+  FailingSensorModel model(0.0);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  // Both requests fill one batch of 8 points, which throws.
+  RequestCoalescer coalescer(10.0, 8);
+  std::future<std::vector<double> > first = coalescer.submit(sensor, backplane::Phase,
+                                                             requestPoints(0, 0));
+  std::future<std::vector<double> > second = coalescer.submit(sensor, backplane::Phase,
+                                                              requestPoints(0, 1));
+  EXPECT_THROW(first.get(), std::runtime_error);
+  EXPECT_THROW(second.get(), std::runtime_error);
+  EXPECT_EQ(2.0, coalescer.metrics().batchRequests.maximum());
+}
+
+
+TEST(RequestCoalescer, invalid) {
+  EXPECT_THROW(RequestCoalescer(-1.0), std::invalid_argument);
+  EXPECT_THROW(RequestCoalescer(NAN), std::invalid_argument);
+  EXPECT_THROW(RequestCoalescer(INFINITY, 16), std::invalid_argument);
+  EXPECT_THROW(RequestCoalescer(1.0e11), std::invalid_argument);
+  EXPECT_THROW(RequestCoalescer(0.001, 0), std::invalid_argument);
+  EXPECT_THROW(RequestCoalescer(0.001, 16, 0), std::invalid_argument);
+}
@@ -0,0 +1,152 @@
+#include "Scenario.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "LineScanSensorModel.h"
+#include "sensorcore.h"
+#include "Sensor.h"
+#include "SensorModel.h"
+#include "TerrainVisibility.h"
+#include "Traversal.h"
+
+using namespace scenario;
+
+namespace {
+
+  double distance(const CartesianPoint &a, const CartesianPoint &b) {
+    return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y)
+                     + (a.z - b.z) * (a.z - b.z));
+  }
+}
+
+
+TEST(Scenario, deterministic) {
+  ScenarioOptions options;
+  options.lines = 200;
+  options.samples = 300;
+  options.elevationCells = 64;
+  Scenario first = createScenario(options);
+  Scenario second = createScenario(options);
+  EXPECT_EQ(first.fingerprint, second.fingerprint);
+  EXPECT_EQ(first.illuminatorPosition.x, second.illuminatorPosition.x);
+  ImagePoint corner(0.0, 0.0, 1.0);
+  EXPECT_EQ(first.model->imageToGround(corner).y, second.model->imageToGround(corner).y);
+  for (int64_t cell = 0; cell < 64; cell += 7) {
+    EXPECT_EQ(first.elevation->height(cell, 63 - cell), second.elevation->height(cell, 63 - cell));
+  }
+
+  options.seed = 2;
+  Scenario other = createScenario(options);
+  EXPECT_NE(first.fingerprint, other.fingerprint);
+  EXPECT_GT(distance(first.center, other.center), 1.0);
+}
+
+
+TEST(Scenario, frameGeometry) {
+  ScenarioOptions options;
+  options.lines = 500;
+  options.samples = 700;
+  options.elevationCells = 32;
+  for (uint64_t seed = 1; seed <= 5; seed++) {
+    options.seed = seed;
+    Scenario scenario = createScenario(options);
+    ASSERT_TRUE(scenario.model);
+    EXPECT_NEAR(0.005, scenario.groundSampleDistance, 1e-12);
+
+    // Near-nadir pointing: the look is close to the surface normal at the image center.
+    Sensor sensor(scenario.model.get(), scenario.illuminatorPosition);
+    ImagePoint center(350.0, 250.0, 1.0);
+    EXPECT_LT(sensor.emissionAngle(center), 2.0 * options.maximumOffNadir);
+    double incidence = sensor.incidenceAngle(center) * 180.0 / M_PI;
+    EXPECT_GE(incidence, 20.0 - 1e-6);
+    EXPECT_LE(incidence, 70.0 + 1e-6);
+
+    // The DEM is a local frame at the center and covers the whole footprint.
+    CartesianPoint local = scenario.toLocal(scenario.center);
+    EXPECT_NEAR(0.0, local.x, 1e-9);
+    EXPECT_NEAR(0.0, local.z, 1e-9);
+    const shapemodel::ElevationModel &elevation = *scenario.elevation;
+    double end = elevation.originX() + elevation.spacing() * (elevation.samples() - 1);
+    for (int corner = 0; corner < 4; corner++) {
+      ImagePoint image(corner % 2 ? 700.0 : 0.0, corner / 2 ? 500.0 : 0.0, 1.0);
+      CartesianPoint point = scenario.toLocal(scenario.model->imageToGround(image));
+      EXPECT_GT(point.x, elevation.originX());
+      EXPECT_LT(point.x, end);
+      EXPECT_GT(point.y, elevation.originY());
+      EXPECT_LT(point.y, end);
+      EXPECT_LT(std::fabs(point.z), 0.1);
+    }
+  }
+}
+
+
+TEST(Scenario, lineScanGeometry) {
+  ScenarioOptions options;
+  options.sensor = LineScanner;
+  options.lines = 400;
+  options.samples = 300;
+  options.elevationCells = 0;
+  Scenario scenario = createScenario(options);
+  ASSERT_TRUE(dynamic_cast<const LineScanSensorModel *>(scenario.model.get()) != NULL);
+  EXPECT_FALSE(scenario.elevation);
+
+  for (double line = 10.0; line < 400.0; line += 95.0) {
+    ImagePoint image(150.0, line, 1.0);
+    CartesianPoint ground = scenario.model->imageToGround(image);
+    ImagePoint projected = scenario.model->groundToImage(ground);
+    EXPECT_NEAR(image.sample, projected.sample, 1e-6);
+    EXPECT_NEAR(image.line, projected.line, 1e-6);
+
+    // Lines are exposed at the rate that gives square pixels on the ground.
+    double alongTrack = distance(ground, scenario.model->imageToGround(
+                                             ImagePoint(150.0, line + 1.0, 1.0)));
+    double crossTrack = distance(ground, scenario.model->imageToGround(
+                                             ImagePoint(151.0, line, 1.0)));
+    EXPECT_NEAR(1.0, alongTrack / crossTrack, 0.15);
+  }
+
+  // The same seed gives the same orbit and sun for either sensor.
+  options.sensor = FrameCamera;
+  Scenario frame = createScenario(options);
+  EXPECT_LT(distance(scenario.center, frame.center), 1.0);
+  EXPECT_EQ(scenario.illuminatorPosition.x > scenario.center.x,
+            frame.illuminatorPosition.x > frame.center.x);
+}
+
+
+TEST(Scenario, elevationTiles) {
+  ScenarioOptions options;
+  options.lines = 256;
+  options.samples = 256;
+  options.elevationCells = 64;
+  Scenario scenario = createScenario(options);
+  execution::GroundTileKey tiles = scenario.elevationTiles(16);
+  EXPECT_GE(tiles(scenario.center), 0);
+  EXPECT_LT(tiles(scenario.center), 16);
+  EXPECT_EQ(-1, tiles(CartesianPoint(0.0, 0.0, 0.0)));
+
+  execution::TraversalSchedule schedule(*scenario.model, 256, 256, 32, tiles);
+  EXPECT_GT(schedule.groundTileCount(), 1u);
+  EXPECT_LE(schedule.groundTileCount(), 16u);
+
+  EXPECT_THROW(scenario.elevationTiles(0), std::invalid_argument);
+  options.elevationCells = 0;
+  EXPECT_THROW(createScenario(options).elevationTiles(16), std::runtime_error);
+}
+
+
+TEST(Scenario, invalid) {
+  ScenarioOptions options;
+  options.lines = 0;
+  EXPECT_THROW(createScenario(options), std::invalid_argument);
+  options = ScenarioOptions();
+  options.elevationCells = 1;
+  EXPECT_THROW(createScenario(options), std::invalid_argument);
+  options = ScenarioOptions();
+  options.sensor = LineScanner;
+  options.lines = 1;
+  EXPECT_THROW(createScenario(options), std::invalid_argument);
+}
@@ -1,10 +1,16 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
 
+#include "Encoding.h"
+#include "FramingSensorModel.h"
 #include "sensorcore.h"
 #include "Sensor.h"
+#include "SensorModelFixtures.h"
 
 TEST(declination, AlphaCentauri) {
   Sensor sensor("test", "test");
@@ -39,3 +45,168 @@ TEST(rightAscension, AlphaCentauri) {
   double rightAscension = sensor.rightAscension(coords);
   EXPECT_NEAR(219.90205833, rad2deg * rightAscension, 1e-4);
 }
+
+TEST(phaseAngle, sensorModel) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 1.0e6, 0.0));
+  // The image center is the sub-observer point, so phase equals incidence there.
+  EXPECT_NEAR(M_PI/4.0, sensor.phaseAngle(ImagePoint(50.0, 50.0, 1.0)), 1e-4);
+  EXPECT_NEAR(M_PI/4.0, sensor.phaseAngle(CartesianPoint(10.0, 0.0, 0.0)), 1e-4);
+}
+
+TEST(emissionAngle, sensorModel) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 1.0e6, 0.0));
+  EXPECT_NEAR(0.0, sensor.emissionAngle(ImagePoint(50.0, 50.0, 1.0)), 1e-6);
+  // The limb as seen from (100, 0, 0) is where the line of sight is tangent to the sphere.
+  EXPECT_NEAR(M_PI/2.0, sensor.emissionAngle(CartesianPoint(1.0, std::sqrt(99.0), 0.0)), 1e-6);
+}
+
+TEST(incidenceAngle, sensorModel) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 1.0e6, 0.0));
+  EXPECT_NEAR(M_PI/4.0, sensor.incidenceAngle(ImagePoint(50.0, 50.0, 1.0)), 1e-4);
+  EXPECT_NEAR(M_PI/4.0, sensor.incidenceAngle(CartesianPoint(0.0, 10.0, 0.0)), 1e-4);
+}
+
+TEST(incidenceAngle, placeHodor) {
+  Sensor sensor("test", "test");
+  EXPECT_DOUBLE_EQ(0.0, sensor.incidenceAngle(CartesianPoint()));
+  EXPECT_DOUBLE_EQ(0.0, sensor.incidenceAngle(ImagePoint()));
+}
+
+TEST(phaseAngles, matchesScalar) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  std::vector<ImagePoint> points;
+  for (int i = 0; i < 10; i++) {
+    points.push_back(ImagePoint(10.0 * i, 5.0 * i, 1.0));
+  }
+  std::vector<double> phase(points.size()), emission(points.size()), incidence(points.size());
+  sensor.phaseAngles(points.data(), points.size(), phase.data());
+  sensor.emissionAngles(points.data(), points.size(), emission.data());
+  sensor.incidenceAngles(points.data(), points.size(), incidence.data());
+  for (size_t i = 0; i < points.size(); i++) {
+    EXPECT_DOUBLE_EQ(sensor.phaseAngle(points[i]), phase[i]);
+    EXPECT_DOUBLE_EQ(sensor.emissionAngle(points[i]), emission[i]);
+    EXPECT_DOUBLE_EQ(sensor.incidenceAngle(points[i]), incidence[i]);
+  }
+}
+
+TEST(phaseAngles, offBodyIsNaN) {
+  // A frame camera 600 km above Mars; sample 200000 looks 76 degrees off nadir, past the limb.
+  FramingSensorModel model(CartesianPoint(4000.0, 100.0, 50.0), 0.01, -M_PI / 2.0 + 0.02, 0.03,
+                           350.0, 0.007, 1024, 1024, CartesianPoint(3396.19, 3396.19, 3376.2));
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  std::vector<ImagePoint> points{ImagePoint(512.0, 512.0, 1.0),
+                                 ImagePoint(200000.0, 512.0, 1.0)};
+  ASSERT_TRUE(std::isnan(model.imageToGround(points[1]).x));
+
+  EXPECT_FALSE(std::isnan(sensor.phaseAngle(points[0])));
+  EXPECT_TRUE(std::isnan(sensor.phaseAngle(points[1])));
+  EXPECT_TRUE(std::isnan(sensor.emissionAngle(points[1])));
+  EXPECT_TRUE(std::isnan(sensor.incidenceAngle(points[1])));
+
+  std::vector<double> phase(points.size()), emission(points.size()), incidence(points.size());
+  sensor.phaseAngles(points.data(), points.size(), phase.data());
+  sensor.emissionAngles(points.data(), points.size(), emission.data());
+  sensor.incidenceAngles(points.data(), points.size(), incidence.data());
+  EXPECT_DOUBLE_EQ(sensor.phaseAngle(points[0]), phase[0]);
+  EXPECT_DOUBLE_EQ(sensor.emissionAngle(points[0]), emission[0]);
+  EXPECT_DOUBLE_EQ(sensor.incidenceAngle(points[0]), incidence[0]);
+  EXPECT_TRUE(std::isnan(phase[1]));
+  EXPECT_TRUE(std::isnan(emission[1]));
+  EXPECT_TRUE(std::isnan(incidence[1]));
+}
+
+TEST(resolution, sensorModel) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 1.0e6, 0.0));
+  EXPECT_DOUBLE_EQ(0.0, sensor.resolution(ImagePoint(50.0, 50.0, 1.0)));
+  sensor.setDetector(500.0, 0.1, 1.0);
+  // 90 km from the sub-observer point: (90 / (500 / 0.1)) * 1000 m/pixel.
+  EXPECT_NEAR(18.0, sensor.resolution(ImagePoint(50.0, 50.0, 1.0)), 1e-9);
+  EXPECT_NEAR(18.0, sensor.resolution(CartesianPoint(10.0, 0.0, 0.0)), 1e-9);
+}
+
+TEST(phaseAngles, encodedOutput) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.001);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  sensor.setDetector(500.0, 0.1, 1.0);
+  std::vector<ImagePoint> points;
+  for (int i = 0; i < 10; i++) {
+    points.push_back(ImagePoint(10.0 * i, 5.0 * i, 1.0));
+  }
+  std::vector<uint16_t> angles(points.size()), resolutions(points.size());
+  sensor.phaseAngles(points.data(), points.size(),
+                     EncodedBuffer(Encoding::AngleFixed16, angles.data()));
+  sensor.resolutions(points.data(), points.size(),
+                     EncodedBuffer(Encoding::LogScaled16, resolutions.data(), 1.0, 1.0e4));
+  for (size_t i = 0; i < points.size(); i++) {
+    EXPECT_NEAR(sensor.phaseAngle(points[i]), decodeAngle(angles[i]), ANGLE_QUANTIZATION_ERROR);
+    double resolution = sensor.resolution(points[i]);
+    EXPECT_NEAR(resolution, decodeLog(resolutions[i], 1.0, 1.0e4), resolution * 1.0e-4);
+  }
+}
+
+TEST(encodeAngle, quantizationError) {
+  double maxError = 0.0;
+  for (int i = 0; i <= 100000; i++) {
+    double angle = M_PI * i / 100000.0;
+    maxError = std::max(maxError, std::fabs(angle - decodeAngle(encodeAngle(angle))));
+  }
+  EXPECT_LE(maxError, ANGLE_QUANTIZATION_ERROR * (1.0 + 1e-9));
+  EXPECT_GT(maxError, 0.5 * ANGLE_QUANTIZATION_ERROR);
+  EXPECT_EQ(0, encodeAngle(-0.1));
+  EXPECT_EQ(65534, encodeAngle(4.0));
+  EXPECT_EQ(NO_DATA_CODE, encodeAngle(NAN));
+  EXPECT_TRUE(std::isnan(decodeAngle(NO_DATA_CODE)));
+}
+
+TEST(encodeHalf, knownValues) {
+  EXPECT_EQ(0x3c00, encodeHalf(1.0));
+  EXPECT_EQ(0xc000, encodeHalf(-2.0));
+  EXPECT_EQ(0x7bff, encodeHalf(65504.0));
+  EXPECT_EQ(0x7c00, encodeHalf(1.0e5));
+  EXPECT_EQ(0x0001, encodeHalf(std::ldexp(1.0, -24)));
+  EXPECT_EQ(0x0000, encodeHalf(std::ldexp(1.0, -26)));
+  EXPECT_EQ(0x3c00, encodeHalf(1.0 + std::ldexp(1.0, -11)));
+  EXPECT_EQ(0x3c02, encodeHalf(1.0 + 3.0 * std::ldexp(1.0, -11)));
+  EXPECT_DOUBLE_EQ(65504.0, decodeHalf(0x7bff));
+  EXPECT_DOUBLE_EQ(std::ldexp(1.0, -24), decodeHalf(0x0001));
+  EXPECT_TRUE(std::isnan(decodeHalf(encodeHalf(NAN))));
+}
+
+TEST(encodeHalf, relativeError) {
+  for (double value = 1.0e-4; value < 6.0e4; value *= 1.01) {
+    EXPECT_NEAR(value, decodeHalf(encodeHalf(value)), value * std::ldexp(1.0, -11));
+  }
+}
+
+TEST(encodeLog, relativeError) {
+  const double minimum = 0.1, maximum = 1.0e5;
+  const double bound = std::exp(std::log(maximum / minimum) / 131068.0) - 1.0;
+  for (double value = minimum; value < maximum; value *= 1.013) {
+    EXPECT_NEAR(value, decodeLog(encodeLog(value, minimum, maximum), minimum, maximum),
+                value * bound * (1.0 + 1e-6));
+  }
+  EXPECT_EQ(NO_DATA_CODE, encodeLog(0.0, minimum, maximum));
+  EXPECT_EQ(NO_DATA_CODE, encodeLog(NAN, minimum, maximum));
+  EXPECT_EQ(65534, encodeLog(1.0e9, minimum, maximum));
+  // An invalid range stores no data rather than converting NaN to a code.
+  EXPECT_EQ(NO_DATA_CODE, encodeLog(1.0, 0.0, 0.0));
+}
+
+TEST(encodeLog, invalidRange) {
+  uint16_t code;
+  EXPECT_THROW(EncodingFormat(Encoding::LogScaled16), std::invalid_argument);
+  EXPECT_THROW(EncodingFormat(Encoding::LogScaled16, 0.0, 10.0), std::invalid_argument);
+  EXPECT_THROW(EncodingFormat(Encoding::LogScaled16, 10.0, 10.0), std::invalid_argument);
+  EXPECT_THROW(EncodedBuffer(Encoding::LogScaled16, &code), std::invalid_argument);
+  EXPECT_THROW(EncodedBuffer(Encoding::LogScaled16, &code, 2.0, 1.0), std::invalid_argument);
+  EncodingFormat format(Encoding::LogScaled16, 1.0, 10.0);
+  format.maximum = -1.0;
+  EXPECT_THROW(EncodedBuffer(format, &code), std::invalid_argument);
+  // The range only matters to LogScaled16.
+  EXPECT_NO_THROW(EncodingFormat(Encoding::Half, 0.0, 0.0));
+}
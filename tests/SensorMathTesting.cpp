@@ -180,3 +180,39 @@ TEST(lat2rect,AlphaCentauri) {
   EXPECT_NEAR(-1.15686,cartesian[2],1e-4);
 }
 
+
+TEST(rect2lat, batch) {
+  double coords[] = {1.0, 1.0, 1.0,   0.0, 0.0, 0.0,   0.0, 1.0, 0.0};
+  double radiusLatLong[9];
+  sensormath::rect2lat(coords, 3, radiusLatLong);
+  for (int i = 0; i < 3; i++) {
+    vector<double> expected = sensormath::rect2lat(vector<double>(coords + 3 * i, coords + 3 * i + 3));
+    for (int j = 0; j < 3; j++) {
+      EXPECT_NEAR(expected[j], radiusLatLong[3 * i + j], 1e-12);
+    }
+  }
+}
+
+
+TEST(rect2lat, batchTinyAndHuge) {
+  double coords[] = {1e-200, 0.0, 0.0,   0.0, 1e200, 1e200};
+  double radiusLatLong[6];
+  sensormath::rect2lat(coords, 2, radiusLatLong);
+  EXPECT_DOUBLE_EQ(1e-200, radiusLatLong[0]);
+  EXPECT_DOUBLE_EQ(0.0, radiusLatLong[1]);
+  EXPECT_DOUBLE_EQ(0.0, radiusLatLong[2]);
+  EXPECT_DOUBLE_EQ(std::sqrt(2.0) * 1e200, radiusLatLong[3]);
+  EXPECT_NEAR(M_PI / 4.0, radiusLatLong[4], 1e-12);
+  EXPECT_NEAR(M_PI / 2.0, radiusLatLong[5], 1e-12);
+}
+
+
+TEST(rect2lat, batchInPlace) {
+  double coords[] = {1.0, 1.0, 1.0,   0.0, 0.0, 0.0,   0.0, 1.0, 0.0};
+  double expected[9];
+  sensormath::rect2lat(coords, 3, expected);
+  sensormath::rect2lat(coords, 3, coords);
+  for (int i = 0; i < 9; i++) {
+    EXPECT_DOUBLE_EQ(expected[i], coords[i]);
+  }
+}
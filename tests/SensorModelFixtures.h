@@ -0,0 +1,99 @@
+#ifndef SensorModelFixtures_h
+#define SensorModelFixtures_h
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+#include "sensorcore.h"
+#include "SensorModel.h"
+
+/**
+ * A simple sensor model for tests: image samples and lines map linearly to longitude and
+ * latitude on a sphere, seen from a fixed observer. Image point (0, 0) is at the upper left
+ * and the image center is the sub-observer point when the observer is on the +x axis.
+ */
+class SphereSensorModel final : public SensorModelBase<SphereSensorModel> {
+
+  public:
+    SphereSensorModel(double radius, const CartesianPoint &observer, double lines,
+                      double samples, double radiansPerPixel)
+        : m_radius(radius), m_observer(observer), m_lines(lines), m_samples(samples),
+          m_radiansPerPixel(radiansPerPixel), m_imageToGroundCalls(0) {
+    }
+
+    CartesianPoint imageToGround(const ImagePoint &imagePoint) const {
+      m_imageToGroundCalls++;
+      double longitude = (imagePoint.sample - 0.5 * m_samples) * m_radiansPerPixel;
+      double latitude = (0.5 * m_lines - imagePoint.line) * m_radiansPerPixel;
+      return CartesianPoint(m_radius * std::cos(latitude) * std::cos(longitude),
+                            m_radius * std::cos(latitude) * std::sin(longitude),
+                            m_radius * std::sin(latitude));
+    }
+
+    ImagePoint groundToImage(const CartesianPoint &groundPoint) const {
+      double longitude = std::atan2(groundPoint.y, groundPoint.x);
+      double latitude = std::atan2(groundPoint.z, std::sqrt(groundPoint.x * groundPoint.x
+                                                            + groundPoint.y * groundPoint.y));
+      return ImagePoint(longitude / m_radiansPerPixel + 0.5 * m_samples,
+                        0.5 * m_lines - latitude / m_radiansPerPixel, 1.0);
+    }
+
+    CartesianVector groundToLook(const CartesianPoint &groundPoint) const {
+      return CartesianVector(groundPoint.x - m_observer.x, groundPoint.y - m_observer.y,
+                             groundPoint.z - m_observer.z);
+    }
+
+    double imageTime(const ImagePoint &) const {
+      return 0.0;
+    }
+
+    size_t imageToGroundCalls() const {
+      return m_imageToGroundCalls;
+    }
+
+  private:
+    double m_radius;
+    CartesianPoint m_observer;
+    double m_lines;
+    double m_samples;
+    double m_radiansPerPixel;
+    mutable std::atomic<size_t> m_imageToGroundCalls;
+};
+
+
+/**
+ * A sensor model for error handling tests: imageToGround throws std::runtime_error for image
+ * lines at or beyond failingLine, and behaves like a 10 km sphere seen from +x elsewhere.
+ */
+class FailingSensorModel final : public SensorModelBase<FailingSensorModel> {
+
+  public:
+    explicit FailingSensorModel(double failingLine) : m_failingLine(failingLine) {
+    }
+
+    CartesianPoint imageToGround(const ImagePoint &imagePoint) const {
+      if (imagePoint.line >= m_failingLine) {
+        throw std::runtime_error("Image point cannot be intersected");
+      }
+      return CartesianPoint(10.0, 0.001 * imagePoint.sample, 0.001 * imagePoint.line);
+    }
+
+    ImagePoint groundToImage(const CartesianPoint &groundPoint) const {
+      return ImagePoint(1000.0 * groundPoint.y, 1000.0 * groundPoint.z, 1.0);
+    }
+
+    CartesianVector groundToLook(const CartesianPoint &groundPoint) const {
+      return CartesianVector(groundPoint.x - 100.0, groundPoint.y, groundPoint.z);
+    }
+
+    double imageTime(const ImagePoint &) const {
+      return 0.0;
+    }
+
+  private:
+    double m_failingLine;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "SensorModel.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sensorcore.h"
+#include "Sensor.h"
+#include "SensorModelFixtures.h"
+
+namespace {
+
+  // Implements only the per-point methods, so the batch methods use the SensorModel defaults.
+  class PointSensorModel : public SensorModel {
+
+    public:
+      PointSensorModel(const SphereSensorModel &model) : m_model(model) {}
+
+      CartesianPoint imageToGround(const ImagePoint &imagePoint) const {
+        return m_model.imageToGround(imagePoint);
+      }
+
+      ImagePoint groundToImage(const CartesianPoint &groundPoint) const {
+        return m_model.groundToImage(groundPoint);
+      }
+
+      CartesianVector groundToLook(const CartesianPoint &groundPoint) const {
+        return m_model.groundToLook(groundPoint);
+      }
+
+      double imageTime(const ImagePoint &imagePoint) const {
+        return m_model.imageTime(imagePoint);
+      }
+
+    private:
+      const SphereSensorModel &m_model;
+  };
+
+
+  // Claims sensor parameters without computing their partials.
+  class ParameterizedSensorModel : public PointSensorModel {
+
+    public:
+      ParameterizedSensorModel(const SphereSensorModel &model) : PointSensorModel(model) {}
+
+      int parameterCount() const {
+        return 2;
+      }
+  };
+}
+
+
+TEST(SensorModel, defaultBatchMatchesPerPoint) {
+  const SphereSensorModel sphere(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.01);
+  PointSensorModel model(sphere);
+  const SensorModel &base = model;
+  std::vector<ImagePoint> images;
+  for (int i = 0; i < 7; i++) {
+    images.push_back(ImagePoint(3.0 * i, 100.0 - 11.0 * i, 1.0));
+  }
+  std::vector<CartesianPoint> ground(images.size());
+  std::vector<CartesianVector> look(images.size());
+  std::vector<ImagePoint> projected(images.size());
+  std::vector<double> times(images.size(), -1.0);
+  base.imageToGround(images.data(), images.size(), ground.data());
+  base.groundToLook(ground.data(), ground.size(), look.data());
+  base.groundToImage(ground.data(), ground.size(), projected.data());
+  base.imageTime(images.data(), images.size(), times.data());
+  for (size_t i = 0; i < images.size(); i++) {
+    CartesianPoint expected = sphere.imageToGround(images[i]);
+    EXPECT_DOUBLE_EQ(expected.x, ground[i].x);
+    EXPECT_DOUBLE_EQ(expected.y, ground[i].y);
+    EXPECT_DOUBLE_EQ(expected.z, ground[i].z);
+    EXPECT_DOUBLE_EQ(expected.x - 100.0, look[i].x);
+    EXPECT_NEAR(images[i].sample, projected[i].sample, 1e-9);
+    EXPECT_NEAR(images[i].line, projected[i].line, 1e-9);
+    EXPECT_EQ(0.0, times[i]);
+  }
+}
+
+
+TEST(SensorModelBase, batchUsesModelPerPoint) {
+  const SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.01);
+  const SensorModel &base = model;
+  ImagePoint images[3] = {ImagePoint(0.0, 0.0, 1.0), ImagePoint(50.0, 50.0, 1.0),
+                          ImagePoint(99.0, 10.0, 1.0)};
+  CartesianPoint ground[3];
+  base.imageToGround(images, 3, ground);
+  EXPECT_EQ(3u, model.imageToGroundCalls());
+  for (int i = 0; i < 3; i++) {
+    CartesianPoint expected = model.imageToGround(images[i]);
+    EXPECT_DOUBLE_EQ(expected.x, ground[i].x);
+    EXPECT_DOUBLE_EQ(expected.y, ground[i].y);
+    EXPECT_DOUBLE_EQ(expected.z, ground[i].z);
+  }
+}
+
+
+TEST(SensorModelBase, sensorBatchesMatchDefaultModel) {
+  const SphereSensorModel sphere(10.0, CartesianPoint(100.0, 0.0, 0.0), 40, 30, 0.01);
+  PointSensorModel point(sphere);
+  Sensor inlined(&sphere, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  Sensor fallback(&point, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  // More points than one sensor model batch.
+  std::vector<ImagePoint> images;
+  for (int line = 0; line < 40; line++) {
+    for (int sample = 0; sample < 30; sample++) {
+      images.push_back(ImagePoint(sample + 0.5, line + 0.5, 1.0));
+    }
+  }
+  std::vector<double> inlinedPhase(images.size()), fallbackPhase(images.size());
+  inlined.phaseAngles(images.data(), images.size(), inlinedPhase.data());
+  fallback.phaseAngles(images.data(), images.size(), fallbackPhase.data());
+  for (size_t i = 0; i < images.size(); i++) {
+    EXPECT_EQ(fallbackPhase[i], inlinedPhase[i]);
+    EXPECT_DOUBLE_EQ(inlined.phaseAngle(images[i]), inlinedPhase[i]);
+  }
+}
+
+
+TEST(SensorModel, defaultPartialsNeedSensorOverride) {
+  const SphereSensorModel sphere(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 100, 0.01);
+  ParameterizedSensorModel model(sphere);
+  const SensorModel &base = model;
+  CartesianPoint ground = sphere.imageToGround(ImagePoint(40.0, 60.0, 1.0));
+  ImagePoint image;
+  std::vector<double> groundPartials(6), sensorPartials(4), matrix(2 * 5);
+  size_t groundColumn = 0;
+  EXPECT_THROW(base.groundToImage(&ground, 1, &image,
+                                  PartialsBuffer(groundPartials.data(), sensorPartials.data())),
+               std::logic_error);
+  EXPECT_THROW(base.groundToImage(&ground, 1, &image,
+                                  PartialsBuffer(matrix.data(), 5, 0, &groundColumn, 3)),
+               std::logic_error);
+  // Ground partials alone are still computed numerically.
+  base.groundToImage(&ground, 1, &image, PartialsBuffer(groundPartials.data(), NULL));
+  EXPECT_NEAR(40.0, image.sample, 1e-9);
+  EXPECT_NE(0.0, groundPartials[1]);
+}
@@ -157,6 +157,52 @@ TEST(offNadirAngle,zeroVector) {
   EXPECT_NEAR(0.0,rad2deg*theta,1e-4);
 }
 
+
+TEST(PhaseAngles, matchesPhaseAngle) {
+  double observer[] = {10.0, 2.0, -3.0};
+  double illuminators[] = {1.0, 0.0, 0.0,   -1.0, 1.0, 0.0,   0.0, 5.0, 5.0};
+  double surface[] = {0.0, 0.0, 0.0,   1.0, 1.0, 1.0,   0.0, 5.0, 5.0};
+  double angles[3];
+  PhaseAngles(observer, 0, illuminators, 3, surface, 3, angles);
+  for (int i = 0; i < 3; i++) {
+    vector<double> observerVector(observer, observer + 3);
+    vector<double> illuminatorVector(illuminators + 3 * i, illuminators + 3 * i + 3);
+    vector<double> surfaceVector(surface + 3 * i, surface + 3 * i + 3);
+    EXPECT_NEAR(PhaseAngle(observerVector, illuminatorVector, surfaceVector), angles[i], 1e-12);
+  }
+}
+
+
+TEST(EmissionAngles, matchesEmissionAngle) {
+  double observers[] = {2.0, 0.0, 0.0,   1.0, 1.0, 1.0,   0.0, 0.0, 0.0};
+  double ground[] = {1.0, 0.0, 0.0,   0.0, 0.0, 0.0,   0.0, 0.0, 0.0};
+  double normals[] = {1.0, 0.0, 0.0,   -2.0, -2.0, 2.0,   0.0, 0.0, 0.0};
+  double angles[3];
+  EmissionAngles(observers, 3, ground, normals, 3, angles);
+  for (int i = 0; i < 3; i++) {
+    vector<double> observerVector(observers + 3 * i, observers + 3 * i + 3);
+    vector<double> groundVector(ground + 3 * i, ground + 3 * i + 3);
+    vector<double> normalVector(normals + 3 * i, normals + 3 * i + 3);
+    EXPECT_NEAR(EmissionAngle(observerVector, groundVector, normalVector), angles[i], 1e-12);
+  }
+  EXPECT_NEAR(0.0, angles[0], 1e-5);
+  EXPECT_NEAR(M_PI, angles[1], 1e-5);
+  EXPECT_NEAR(M_PI / 2.0, angles[2], 1e-5);
+}
+
+
+TEST(computeRADec, batch) {
+  double coords[] = {-0.495304, -0.414169, -1.15686,   0.0, 1.0, 0.0};
+  double radec[4];
+  computeRADec(coords, 2, radec);
+  vector<double> expected = computeRADec(vector<double>(coords, coords + 3));
+  EXPECT_DOUBLE_EQ(expected[0], radec[0]);
+  EXPECT_DOUBLE_EQ(expected[1], radec[1]);
+  EXPECT_NEAR(M_PI / 2.0, radec[2], 1e-12);
+  EXPECT_NEAR(0.0, radec[3], 1e-12);
+}
+
+
 int main(int argc, char **argv) {
    ::testing::InitGoogleTest(&argc, argv);
    return RUN_ALL_TESTS();
@@ -0,0 +1,227 @@
+#include "ShardedJob.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "Backplane.h"
+#include "Encoding.h"
+#include "FramingSensorModel.h"
+#include "sensorcore.h"
+#include "Sensor.h"
+
+using namespace backplane;
+
+namespace {
+
+  // A 100 x 130 frame about 600 km above a Mars-sized ellipsoid, in 32 pixel tiles.
+  JobDescription job(const std::string &output, int shards, Quantity quantity = Phase) {
+    JobDescription job;
+    job.quantity = quantity;
+    job.lines = 100;
+    job.samples = 130;
+    job.tileSize = 32;
+    job.shards = shards;
+    job.output = output;
+    job.cameraPosition = CartesianPoint(4000.0, 100.0, 50.0);
+    job.omega = 0.01;
+    job.phi = -M_PI / 2.0 + 0.02;
+    job.kappa = 0.03;
+    job.focalLength = 350.0;
+    job.pixelPitch = 0.007;
+    job.bodyRadii = CartesianPoint(3396.19, 3396.19, 3376.2);
+    job.illuminatorPosition = CartesianPoint(1.0e8, 2.0e7, 3.0e7);
+    return job;
+  }
+
+
+  std::string readFile(const std::string &path) {
+    std::ifstream input(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+  }
+
+
+  // The product of a single-process generate() of the job.
+  std::string singleProcess(const JobDescription &job) {
+    FramingSensorModel model(job.cameraPosition, job.omega, job.phi, job.kappa, job.focalLength,
+                             job.pixelPitch, double(job.lines), double(job.samples),
+                             job.bodyRadii);
+    Sensor sensor(&model, job.illuminatorPosition);
+    sensor.setDetector(job.focalLength, job.pixelPitch, job.summing);
+    PyramidBuffer buffer;
+    generate(sensor, job.quantity, job.lines, job.samples, 1, Direct, buffer, 256, job.format);
+    if (job.format.encoding == Encoding::Float64) {
+      return std::string(reinterpret_cast<const char *>(buffer.levels[0].data()),
+                         buffer.levels[0].size() * sizeof(double));
+    }
+    return std::string(reinterpret_cast<const char *>(buffer.codes[0].data()),
+                       buffer.codes[0].size() * sizeof(uint16_t));
+  }
+
+
+  // Runs every shard of a job in its own process.
+  void runInProcesses(const JobDescription &job) {
+    std::vector<pid_t> children;
+    for (int shard = 0; shard < job.shards; shard++) {
+      pid_t child = fork();
+      ASSERT_GE(child, 0);
+      if (child == 0) {
+        try {
+          runShard(job, shard);
+        }
+        catch (...) {
+          _exit(1);
+        }
+        _exit(0);
+      }
+      children.push_back(child);
+    }
+    for (size_t i = 0; i < children.size(); i++) {
+      int status = 0;
+      ASSERT_EQ(children[i], waitpid(children[i], &status, 0));
+      EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+  }
+
+
+  class ShardedJobTest : public ::testing::Test {
+
+    protected:
+      void SetUp() {
+        char directory[] = "/tmp/ShardedJobTesting-XXXXXX";
+        ASSERT_TRUE(mkdtemp(directory) != NULL);
+        m_directory = directory;
+      }
+
+      void TearDown() {
+        std::string command = "rm -rf '" + m_directory + "'";
+        EXPECT_EQ(0, std::system(command.c_str()));
+      }
+
+      std::string m_directory;
+  };
+}
+
+
+TEST(ShardedJob, jobRoundTrip) {
+  JobDescription original = job("/data/mosaic.phase", 7, Resolution);
+  original.format = EncodingFormat(Encoding::LogScaled16, 1.0, 1000.0);
+  original.summing = 2.0;
+  std::ostringstream text;
+  writeJob(original, text);
+
+  std::istringstream input("# A comment\n\n" + text.str());
+  JobDescription read = readJob(input);
+  std::ostringstream again;
+  writeJob(read, again);
+  EXPECT_EQ(text.str(), again.str());
+  EXPECT_EQ(Resolution, read.quantity);
+  EXPECT_EQ(Encoding::LogScaled16, read.format.encoding);
+  EXPECT_EQ(original.phi, read.phi);
+  EXPECT_EQ("/data/mosaic.phase", read.output);
+}
+
+
+TEST(ShardedJob, invalidJob) {
+  std::istringstream unknown("lines = 10\nsamples = 10\noutput = x\ncolor = red\n");
+  EXPECT_THROW(readJob(unknown), std::invalid_argument);
+  std::istringstream malformed("lines 10\n");
+  EXPECT_THROW(readJob(malformed), std::invalid_argument);
+  std::istringstream incomplete("lines = 10\noutput = x\n");
+  EXPECT_THROW(readJob(incomplete), std::invalid_argument);
+  std::istringstream badVector("lines = 10\nsamples = 10\noutput = x\nbody_radii = 1 2\n");
+  EXPECT_THROW(readJob(badVector), std::invalid_argument);
+  std::istringstream noRange("lines = 10\nsamples = 10\noutput = x\nencoding = log16\n");
+  EXPECT_THROW(readJob(noRange), std::invalid_argument);
+  std::istringstream badRange("lines = 10\nsamples = 10\noutput = x\nencoding = log16\n"
+                              "encoding_minimum = 5\nencoding_maximum = 5\n");
+  EXPECT_THROW(readJob(badRange), std::invalid_argument);
+  // Integer keys take whole numbers only; nothing is truncated or wrapped.
+  const char *badIntegers[] = {"lines = 12.7", "tile_size = 4.9", "tile_size = 5e9",
+                               "shards = 3000000000", "samples = 99999999999999999999",
+                               "lines = 12 13", "lines = ten"};
+  for (const char *badInteger : badIntegers) {
+    std::istringstream text("lines = 10\nsamples = 10\noutput = x\n" + std::string(badInteger)
+                            + "\n");
+    EXPECT_THROW(readJob(text), std::invalid_argument) << badInteger;
+  }
+  EXPECT_THROW(shardRange(job("x", 3), 3), std::out_of_range);
+}
+
+
+TEST(ShardedJob, shardRangesCoverTiles) {
+  JobDescription small = job("x", 3);
+  EXPECT_EQ(20, tileCount(small));
+  int64_t next = 0;
+  for (int shard = 0; shard < small.shards; shard++) {
+    ShardRange range = shardRange(small, shard);
+    EXPECT_EQ(next, range.firstTile);
+    EXPECT_GE(range.tileCount, 6);
+    next += range.tileCount;
+  }
+  EXPECT_EQ(20, next);
+
+  JobDescription many = job("x", 25);
+  int64_t total = 0;
+  for (int shard = 0; shard < many.shards; shard++) {
+    total += shardRange(many, shard).tileCount;
+  }
+  EXPECT_EQ(20, total);
+}
+
+
+TEST_F(ShardedJobTest, processesMatchSingleProcess) {
+  JobDescription phase = job(m_directory + "/phase.raw", 3);
+  runInProcesses(phase);
+  mergeShards(phase);
+  EXPECT_EQ(singleProcess(phase), readFile(phase.output));
+
+  JobDescription emission = job(m_directory + "/emission.raw", 4, Emission);
+  emission.format = EncodingFormat(Encoding::AngleFixed16);
+  runInProcesses(emission);
+  mergeShards(emission);
+  std::string product = readFile(emission.output);
+  EXPECT_EQ(size_t(100 * 130 * 2), product.size());
+  EXPECT_EQ(singleProcess(emission), product);
+
+  // More shards than tile rows (and some empty shards) still give the same product.
+  JobDescription fine = job(m_directory + "/fine.raw", 25);
+  runInProcesses(fine);
+  mergeShards(fine);
+  EXPECT_EQ(readFile(phase.output), readFile(fine.output));
+}
+
+
+TEST_F(ShardedJobTest, restart) {
+  JobDescription phase = job(m_directory + "/phase.raw", 3);
+  EXPECT_TRUE(runShard(phase, 0));
+  EXPECT_TRUE(runShard(phase, 2));
+  EXPECT_THROW(mergeShards(phase), std::runtime_error);
+
+  // A shard left half-written by an interrupted run is recomputed; complete ones are skipped.
+  std::string interrupted = shardPath(phase, 1);
+  std::ofstream(interrupted.c_str()) << "partial";
+  EXPECT_FALSE(shardComplete(phase, 1));
+  EXPECT_FALSE(runShard(phase, 0));
+  EXPECT_TRUE(runShard(phase, 1));
+  EXPECT_FALSE(runShard(phase, 1));
+  mergeShards(phase);
+  EXPECT_EQ(singleProcess(phase), readFile(phase.output));
+
+  // Shards of a different job are not reused.
+  JobDescription emission = job(phase.output, 3, Emission);
+  EXPECT_FALSE(shardComplete(emission, 0));
+}
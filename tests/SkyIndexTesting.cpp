@@ -0,0 +1,210 @@
+#include "SkyIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sensorcore.h"
+
+using namespace skyindex;
+
+namespace {
+  double dotProduct(const CartesianVector &a, const CartesianVector &b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+  }
+
+
+  // Deterministic uniform sample of the sphere (Fibonacci lattice).
+  std::vector<CatalogEntry> fibonacciCatalog(size_t count) {
+    std::vector<CatalogEntry> catalog;
+    const double golden = M_PI * (3.0 - std::sqrt(5.0));
+    for (size_t i = 0; i < count; i++) {
+      double z = 1.0 - 2.0 * (i + 0.5) / count;
+      double ra = std::fmod(golden * i, 2.0 * M_PI);
+      catalog.push_back(CatalogEntry(ra, std::asin(z), 1000 + i));
+    }
+    return catalog;
+  }
+}
+
+
+TEST(pixelToVector, baseFaces) {
+  CartesianVector center = pixelToVector(0, 0);
+  EXPECT_NEAR(2.0/3.0, center.z, 1e-12);
+  EXPECT_NEAR(M_PI/4.0, std::atan2(center.y, center.x), 1e-12);
+
+  center = pixelToVector(4, 0);
+  EXPECT_NEAR(0.0, center.z, 1e-12);
+  EXPECT_NEAR(0.0, center.y, 1e-12);
+
+  center = pixelToVector(8, 0);
+  EXPECT_NEAR(-2.0/3.0, center.z, 1e-12);
+}
+
+
+TEST(vectorToPixel, roundTrip) {
+  for (int order = 0; order <= 6; order += 3) {
+    for (int64_t pixel = 0; pixel < pixelCount(order); pixel++) {
+      EXPECT_EQ(pixel, vectorToPixel(pixelToVector(pixel, order), order));
+    }
+  }
+}
+
+
+TEST(vectorToPixel, poles) {
+  EXPECT_EQ(0, vectorToPixel(CartesianVector(0.0, 0.0, 5.0), 0));
+  EXPECT_EQ(8, vectorToPixel(CartesianVector(0.0, 0.0, -1.0), 0));
+  EXPECT_EQ(4, vectorToPixel(CartesianVector(1.0, 0.0, 0.0), 0));
+}
+
+
+TEST(vectorToPixel, equalArea) {
+  // Every pixel should receive about the same number of uniformly distributed points.
+  const int order = 2;
+  std::vector<int> counts(pixelCount(order), 0);
+  std::vector<CatalogEntry> catalog = fibonacciCatalog(192000);
+  for (size_t i = 0; i < catalog.size(); i++) {
+    counts[vectorToPixel(raDecToVector(catalog[i].rightAscension, catalog[i].declination),
+                         order)]++;
+  }
+  for (size_t i = 0; i < counts.size(); i++) {
+    EXPECT_NEAR(1000, counts[i], 30);
+  }
+}
+
+
+TEST(neighbors, symmetric) {
+  const int order = 3;
+  for (int64_t pixel = 0; pixel < pixelCount(order); pixel++) {
+    int64_t result[8];
+    neighbors(pixel, order, result);
+    int missing = 0;
+    for (int i = 0; i < 8; i++) {
+      if (result[i] < 0) {
+        missing++;
+        continue;
+      }
+      int64_t back[8];
+      neighbors(result[i], order, back);
+      EXPECT_NE(back + 8, std::find(back, back + 8, pixel));
+      double separation = std::acos(std::min(1.0, dotProduct(pixelToVector(pixel, order),
+                                                             pixelToVector(result[i], order))));
+      EXPECT_LT(separation, 2.0 * maxPixelRadius(order));
+    }
+    EXPECT_LE(missing, 1);
+  }
+}
+
+
+TEST(neighbors, interior) {
+  int64_t result[8];
+  // Pixel 12 at order 2 is (x, y) = (2, 2) on face 0.
+  neighbors(12, 2, result);
+  int64_t expected[8] = { 9, 11, 14, 15, 13, 7, 6, 3 };
+  for (int i = 0; i < 8; i++) {
+    EXPECT_EQ(expected[i], result[i]);
+  }
+}
+
+
+TEST(SkyIndex, coneSearchMatchesBruteForce) {
+  std::vector<CatalogEntry> catalog = fibonacciCatalog(20000);
+  SkyIndex index(catalog, 5);
+  ASSERT_EQ(catalog.size(), index.size());
+
+  std::vector<CartesianVector> centers;
+  centers.push_back(CartesianVector(0.0, 0.0, 1.0));
+  centers.push_back(CartesianVector(0.0, 0.0, -1.0));
+  centers.push_back(CartesianVector(1.0, 1.0, 0.0));
+  centers.push_back(CartesianVector(-0.495304, -0.414169, -1.15686));
+
+  const double radii[3] = { 0.01, 0.05, 0.3 };
+  for (int r = 0; r < 3; r++) {
+    std::vector<size_t> offsets, matches;
+    index.coneSearch(centers.data(), centers.size(), radii[r], offsets, matches);
+    ASSERT_EQ(centers.size() + 1, offsets.size());
+
+    for (size_t c = 0; c < centers.size(); c++) {
+      std::vector<uint64_t> expected;
+      double length = std::sqrt(dotProduct(centers[c], centers[c]));
+      for (size_t i = 0; i < catalog.size(); i++) {
+        CartesianVector star = raDecToVector(catalog[i].rightAscension, catalog[i].declination);
+        if (dotProduct(star, centers[c]) / length >= std::cos(radii[r])) {
+          expected.push_back(catalog[i].id);
+        }
+      }
+      std::vector<uint64_t> found;
+      for (size_t m = offsets[c]; m < offsets[c + 1]; m++) {
+        found.push_back(index.id(matches[m]));
+      }
+      std::sort(expected.begin(), expected.end());
+      std::sort(found.begin(), found.end());
+      EXPECT_EQ(expected, found);
+
+      std::vector<size_t> single;
+      index.coneSearch(centers[c], radii[r], single);
+      EXPECT_EQ(offsets[c + 1] - offsets[c], single.size());
+    }
+  }
+}
+
+
+TEST(SkyIndex, saveAndLoad) {
+  std::vector<CatalogEntry> catalog = fibonacciCatalog(500);
+  SkyIndex index(catalog, 4);
+  const char *path = "SkyIndexTesting.idx";
+  index.save(path);
+
+  SkyIndex mapped = SkyIndex::load(path);
+  ASSERT_EQ(index.size(), mapped.size());
+  EXPECT_EQ(4, mapped.order());
+  for (size_t i = 0; i < index.size(); i++) {
+    EXPECT_EQ(index.pixel(i), mapped.pixel(i));
+    EXPECT_EQ(index.id(i), mapped.id(i));
+    EXPECT_DOUBLE_EQ(index.direction(i).z, mapped.direction(i).z);
+  }
+
+  std::vector<size_t> expected, found;
+  index.coneSearch(CartesianVector(1.0, 0.0, 0.0), 0.2, expected);
+  mapped.coneSearch(CartesianVector(1.0, 0.0, 0.0), 0.2, found);
+  EXPECT_EQ(expected, found);
+  std::remove(path);
+}
+
+
+TEST(SkyIndex, loadRejectsInvalidFile) {
+  EXPECT_THROW(SkyIndex::load("does-not-exist.idx"), std::runtime_error);
+
+  // A count whose size in bytes wraps around to the real file size.
+  SkyIndex index(fibonacciCatalog(500), 4);
+  const char *path = "SkyIndexTesting-wrapped.idx";
+  index.save(path);
+  uint64_t count = 500 + (uint64_t(1) << 61);
+  std::FILE *file = std::fopen(path, "r+b");
+  ASSERT_TRUE(file != NULL);
+  ASSERT_EQ(0, std::fseek(file, 24, SEEK_SET));
+  ASSERT_EQ(size_t(1), std::fwrite(&count, sizeof(count), 1, file));
+  std::fclose(file);
+  EXPECT_THROW(SkyIndex::load(path), std::runtime_error);
+  std::remove(path);
+}
+
+
+TEST(SkyIndex, rejectsNonFiniteDirections) {
+  EXPECT_THROW(vectorToPixel(CartesianVector(NAN, 0.0, 1.0), 0), std::invalid_argument);
+  EXPECT_THROW(vectorToPixel(CartesianVector(0.0, INFINITY, 0.0), 5), std::invalid_argument);
+  int64_t pixel = vectorToPixel(CartesianVector(1e-200, 0.0, 1e-201), 3);
+  EXPECT_EQ(vectorToPixel(CartesianVector(1.0, 0.0, 0.1), 3), pixel);
+
+  std::vector<CatalogEntry> catalog = fibonacciCatalog(10);
+  catalog[3].declination = NAN;
+  EXPECT_THROW(SkyIndex(catalog, 4), std::invalid_argument);
+  catalog[3].declination = 0.0;
+  catalog[7].rightAscension = INFINITY;
+  EXPECT_THROW(SkyIndex(catalog, 4), std::invalid_argument);
+}
@@ -0,0 +1,190 @@
+#include "StreamingStatistics.h"
+
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Backplane.h"
+#include "Encoding.h"
+#include "Sensor.h"
+#include "SensorModelFixtures.h"
+#include "ThreadPool.h"
+
+using namespace statistics;
+
+TEST(StreamingStatistics, emptySummary) {
+  StreamingStatistics summary;
+  EXPECT_EQ(0u, summary.count());
+  EXPECT_TRUE(std::isnan(summary.mean()));
+  EXPECT_TRUE(std::isnan(summary.minimum()));
+  EXPECT_TRUE(std::isnan(summary.variance()));
+}
+
+
+TEST(StreamingStatistics, moments) {
+  StreamingStatistics summary(0.0, 10.0, 10);
+  double values[] = {2.0, 4.0, 4.0, 4.0, 5.0, 5.0, 7.0, 9.0};
+  summary.add(values, 8);
+  summary.add(NAN);
+  EXPECT_EQ(8u, summary.count());
+  EXPECT_EQ(1u, summary.invalidCount());
+  EXPECT_DOUBLE_EQ(2.0, summary.minimum());
+  EXPECT_DOUBLE_EQ(9.0, summary.maximum());
+  EXPECT_DOUBLE_EQ(5.0, summary.mean());
+  EXPECT_DOUBLE_EQ(32.0 / 7.0, summary.variance());
+}
+
+
+TEST(StreamingStatistics, infiniteValuesAreInvalid) {
+  StreamingStatistics summary(0.0, 10.0, 10), other(0.0, 10.0, 10);
+  summary.add(2.0);
+  summary.add(INFINITY);
+  summary.add(-INFINITY);
+  summary.add(4.0);
+  EXPECT_EQ(2u, summary.count());
+  EXPECT_EQ(2u, summary.invalidCount());
+  EXPECT_DOUBLE_EQ(4.0, summary.maximum());
+  EXPECT_DOUBLE_EQ(2.0, summary.variance());
+  EXPECT_EQ(0u, summary.overflow());
+
+  // Merging keeps the summary finite.
+  other.add(INFINITY);
+  other.add(3.0);
+  summary.merge(other);
+  EXPECT_EQ(3u, summary.count());
+  EXPECT_EQ(3u, summary.invalidCount());
+  EXPECT_DOUBLE_EQ(3.0, summary.mean());
+  EXPECT_DOUBLE_EQ(1.0, summary.variance());
+}
+
+
+TEST(StreamingStatistics, histogram) {
+  StreamingStatistics summary(0.0, 4.0, 4);
+  double values[] = {-1.0, 0.0, 0.5, 1.0, 3.9, 4.0, 4.5};
+  summary.add(values, 7);
+  ASSERT_EQ(4, summary.bins());
+  EXPECT_EQ(2u, summary.histogram()[0]);
+  EXPECT_EQ(1u, summary.histogram()[1]);
+  EXPECT_EQ(0u, summary.histogram()[2]);
+  EXPECT_EQ(2u, summary.histogram()[3]);
+  EXPECT_EQ(1u, summary.underflow());
+  EXPECT_EQ(1u, summary.overflow());
+  EXPECT_DOUBLE_EQ(3.0, summary.binMinimum(3));
+}
+
+
+TEST(StreamingStatistics, quantile) {
+  StreamingStatistics summary(0.0, 100.0, 100);
+  EXPECT_TRUE(std::isnan(summary.quantile(0.5)));
+  for (int i = 0; i < 1000; i++) {
+    summary.add(0.1 * i + 0.05);
+  }
+  summary.add(250.0);
+  EXPECT_NEAR(50.0, summary.quantile(0.5), 1.0);
+  EXPECT_NEAR(99.0, summary.quantile(0.99), 1.0);
+  EXPECT_DOUBLE_EQ(250.0, summary.quantile(1.0));
+  EXPECT_DOUBLE_EQ(1.0, summary.quantile(0.0));
+}
+
+
+TEST(StreamingStatistics, mergeMatchesSinglePass) {
+  StreamingStatistics all(0.0, 1.0, 8), first(0.0, 1.0, 8), second(0.0, 1.0, 8);
+  for (int i = 0; i < 100; i++) {
+    double value = std::fmod(i * 0.618034, 1.0);
+    all.add(value);
+    (i < 37 ? first : second).add(value);
+  }
+  first.merge(second);
+  EXPECT_EQ(all.count(), first.count());
+  EXPECT_DOUBLE_EQ(all.mean(), first.mean());
+  EXPECT_NEAR(all.variance(), first.variance(), 1e-12);
+  EXPECT_EQ(all.minimum(), first.minimum());
+  EXPECT_EQ(all.maximum(), first.maximum());
+  EXPECT_EQ(all.histogram(), first.histogram());
+}
+
+
+TEST(StreamingStatistics, mergeRejectsDifferentHistograms) {
+  StreamingStatistics summary(0.0, 1.0, 8);
+  EXPECT_THROW(summary.merge(StreamingStatistics(0.0, 1.0, 4)), std::invalid_argument);
+}
+
+
+TEST(StreamingStatistics, encodedValues) {
+  uint16_t codes[3];
+  EncodedBuffer buffer(Encoding::AngleFixed16, codes);
+  buffer.store(0, 0.5);
+  buffer.store(1, 1.0);
+  buffer.store(2, NAN);
+  StreamingStatistics summary;
+  summary.add(buffer, 3);
+  EXPECT_EQ(2u, summary.count());
+  EXPECT_EQ(1u, summary.invalidCount());
+  EXPECT_NEAR(0.75, summary.mean(), ANGLE_QUANTIZATION_ERROR);
+}
+
+
+TEST(summarize, matchesRaster) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 50, 60, 0.02);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  std::vector<double> raster(50 * 60);
+  backplane::evaluate(sensor, backplane::Incidence, 0, 0, 0, 50, 60, raster.data());
+  StreamingStatistics expected;
+  expected.add(raster.data(), raster.size());
+
+  StreamingStatistics summary;
+  backplane::summarize(sensor, backplane::Incidence, 50, 60, summary, 1, 7);
+  EXPECT_EQ(expected.count(), summary.count());
+  EXPECT_EQ(expected.invalidCount(), summary.invalidCount());
+  EXPECT_EQ(expected.minimum(), summary.minimum());
+  EXPECT_EQ(expected.maximum(), summary.maximum());
+  EXPECT_NEAR(expected.mean(), summary.mean(), 1e-12);
+  EXPECT_NEAR(expected.standardDeviation(), summary.standardDeviation(), 1e-12);
+  EXPECT_EQ(expected.histogram(), summary.histogram());
+}
+
+
+TEST(summarize, sameResultForAnyThreadCount) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 64, 40, 0.01);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  StreamingStatistics reference;
+  backplane::summarize(sensor, backplane::Phase, 64, 40, reference, 1, 3);
+
+  int threads[] = {2, 3, 7};
+  for (int i = 0; i < 3; i++) {
+    StreamingStatistics summary;
+    backplane::summarize(sensor, backplane::Phase, 64, 40, summary, threads[i], 3);
+    EXPECT_EQ(reference.count(), summary.count());
+    EXPECT_EQ(reference.mean(), summary.mean());
+    EXPECT_EQ(reference.variance(), summary.variance());
+    EXPECT_EQ(reference.histogram(), summary.histogram());
+  }
+
+  execution::Topology topology;
+  topology.nodes.push_back(std::vector<int>{0});
+  topology.nodes.push_back(std::vector<int>{1});
+  execution::ThreadPool pool(4, execution::NoPinning, topology);
+  StreamingStatistics pooled;
+  backplane::summarize(sensor, backplane::Phase, 64, 40, pooled, pool, 3);
+  EXPECT_EQ(reference.mean(), pooled.mean());
+  EXPECT_EQ(reference.variance(), pooled.variance());
+  EXPECT_EQ(reference.histogram(), pooled.histogram());
+}
+
+
+TEST(generate, collectsFullResolutionStatistics) {
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 32, 32, 0.01);
+  Sensor sensor(&model, CartesianPoint(1.0e6, 2.0e5, 3.0e5));
+  backplane::PyramidBuffer pyramid;
+  StreamingStatistics summary;
+  backplane::generate(sensor, backplane::Emission, 32, 32, 3, backplane::Reduce, pyramid, 8,
+                      EncodingFormat(), &summary);
+  StreamingStatistics expected;
+  expected.add(pyramid.levels[0].data(), pyramid.levels[0].size());
+  EXPECT_EQ(32u * 32u, summary.count() + summary.invalidCount());
+  EXPECT_EQ(expected.count(), summary.count());
+  EXPECT_EQ(expected.histogram(), summary.histogram());
+}
@@ -0,0 +1,161 @@
+#include "TerrainVisibility.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sensorcore.h"
+
+using namespace shapemodel;
+
+namespace {
+
+  // A 64 x 64 DEM with 1 km cells whose heights come from a function of (x, y).
+  template <typename Function>
+  std::shared_ptr<const ElevationModel> terrain(Function heightAt) {
+    const int64_t size = 64;
+    std::vector<double> heights(size * size);
+    for (int64_t line = 0; line < size; line++) {
+      for (int64_t sample = 0; sample < size; sample++) {
+        heights[line * size + sample] = heightAt(double(sample), double(line));
+      }
+    }
+    return std::make_shared<ElevationModel>(size, size, heights, 0.0, 0.0, 1.0);
+  }
+
+
+  double flat(double, double) {
+    return 0.0;
+  }
+
+
+  // A 10 km high north-south wall at x = 32.
+  double wall(double x, double) {
+    return x == 32.0 ? 10.0 : 0.0;
+  }
+
+
+  double hills(double x, double y) {
+    return 2.0 * std::sin(0.3 * x) * std::cos(0.2 * y) + 1.5 * std::sin(0.11 * (x + y))
+           + 3.0 * std::exp(-((x - 40.0) * (x - 40.0) + (y - 20.0) * (y - 20.0)) / 30.0);
+  }
+
+
+  CartesianPoint surfacePoint(const ElevationModel &dem, int64_t line, int64_t sample) {
+    return CartesianPoint(sample * dem.spacing(), line * dem.spacing(),
+                          dem.height(line, sample));
+  }
+}
+
+
+TEST(ElevationModel, interpolation) {
+  std::shared_ptr<const ElevationModel> dem = terrain(hills);
+  EXPECT_DOUBLE_EQ(hills(5.0, 7.0), dem->height(int64_t(7), int64_t(5)));
+  EXPECT_DOUBLE_EQ(hills(5.0, 7.0), dem->height(5.0, 7.0));
+  EXPECT_NEAR(0.5 * (hills(5.0, 7.0) + hills(6.0, 7.0)), dem->height(5.5, 7.0), 1e-12);
+  EXPECT_TRUE(std::isnan(dem->height(-0.5, 7.0)));
+  EXPECT_TRUE(std::isnan(dem->height(5.0, 63.5)));
+}
+
+
+TEST(ElevationModel, invalid) {
+  std::vector<double> heights(4, 0.0);
+  EXPECT_THROW(ElevationModel(2, 3, heights, 0.0, 0.0, 1.0), std::invalid_argument);
+  EXPECT_THROW(ElevationModel(2, 2, heights, 0.0, 0.0, 0.0), std::invalid_argument);
+  EXPECT_THROW(TerrainVisibility(std::shared_ptr<const ElevationModel>(), 32),
+               std::invalid_argument);
+}
+
+
+TEST(TerrainVisibility, flatPlane) {
+  TerrainVisibility visibility(terrain(flat), 16);
+  CartesianPoint point = surfacePoint(visibility.elevation(), 20, 30);
+  EXPECT_FALSE(visibility.isShadowed(point, CartesianVector(1.0, 0.5, 0.05)));
+  EXPECT_FALSE(visibility.rayMarchShadowed(point, CartesianVector(1.0, 0.5, 0.05)));
+  EXPECT_TRUE(visibility.isShadowed(point, CartesianVector(1.0, 0.0, -0.1)));
+  EXPECT_TRUE(visibility.isVisible(point, CartesianPoint(10.0, 10.0, 100.0)));
+  EXPECT_TRUE(visibility.rayMarchVisible(point, CartesianPoint(10.0, 10.0, 100.0)));
+}
+
+
+TEST(TerrainVisibility, wallShadow) {
+  TerrainVisibility visibility(terrain(wall), 32);
+  const ElevationModel &dem = visibility.elevation();
+  // Sun low in the east (+x), 45 degrees up: the wall shadows the 10 km west of it.
+  CartesianVector sun(1.0, 0.0, 1.0);
+  EXPECT_TRUE(visibility.isShadowed(surfacePoint(dem, 30, 25), sun));
+  EXPECT_TRUE(visibility.rayMarchShadowed(surfacePoint(dem, 30, 25), sun));
+  EXPECT_FALSE(visibility.isShadowed(surfacePoint(dem, 30, 20), sun));
+  EXPECT_FALSE(visibility.rayMarchShadowed(surfacePoint(dem, 30, 20), sun));
+  EXPECT_FALSE(visibility.isShadowed(surfacePoint(dem, 30, 40), sun));
+  // The sun in the west lights the same point.
+  EXPECT_FALSE(visibility.isShadowed(surfacePoint(dem, 30, 25), CartesianVector(-1.0, 0.0, 1.0)));
+  // Straight overhead nothing is shadowed.
+  EXPECT_FALSE(visibility.isShadowed(surfacePoint(dem, 30, 31), CartesianVector(0.0, 0.0, 1.0)));
+
+  // An observer far to the east and low sees the eastern face but not the cells behind the wall.
+  CartesianPoint observer(1000.0, 30.0, 100.0);
+  EXPECT_TRUE(visibility.isVisible(surfacePoint(dem, 30, 40), observer));
+  EXPECT_FALSE(visibility.isVisible(surfacePoint(dem, 30, 31), observer));
+  EXPECT_FALSE(visibility.rayMarchVisible(surfacePoint(dem, 30, 31), observer));
+}
+
+
+TEST(TerrainVisibility, horizonAgreesWithRayMarch) {
+  TerrainVisibility visibility(terrain(hills), 64);
+  const ElevationModel &dem = visibility.elevation();
+  CartesianPoint orbiter(-300.0, 150.0, 200.0);
+
+  int64_t total = 0, shadowAgreement = 0, visibilityAgreement = 0, shadowedCount = 0;
+  for (int64_t line = 0; line < dem.lines(); line++) {
+    for (int64_t sample = 0; sample < dem.samples(); sample++) {
+      CartesianPoint point = surfacePoint(dem, line, sample);
+      // Sun about 8 degrees above the horizon in the north-east.
+      CartesianVector sun(0.6, 0.8, 0.14);
+      bool shadowed = visibility.isShadowed(point, sun);
+      shadowAgreement += shadowed == visibility.rayMarchShadowed(point, sun);
+      shadowedCount += shadowed;
+      visibilityAgreement += visibility.isVisible(point, orbiter)
+                             == visibility.rayMarchVisible(point, orbiter);
+      total++;
+    }
+  }
+  EXPECT_GT(shadowedCount, total / 20);
+  EXPECT_LT(shadowedCount, total - total / 20);
+  EXPECT_GT(shadowAgreement, 0.95 * total);
+  EXPECT_GT(visibilityAgreement, 0.95 * total);
+}
+
+
+TEST(TerrainVisibility, masks) {
+  TerrainVisibility visibility(terrain(hills), 32);
+  const ElevationModel &dem = visibility.elevation();
+  std::vector<double> points, suns, observers;
+  for (int64_t line = 0; line < dem.lines(); line += 3) {
+    for (int64_t sample = 0; sample < dem.samples(); sample += 5) {
+      CartesianPoint point = surfacePoint(dem, line, sample);
+      points.insert(points.end(), {point.x, point.y, point.z});
+      suns.insert(suns.end(), {std::cos(0.1 * line), std::sin(0.1 * line), 0.2});
+      observers.insert(observers.end(), {500.0, -100.0 + line, 50.0 + sample});
+    }
+  }
+  size_t count = points.size() / 3;
+  std::vector<uint8_t> shadowed(count), visible(count), sharedShadowed(count);
+  visibility.shadowMask(points.data(), count, suns.data(), 3, shadowed.data());
+  visibility.visibilityMask(points.data(), count, observers.data(), 3, visible.data());
+  visibility.shadowMask(points.data(), count, suns.data(), 0, sharedShadowed.data());
+
+  CartesianVector firstSun(suns[0], suns[1], suns[2]);
+  for (size_t i = 0; i < count; i++) {
+    CartesianPoint point(points[3 * i], points[3 * i + 1], points[3 * i + 2]);
+    CartesianVector sun(suns[3 * i], suns[3 * i + 1], suns[3 * i + 2]);
+    CartesianPoint observer(observers[3 * i], observers[3 * i + 1], observers[3 * i + 2]);
+    EXPECT_EQ(visibility.isShadowed(point, sun), bool(shadowed[i]));
+    EXPECT_EQ(visibility.isVisible(point, observer), bool(visible[i]));
+    EXPECT_EQ(visibility.isShadowed(point, firstSun), bool(sharedShadowed[i]));
+  }
+}
@@ -0,0 +1,147 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+using namespace execution;
+
+namespace {
+
+  // Two nodes of two CPUs each; pinning to them may fail, which leaves threads unpinned.
+  Topology twoNodes() {
+    Topology topology;
+    topology.nodes.push_back(std::vector<int>{0, 1});
+    topology.nodes.push_back(std::vector<int>{2, 3});
+    return topology;
+  }
+}
+
+
+TEST(Topology, parseCpuList) {
+  std::vector<int> cpus = parseCpuList("0-3,8, 10-11\n");
+  std::vector<int> expected{0, 1, 2, 3, 8, 10, 11};
+  EXPECT_EQ(expected, cpus);
+  EXPECT_TRUE(parseCpuList("").empty());
+  EXPECT_THROW(parseCpuList("3-1"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("0-x"), std::invalid_argument);
+}
+
+
+TEST(Topology, readSysfs) {
+  char directory[] = "/tmp/ThreadPoolTesting-XXXXXX";
+  ASSERT_TRUE(mkdtemp(directory) != NULL);
+  std::string root = directory;
+  const char *nodes[] = {"node0", "node1", "node10"};
+  const char *lists[] = {"0-3,8-11", "4-7,12-15", ""};
+  for (int i = 0; i < 3; i++) {
+    std::string node = root + "/" + nodes[i];
+    ASSERT_EQ(0, mkdir(node.c_str(), 0700));
+    std::ofstream((node + "/cpulist").c_str()) << lists[i] << "\n";
+  }
+  ASSERT_EQ(0, mkdir((root + "/power").c_str(), 0700));
+
+  Topology topology = Topology::read(root);
+  ASSERT_EQ(2u, topology.nodes.size());
+  EXPECT_EQ(8u, topology.nodes[0].size());
+  EXPECT_EQ(4, topology.nodes[1][0]);
+  EXPECT_EQ(16, topology.cpuCount());
+  EXPECT_TRUE(Topology::read(root + "/missing").nodes.empty());
+  EXPECT_EQ(0, std::system(("rm -rf '" + root + "'").c_str()));
+
+  Topology detected = Topology::detect();
+  EXPECT_GE(detected.nodes.size(), 1u);
+  EXPECT_GE(detected.cpuCount(), 1);
+}
+
+
+TEST(ThreadPool, parallelForRunsEveryItemOnce) {
+  ThreadPool pool(4, PinToNode, twoNodes());
+  EXPECT_EQ(4, pool.threads());
+  EXPECT_EQ(2, pool.nodes());
+  std::vector<std::atomic<int> > counts(1000);
+  for (size_t i = 0; i < counts.size(); i++) {
+    counts[i] = 0;
+  }
+  pool.parallelFor(1000, [&](int64_t index) {
+    EXPECT_GE(ThreadPool::currentNode(), 0);
+    counts[index]++;
+  });
+  for (size_t i = 0; i < counts.size(); i++) {
+    EXPECT_EQ(1, counts[i]);
+  }
+  EXPECT_EQ(-1, ThreadPool::currentNode());
+}
+
+
+TEST(ThreadPool, nodesGetContiguousShares) {
+  ThreadPool pool(3, NoPinning, twoNodes());
+  // Node 0 has two of the three threads, so it gets the first two thirds of the items.
+  EXPECT_EQ(0, pool.nodeOf(0, 90));
+  EXPECT_EQ(0, pool.nodeOf(59, 90));
+  EXPECT_EQ(1, pool.nodeOf(60, 90));
+  EXPECT_EQ(1, pool.nodeOf(89, 90));
+
+  // With one node, every item belongs to it.
+  Topology oneNode;
+  oneNode.nodes.push_back(std::vector<int>{0, 1});
+  ThreadPool single(2, NoPinning, oneNode);
+  EXPECT_EQ(0, single.nodeOf(0, 2));
+  EXPECT_EQ(0, single.nodeOf(1, 2));
+}
+
+
+TEST(ThreadPool, nestedParallelFor) {
+  ThreadPool pool(2, NoPinning, twoNodes());
+  std::atomic<int> total(0);
+  pool.parallelFor(8, [&](int64_t) {
+    pool.parallelFor(8, [&](int64_t) {
+      total++;
+    });
+  });
+  EXPECT_EQ(64, total);
+}
+
+
+TEST(ThreadPool, exceptionsReachCaller) {
+  ThreadPool pool(2, NoPinning, twoNodes());
+  std::atomic<int> finished(0);
+  EXPECT_THROW(pool.parallelFor(10, [&](int64_t index) {
+    if (index == 3) {
+      throw std::runtime_error("item 3");
+    }
+    finished++;
+  }), std::runtime_error);
+  EXPECT_EQ(9, finished);
+}
+
+
+TEST(ThreadPool, submitRunsBeforeDestruction) {
+  std::atomic<int> ran(0);
+  {
+    ThreadPool pool(2, NoPinning, twoNodes());
+    for (int i = 0; i < 50; i++) {
+      pool.submit([&]() { ran++; }, i % 3 - 1);
+    }
+  }
+  EXPECT_EQ(50, ran);
+}
+
+
+TEST(FirstTouchBuffer, zeroedByBlocks) {
+  ThreadPool pool(3, NoPinning, twoNodes());
+  FirstTouchBuffer<double> buffer(pool, 100, 37, 7);
+  ASSERT_EQ(3700u, buffer.size());
+  for (size_t i = 0; i < buffer.size(); i++) {
+    EXPECT_EQ(0.0, buffer.data()[i]);
+  }
+}
@@ -0,0 +1,133 @@
+#include "Traversal.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sensorcore.h"
+#include "SensorModelFixtures.h"
+
+using namespace execution;
+
+TEST(Curve, mortonIndex) {
+  EXPECT_EQ(0u, mortonIndex(0, 0));
+  EXPECT_EQ(1u, mortonIndex(1, 0));
+  EXPECT_EQ(2u, mortonIndex(0, 1));
+  EXPECT_EQ(15u, mortonIndex(3, 3));
+  EXPECT_EQ(0xffffffffffffffffULL, mortonIndex(0xffffffffu, 0xffffffffu));
+}
+
+
+TEST(Curve, hilbertVisitsNeighbors) {
+  for (int bits = 1; bits <= 5; bits++) {
+    uint32_t size = 1u << bits;
+    std::vector<int> xs(size * size, -1), ys(size * size, -1);
+    for (uint32_t y = 0; y < size; y++) {
+      for (uint32_t x = 0; x < size; x++) {
+        uint64_t index = hilbertIndex(bits, x, y);
+        ASSERT_LT(index, uint64_t(size) * size);
+        ASSERT_EQ(-1, xs[index]);
+        xs[index] = int(x);
+        ys[index] = int(y);
+      }
+    }
+    EXPECT_EQ(0, xs[0] + ys[0]);
+    for (size_t i = 1; i < xs.size(); i++) {
+      EXPECT_EQ(1, std::abs(xs[i] - xs[i - 1]) + std::abs(ys[i] - ys[i - 1]));
+    }
+  }
+  EXPECT_EQ(5, curveBits(17));
+  EXPECT_EQ(1, curveBits(1));
+}
+
+
+TEST(TraversalSchedule, coversImageAlongCurve) {
+  TraversalSchedule schedule(250, 256, 32);
+  ASSERT_EQ(64u, schedule.size());
+  EXPECT_EQ(0u, schedule.groundTileCount());
+  std::vector<int> covered(250 * 256, 0);
+  for (size_t i = 0; i < schedule.size(); i++) {
+    const ImageTile &tile = schedule[i];
+    for (int line = 0; line < tile.lines; line++) {
+      for (int sample = 0; sample < tile.samples; sample++) {
+        covered[(tile.firstLine + line) * 256 + tile.firstSample + sample]++;
+      }
+    }
+    if (i > 0) {
+      const ImageTile &previous = schedule[i - 1];
+      EXPECT_EQ(32, std::abs(tile.firstLine - previous.firstLine)
+                    + std::abs(tile.firstSample - previous.firstSample));
+    }
+  }
+  for (size_t i = 0; i < covered.size(); i++) {
+    ASSERT_EQ(1, covered[i]);
+  }
+  // The curve runs from the top left tile to the top right one.
+  EXPECT_EQ(0, schedule[0].firstLine + schedule[0].firstSample);
+  EXPECT_EQ(0, schedule[63].firstLine);
+  EXPECT_EQ(224, schedule[63].firstSample);
+
+  TraversalSchedule rows(100, 100, 30, RowMajor);
+  EXPECT_EQ(90, rows[3].firstSample);
+  EXPECT_EQ(30, rows[4].firstLine);
+  EXPECT_THROW(TraversalSchedule(0, 10, 8), std::invalid_argument);
+}
+
+
+TEST(TraversalSchedule, groupsByGroundTile) {
+  // The image spans about 34 degrees of longitude and 29 of latitude.
+  SphereSensorModel model(10.0, CartesianPoint(100.0, 0.0, 0.0), 100, 120, 0.005);
+  TraversalSchedule schedule(model, 100, 120, 10, planetocentricTiles(10.0));
+  ASSERT_EQ(120u, schedule.size());
+  EXPECT_GT(schedule.groundTileCount(), 4u);
+
+  // Each ground tile is one run of the schedule, and runs come in key order.
+  std::set<int64_t> finished;
+  for (size_t i = 0; i < schedule.size(); i++) {
+    int64_t key = schedule[i].groundTile;
+    ASSERT_GE(key, 0);
+    EXPECT_EQ(0u, finished.count(key));
+    if (i > 0 && schedule[i - 1].groundTile != key) {
+      EXPECT_LT(schedule[i - 1].groundTile, key);
+      finished.insert(schedule[i - 1].groundTile);
+    }
+  }
+
+  // Every tile's center really lies on its ground tile.
+  GroundTileKey groundTile = planetocentricTiles(10.0);
+  for (size_t i = 0; i < schedule.size(); i++) {
+    const ImageTile &tile = schedule[i];
+    ImagePoint center(tile.firstSample + 0.5 * tile.samples, tile.firstLine + 0.5 * tile.lines,
+                      1.0);
+    EXPECT_EQ(groundTile(model.imageToGround(center)), tile.groundTile);
+  }
+  EXPECT_EQ(-1, groundTile(CartesianPoint(NAN, 0.0, 0.0)));
+  EXPECT_THROW(planetocentricTiles(0.0), std::invalid_argument);
+}
+
+
+TEST(curveOrder, sortsScatteredPoints) {
+  std::vector<ImagePoint> points;
+  points.push_back(ImagePoint(200.0, 10.0, 1.0));
+  points.push_back(ImagePoint(5.0, 5.0, 1.0));
+  points.push_back(ImagePoint(NAN, 5.0, 1.0));
+  points.push_back(ImagePoint(210.0, 20.0, 1.0));
+  points.push_back(ImagePoint(1.0, 2.0, 1.0));
+  points.push_back(ImagePoint(-1.0, 2.0, 1.0));
+  std::vector<size_t> order = curveOrder(points.data(), points.size(), 64.0);
+  ASSERT_EQ(6u, order.size());
+  // Points sharing a cell stay together and in their original order; invalid ones go last.
+  EXPECT_EQ(1u, order[0]);
+  EXPECT_EQ(4u, order[1]);
+  EXPECT_EQ(0u, order[2]);
+  EXPECT_EQ(3u, order[3]);
+  EXPECT_EQ(2u, order[4]);
+  EXPECT_EQ(5u, order[5]);
+  EXPECT_THROW(curveOrder(points.data(), points.size(), 0.0), std::invalid_argument);
+}
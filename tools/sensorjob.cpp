@@ -0,0 +1,63 @@
+// Command-line driver for sharded backplane jobs (see ShardedJob.h).
+//
+//   sensorjob plan <job file>          Lists the tile range of every shard.
+//   sensorjob run <job file> <shard>   Computes one shard; skips it if already complete.
+//   sensorjob merge <job file>         Assembles the shard files into the product.
+
+#include <climits>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "ShardedJob.h"
+
+namespace {
+
+  int usage() {
+    std::cerr << "usage: sensorjob plan <job file>\n"
+                 "       sensorjob run <job file> <shard>\n"
+                 "       sensorjob merge <job file>\n";
+    return 2;
+  }
+}
+
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    return usage();
+  }
+  std::string command = argv[1];
+  try {
+    backplane::JobDescription job = backplane::readJob(std::string(argv[2]));
+    if (command == "plan" && argc == 3) {
+      std::cout << backplane::tileCount(job) << " tiles in " << job.shards << " shards\n";
+      for (int shard = 0; shard < job.shards; shard++) {
+        backplane::ShardRange range = backplane::shardRange(job, shard);
+        std::cout << shard << " " << range.firstTile << " " << range.tileCount << " "
+                  << (backplane::shardComplete(job, shard) ? "complete" : "pending") << "\n";
+      }
+    }
+    else if (command == "run" && argc == 4) {
+      char *end;
+      long shard = std::strtol(argv[3], &end, 10);
+      if (end == argv[3] || *end != '\0' || shard < 0 || shard > INT_MAX) {
+        return usage();
+      }
+      bool computed = backplane::runShard(job, int(shard));
+      std::cout << "shard " << shard << (computed ? " computed" : " already complete") << "\n";
+    }
+    else if (command == "merge" && argc == 3) {
+      backplane::mergeShards(job);
+      std::cout << "wrote " << job.output << "\n";
+    }
+    else {
+      return usage();
+    }
+  }
+  catch (const std::exception &error) {
+    std::cerr << "sensorjob: " << error.what() << "\n";
+    return 1;
+  }
+  return 0;
+}